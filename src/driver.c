@@ -51,6 +51,7 @@ typedef enum
     OPTION_EXA_COMPRESSION_JPEG_QUALITY,
     OPTION_EXA_COMPRESSION_PNG,
     OPTION_EXA_ERASE_PIXMAPS,
+    OPTION_EXA_COPY_THREADS,
 } TegraOptions;
 
 static const OptionInfoRec Options[] = {
@@ -65,6 +66,7 @@ static const OptionInfoRec Options[] = {
     { OPTION_EXA_COMPRESSION_JPEG_QUALITY, "JPEGCompressionQuality", OPTV_INTEGER, { 0 }, FALSE },
     { OPTION_EXA_COMPRESSION_PNG, "DisableCompressionPNG", OPTV_BOOLEAN, { 0 }, FALSE },
     { OPTION_EXA_ERASE_PIXMAPS, "SecureErasePixmaps", OPTV_BOOLEAN, { 0 }, FALSE },
+    { OPTION_EXA_COPY_THREADS, "CopyThreads", OPTV_INTEGER, { 0 }, FALSE },
     { -1, NULL, OPTV_NONE, { 0 }, FALSE }
 };
 
@@ -483,6 +485,15 @@ TegraPreInit(ScrnInfoPtr pScrn, int flags)
                 "EXA secure erase pixmaps: enabled %s\n",
                 tegra->exa_erase_pixmaps ? "YES" : "NO");
 
+    /* 0 selects the default number of threads */
+    tegra->exa_copy_threads = 0;
+    xf86GetOptValInteger(tegra->Options, OPTION_EXA_COPY_THREADS,
+                         &tegra->exa_copy_threads);
+    tegra->exa_copy_threads = max(0, tegra->exa_copy_threads);
+
+    xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+                "EXA copy threads: %d\n", tegra->exa_copy_threads);
+
     /* Load the required sub modules */
     if (!xf86LoadSubModule(pScrn, "dri2") ||
         !xf86LoadSubModule(pScrn, "fb"))
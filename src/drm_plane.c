@@ -23,6 +23,8 @@
  */
 
 #include "driver.h"
+#include "memcpy-vfp/memcpy_vfp.h"
+#include "memcpy-vfp/pixel_convert.h"
 
 #define HANDLE_INVALID  0
 
@@ -672,17 +674,64 @@ static void copy_plane_data(uint8_t *dst, uint8_t *src,
                             unsigned pitch_dst,
                             unsigned pitch_src)
 {
-    unsigned i;
+    char *cdst = (char *)dst;
+    char *csrc = (char *)src;
 
-    if (pitch_dst == pitch_src)
-        memcpy(dst, src, height * pitch_dst);
+    if (pitch_dst == pitch_src) {
+        pitch_src *= height;
+        pitch_dst  = pitch_src;
+        height     = 1;
+    }
+
+    /* client's data is cacheable, framebuffer's BO is write-combined */
+    if (tegra_memcpy_vfp_copy_is_safe(cdst, csrc, pitch_src) &&
+        (height == 1 || pitch_dst % 128 == 0))
+        tegra_copy_block_vfp_arm_2d(cdst, pitch_dst, csrc, pitch_src,
+                                    pitch_src, height);
     else
-        for (i = 0; i < height; i++, dst += pitch_dst, src += pitch_src)
-            memcpy(dst, src, pitch_src);
+        tegra_memcpy_2d(cdst, pitch_dst, csrc, pitch_src,
+                        pitch_src, height);
+}
+
+/*
+ * Overlay plane may lack planar YUV support, in that case client's YV12 /
+ * I420 data is packed into YUYV framebuffer line-by-line.
+ */
+static void pack_planar_data(drm_overlay_fb *fb, uint8_t *data, int swap)
+{
+    uint32_t format = DRM_FORMAT_YUV420;
+    unsigned pitch_y = fb_pitch(format, fb->width);
+    unsigned pitch_c = fb_pitch_c(format, fb->width);
+    uint8_t *src_y = data;
+    uint8_t *src_v = src_y + fb_size(format, fb->width, fb->height);
+    uint8_t *src_u = src_v + fb_size_c(format, fb->width, fb->height);
+    uint8_t *dst = fb->bo_mmap;
+    unsigned y;
+
+    /* I420 has U plane first, YV12 has V plane first */
+    if (swap) {
+        uint8_t *tmp = src_u;
+        src_u = src_v;
+        src_v = tmp;
+    }
+
+    for (y = 0; y < fb->height; y++, dst += fb->pitch)
+        tegra_convert_yuv_to_packed(dst,
+                                    src_y + y * pitch_y,
+                                    src_u + y / 2 * pitch_c,
+                                    src_v + y / 2 * pitch_c,
+                                    fb->width,
+                                    fb->format == DRM_FORMAT_UYVY);
 }
 
-void drm_copy_data_to_fb(drm_overlay_fb *fb, uint8_t *data, int swap)
+void drm_copy_data_to_fb(drm_overlay_fb *fb, uint8_t *data, int swap,
+                         Bool planar_src)
 {
+    if (planar_src && !format_planar(fb->format)) {
+        pack_planar_data(fb, data, swap);
+        return;
+    }
+
     if (!format_planar(fb->format)) {
         copy_plane_data(fb->bo_mmap, data,
                         fb->width, fb->height,
@@ -101,7 +101,8 @@ int drm_get_overlay_plane(int drm_fd, int crtc_pipe, uint32_t format,
 
 int drm_get_primary_plane(int drm_fd, int crtc_pipe, uint32_t *plane_id);
 
-void drm_copy_data_to_fb(drm_overlay_fb *fb, uint8_t *data, int swap);
+void drm_copy_data_to_fb(drm_overlay_fb *fb, uint8_t *data, int swap,
+                         Bool planar_src);
 
 int drm_set_planes_rotation(int drm_fd, uint32_t crtc_mask, uint32_t mode);
 
@@ -248,24 +248,27 @@ static bool tegra_exa_prepare_composite(int op,
     ScrnInfoPtr pScrn = xf86ScreenToScrn(dst->drawable.pScreen);
     TegraPtr tegra = TegraPTR(pScrn);
     struct tegra_pixmap * priv;
+    bool prefer_3d = false;
 
     PROFILE_STOP(composite)
     PROFILE_START(composite)
 
     ACCEL_MSG("\n");
 
-    /* Use GR2D for simple solid fills as usually it is more optimal. */
-    if (tegra_exa_prepare_composite_2d(op, src_picture, mask_picture, dst_picture,
-                                       src, mask, dst)) {
-        ACCEL_MSG("GR2D: op: %s\n", op_name(op));
-        dump_pict("GR2D: src", src, src_picture, true);
-        dump_pict("GR2D: dst", dst, dst_picture, true);
-
-        PROFILE_STOP(composite)
-        PROFILE_START(composite)
-
-        return true;
-    }
+    /*
+     * Use GR2D for simple solid fills and copies as usually it is more
+     * optimal, unless cost model tells otherwise, like in a case of
+     * destination that is being rendered by GR3D.
+     */
+    if (tegra->exa_compositing && !mask_picture &&
+        (op == PictOpSrc || op == PictOpClear))
+        prefer_3d = tegra_exa_cost_select_composite_engine(tegra->exa, dst) ==
+                    TEGRA_3D;
+
+    if (!prefer_3d &&
+        tegra_exa_prepare_composite_2d(op, src_picture, mask_picture, dst_picture,
+                                       src, mask, dst))
+        goto accel_2d;
 
     if (!tegra->exa_compositing)
         goto fallback;
@@ -283,6 +286,11 @@ static bool tegra_exa_prepare_composite(int op,
         return true;
     }
 
+    if (prefer_3d &&
+        tegra_exa_prepare_composite_2d(op, src_picture, mask_picture, dst_picture,
+                                       src, mask, dst))
+        goto accel_2d;
+
     if (src_picture && src_picture->pDrawable) {
         priv = exaGetPixmapDriverPrivate(src);
         priv->picture_format = src_picture->format;
@@ -305,6 +313,16 @@ fallback:
     dump_pict("dst",  dst,  dst_picture,  false);
 
     return false;
+
+accel_2d:
+    ACCEL_MSG("GR2D: op: %s\n", op_name(op));
+    dump_pict("GR2D: src", src, src_picture, true);
+    dump_pict("GR2D: dst", dst, dst_picture, true);
+
+    PROFILE_STOP(composite)
+    PROFILE_START(composite)
+
+    return true;
 }
 
 static void tegra_exa_composite(PixmapPtr dst,
@@ -319,6 +337,9 @@ static void tegra_exa_composite(PixmapPtr dst,
     ACCEL_MSG("src %dx%d mask %dx%d dst %dx%d w:h %d:%d\n",
               src_x, src_y, mask_x, mask_y, dst_x, dst_y, width, height);
 
+    /* sources may be transformed or repeated, only destination is known */
+    tegra->scratch.dst_bands |= tegra_exa_pixmap_bands(dst, dst_y, height);
+
     if (tegra->scratch.op2d == TEGRA2D_SOLID)
         return tegra_exa_solid_2d(dst, dst_x, dst_y,
                                   dst_x + width, dst_y + height);
@@ -327,6 +348,11 @@ static void tegra_exa_composite(PixmapPtr dst,
         return tegra_exa_copy_2d_ext(dst, src_x, src_y,
                                      dst_x, dst_y, width, height);
 
+    if (tegra->scratch.op2d == TEGRA2D_COPY_TRANSLATE)
+        return tegra_exa_composite_copy_2d_translate(dst, src_x, src_y,
+                                                     dst_x, dst_y,
+                                                     width, height);
+
     return tegra_exa_composite_3d(dst, src_x, src_y, mask_x, mask_y,
                                   dst_x, dst_y, width, height);
 }
@@ -338,8 +364,12 @@ static void tegra_exa_done_composite(PixmapPtr dst)
 
     if (tegra->scratch.op2d == TEGRA2D_SOLID)
         tegra_exa_done_solid_2d(dst);
-    else if (tegra->scratch.op2d == TEGRA2D_COPY)
+    else if (tegra->scratch.op2d == TEGRA2D_COPY) {
+        tegra_exa_flush_rotate_boxes(tegra, dst);
         tegra_exa_done_copy_2d(dst);
+    }
+    else if (tegra->scratch.op2d == TEGRA2D_COPY_TRANSLATE)
+        tegra_exa_done_composite_copy_2d_translate(dst);
     else
         tegra_exa_done_composite_3d(dst);
 
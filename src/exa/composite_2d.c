@@ -94,12 +94,59 @@ tegra_exa_transform_is_supported(int32_t dw, int32_t dh,
     /*
      * Transposing currently unimplemented (no real use-case),
      * More complex transformations (like scaling, skewing) can't be done
-     * on GR2D.
+     * by the FR unit.
+     *
+     * TODO: scale-only transforms and planar YUV sources could go to the
+     * stretch-blit (SB) unit, which has DDA scaling and CSC. Nothing in
+     * the driver programs SB yet, so these composites are left to GR3D,
+     * which handles them via tegra_exa_simple_transform_scale().
      */
     FALLBACK_MSG("complex transform\n");
     return false;
 }
 
+/*
+ * Copying with an identity or integer-translation transform doesn't need
+ * texture sampling, GR2D takes it over from GR3D. Only bit-exact copies are
+ * accepted, the destination format may drop the alpha channel of the source.
+ */
+static bool
+tegra_exa_composite_copy_2d_translate_supported(PicturePtr src_picture,
+                                                PicturePtr dst_picture)
+{
+    PictFormatShort src_format = src_picture->format;
+    PictFormatShort dst_format = dst_picture->format;
+
+    if (src_picture->pDrawable->type != DRAWABLE_PIXMAP)
+        return false;
+
+    if (src_picture->repeat || src_picture->alphaMap || dst_picture->alphaMap)
+        return false;
+
+    if (src_picture->filter == PictFilterConvolution)
+        return false;
+
+    switch (tegra_exa_transform_type(src_picture->transform)) {
+    case TEGRA_TRANSFORM_IDENTITY:
+    case TEGRA_TRANSFORM_TRANSLATE:
+        break;
+
+    default:
+        return false;
+    }
+
+    if (src_format == dst_format)
+        return true;
+
+    if (PICT_FORMAT_A(dst_format) ||
+        PICT_FORMAT_BPP(src_format) != PICT_FORMAT_BPP(dst_format) ||
+        PICT_FORMAT_TYPE(src_format) != PICT_FORMAT_TYPE(dst_format) ||
+        PICT_FORMAT_RGB(src_format) != PICT_FORMAT_RGB(dst_format))
+        return false;
+
+    return true;
+}
+
 static bool tegra_exa_check_composite_2d(int op,
                                          PicturePtr src_picture,
                                          PicturePtr mask_picture,
@@ -116,9 +163,6 @@ static bool tegra_exa_check_composite_2d(int op,
         if (op != PictOpSrc)
             return false;
 
-        if (!src_picture->transform)
-            return false;
-
         if (mask_picture)
             return false;
 
@@ -126,6 +170,13 @@ static bool tegra_exa_check_composite_2d(int op,
             dst_picture->pDrawable->bitsPerPixel)
             return false;
 
+        if (tegra_exa_composite_copy_2d_translate_supported(src_picture,
+                                                            dst_picture))
+            return true;
+
+        if (!src_picture->transform)
+            return false;
+
         if (!tegra_exa_transform_is_supported(dst_picture->pDrawable->width,
                                               dst_picture->pDrawable->height,
                                               src_picture->pDrawable->width,
@@ -260,10 +311,140 @@ static bool tegra_exa_prepare_composite_copy_2d_rotate(int op,
         return false;
 
     tegra->scratch.transform = *src_picture->transform;
+    tegra->num_rotate_boxes = 0;
 
     return tegra_exa_prepare_copy_2d_ext(src, dst, GXcopy, FB_ALLONES);
 }
 
+static bool tegra_exa_prepare_composite_copy_2d_translate(int op,
+                                                          PicturePtr src_picture,
+                                                          PicturePtr mask_picture,
+                                                          PicturePtr dst_picture,
+                                                          PixmapPtr src,
+                                                          PixmapPtr dst)
+{
+    ScrnInfoPtr scrn = xf86ScreenToScrn(dst->drawable.pScreen);
+    struct tegra_exa *tegra = TegraPTR(scrn)->exa;
+    PictTransformPtr t;
+
+    if (mask_picture)
+        return false;
+
+    if (op != PictOpSrc)
+        return false;
+
+    if (!src_picture || !src_picture->pDrawable)
+        return false;
+
+    if (src->drawable.bitsPerPixel != dst->drawable.bitsPerPixel)
+        return false;
+
+    if (!tegra_exa_composite_copy_2d_translate_supported(src_picture,
+                                                         dst_picture))
+        return false;
+
+    /* regular copy takes care of deferred fills and alpha tracking */
+    if (!tegra_exa_prepare_copy_2d(src, dst, 0, 0, GXcopy, FB_ALLONES))
+        return false;
+
+    t = src_picture->transform;
+
+    tegra->scratch.translate_x = t ? pixman_fixed_to_int(t->matrix[0][2]) : 0;
+    tegra->scratch.translate_y = t ? pixman_fixed_to_int(t->matrix[1][2]) : 0;
+    tegra->scratch.clear_2d = false;
+
+    return true;
+}
+
+static void tegra_exa_composite_clear_2d(struct tegra_exa *tegra,
+                                         PixmapPtr dst,
+                                         int x1, int y1, int x2, int y2)
+{
+    bool prepared = tegra->scratch.clear_2d;
+
+    if (x1 >= x2 || y1 >= y2)
+        return;
+
+    /*
+     * Clearing is a solid fill, which can't be mixed into the copy job,
+     * hence it is recorded into a separate job. Both jobs write to
+     * disjoint areas, so their execution order doesn't matter.
+     */
+    tegra_exa_wrap_state(tegra, &tegra->opt_state[TEGRA_OPT_CLEAR]);
+
+    if (!prepared)
+        prepared = tegra_exa_prepare_solid_2d(dst, GXcopy, FB_ALLONES, 0);
+
+    if (prepared)
+        tegra_exa_solid_2d(dst, x1, y1, x2, y2);
+    else
+        ERROR_MSG("failed to clear area outside of source\n");
+
+    tegra_exa_unwrap_state(tegra, &tegra->opt_state[TEGRA_OPT_CLEAR]);
+
+    tegra->scratch.clear_2d = prepared;
+}
+
+static void tegra_exa_composite_copy_2d_translate(PixmapPtr dst,
+                                                  int src_x, int src_y,
+                                                  int dst_x, int dst_y,
+                                                  int width, int height)
+{
+    ScrnInfoPtr scrn = xf86ScreenToScrn(dst->drawable.pScreen);
+    struct tegra_exa *tegra = TegraPTR(scrn)->exa;
+    PixmapPtr src = tegra->scratch.src;
+    int x1, y1, x2, y2;
+
+    src_x += tegra->scratch.translate_x;
+    src_y += tegra->scratch.translate_y;
+
+    x1 = max(src_x, 0);
+    y1 = max(src_y, 0);
+    x2 = min(src_x + width, src->drawable.width);
+    y2 = min(src_y + height, src->drawable.height);
+
+    if (x1 >= x2 || y1 >= y2) {
+        tegra_exa_composite_clear_2d(tegra, dst, dst_x, dst_y,
+                                     dst_x + width, dst_y + height);
+        return;
+    }
+
+    tegra_exa_copy_2d(dst, x1, y1, dst_x + x1 - src_x, dst_y + y1 - src_y,
+                      x2 - x1, y2 - y1);
+
+    /* PictOpSrc writes transparent black outside of the source bounds */
+    tegra_exa_composite_clear_2d(tegra, dst,
+                                 dst_x, dst_y,
+                                 dst_x + width, dst_y + y1 - src_y);
+
+    tegra_exa_composite_clear_2d(tegra, dst,
+                                 dst_x, dst_y + y2 - src_y,
+                                 dst_x + width, dst_y + height);
+
+    tegra_exa_composite_clear_2d(tegra, dst,
+                                 dst_x, dst_y + y1 - src_y,
+                                 dst_x + x1 - src_x, dst_y + y2 - src_y);
+
+    tegra_exa_composite_clear_2d(tegra, dst,
+                                 dst_x + x2 - src_x, dst_y + y1 - src_y,
+                                 dst_x + width, dst_y + y2 - src_y);
+}
+
+static void tegra_exa_done_composite_copy_2d_translate(PixmapPtr dst)
+{
+    ScrnInfoPtr scrn = xf86ScreenToScrn(dst->drawable.pScreen);
+    struct tegra_exa *tegra = TegraPTR(scrn)->exa;
+    bool clear = tegra->scratch.clear_2d;
+
+    tegra_exa_done_copy_2d(dst);
+
+    if (clear) {
+        tegra_exa_wrap_state(tegra, &tegra->opt_state[TEGRA_OPT_CLEAR]);
+        tegra_exa_done_solid_2d(dst);
+        tegra_exa_unwrap_state(tegra, &tegra->opt_state[TEGRA_OPT_CLEAR]);
+    }
+}
+
 static bool tegra_exa_prepare_composite_2d(int op,
                                            PicturePtr src_picture,
                                            PicturePtr mask_picture,
@@ -289,6 +470,13 @@ static bool tegra_exa_prepare_composite_2d(int op,
         return true;
     }
 
+    if (tegra_exa_prepare_composite_copy_2d_translate(op, src_picture,
+                                                      mask_picture,
+                                                      dst_picture, src, dst)) {
+        tegra->scratch.op2d = TEGRA2D_COPY_TRANSLATE;
+        return true;
+    }
+
     return false;
 }
 
@@ -41,6 +41,16 @@
 #define TEX_NORMAL          4
 #define TEX_MIRROR          5
 
+/*
+ * Rects sharing the same texture coordinates mapping are drawn using a
+ * single bounding quad and a scissored draw per rect if there are at least
+ * that many of them in a row. Every draw costs a scissor update and two
+ * syncpoint waits, while splitting on CPU costs clipping / transformation
+ * and six vertices per rect, hence scissoring pays off only for a larger
+ * number of rects.
+ */
+#define TEGRA_3D_SCISSOR_MIN_RECTS  8
+
 #define PROG_SEL(SRC_SEL, MASK_SEL) ((SRC_SEL) | ((MASK_SEL) << 3))
 
 #define PROG_DEF(OP_NAME) \
@@ -201,7 +211,7 @@ static bool
 tegra_exa_texture_optimized_out(PicturePtr picture, PixmapPtr pixmap,
                                 const struct tegra_composite_config *cfg)
 {
-    struct tegra_pixmap *priv;
+    Pixel color;
 
     /*
      * GR3D performance is quite slow for a non-trivial shaders,
@@ -214,19 +224,15 @@ tegra_exa_texture_optimized_out(PicturePtr picture, PixmapPtr pixmap,
                 return true;
     }
 
-    if (pixmap) {
-        priv = exaGetPixmapDriverPrivate(pixmap);
-
-        if (priv->state.solid_fill) {
-            if (picture->repeat)
-                return true;
+    if (pixmap && tegra_exa_pixmap_solid_color(pixmap, &color)) {
+        if (picture->repeat)
+            return true;
 
-            if (priv->state.solid_color == 0x0)
-                return true;
+        if (color == 0x0)
+            return true;
 
-            if (!cfg || cfg->discards_clipped_area)
-                return true;
-        }
+        if (!cfg || cfg->discards_clipped_area)
+            return true;
     }
 
     return false;
@@ -456,20 +462,20 @@ static bool tegra_exa_check_composite_3d(int op,
 
 static Pixel tegra_exa_optimized_texture_color(PixmapPtr pix)
 {
-    struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(pix);
     Pixel color = 0x00000000;
+    Pixel solid;
     void *ptr;
 
-    if (priv->state.solid_fill) {
+    if (tegra_exa_pixmap_solid_color(pix, &solid)) {
         switch (pix->drawable.bitsPerPixel) {
         case 8:
-            color = priv->state.solid_color << 24;
+            color = solid << 24;
             break;
         case 16:
-            color = priv->state.solid_color;
+            color = solid;
             break;
         case 32:
-            color = priv->state.solid_color;
+            color = solid;
             break;
         }
         goto done;
@@ -511,8 +517,10 @@ static bool tegra_exa_prepare_composite_3d(int op,
     bool src_tex = (src_picture && src_picture->pDrawable);
     struct tegra_exa *tegra = TegraPTR(pScrn)->exa;
     struct tegra_3d_draw_state draw_state;
+    unsigned atlas_x = 0, atlas_y = 0;
     bool mask_tex_reduced = true;
     bool src_tex_reduced = true;
+    PixmapPtr atlas;
     unsigned mask_sel;
     unsigned src_sel;
     Pixel solid;
@@ -526,6 +534,35 @@ static bool tegra_exa_prepare_composite_3d(int op,
 
     memset(&draw_state, 0, sizeof(draw_state));
 
+    /*
+     * Glyph uploading uses the main drawing context, hence it should be
+     * done before entering the optimization state.
+     */
+    atlas = tegra_exa_glyph_atlas_lookup(tegra, op, mask_picture, pmask,
+                                         &atlas_x, &atlas_y);
+
+    /*
+     * GR3D samples linear textures only, tiled pixmap is sampled from its
+     * linear copy. Copying is a GR2D job, hence it's done here as well.
+     */
+    if (src_tex && tegra_exa_pixmap_is_tiled(psrc) &&
+        !tegra_exa_texture_optimized_out(src_picture, psrc, cfg)) {
+        psrc = tegra_exa_detiled_copy(tegra, psrc);
+        if (!psrc) {
+            FALLBACK_MSG("failed to copy tiled src texture\n");
+            return false;
+        }
+    }
+
+    if (mask_tex && !atlas && tegra_exa_pixmap_is_tiled(pmask) &&
+        !tegra_exa_texture_optimized_out(mask_picture, pmask, cfg)) {
+        pmask = tegra_exa_detiled_copy(tegra, pmask);
+        if (!pmask) {
+            FALLBACK_MSG("failed to copy tiled mask texture\n");
+            return false;
+        }
+    }
+
     tegra_exa_enter_optimization_3d_state(tegra);
 
     if (src_tex && tegra_exa_texture_optimized_out(src_picture, psrc, cfg))
@@ -544,9 +581,26 @@ static bool tegra_exa_prepare_composite_3d(int op,
     if (mask_tex_reduced)
         ACCEL_MSG("mask texture reduced\n");
 
+    tegra->scratch.mask_atlas = false;
+
+    if (mask_tex && atlas) {
+        ACCEL_MSG("mask texture sampled from glyph atlas %u:%u\n",
+                  atlas_x, atlas_y);
+
+        tegra->scratch.mask_atlas = true;
+        tegra->scratch.mask_atlas_x = atlas_x;
+        tegra->scratch.mask_atlas_y = atlas_y;
+        tegra->scratch.mask_atlas_width = pmask->drawable.width;
+        tegra->scratch.mask_atlas_height = pmask->drawable.height;
+
+        pmask = atlas;
+    }
+
     tegra->scratch.mask = (op != PictOpClear && mask_tex) ? pmask : NULL;
     tegra->scratch.src = (op != PictOpClear && src_tex) ? psrc : NULL;
     tegra->scratch.ops = 0;
+    tegra->scratch.dst_bands = 0;
+    tegra->scratch.src_bands = 0;
 
     if (src_picture) {
         if (tegra->scratch.src) {
@@ -578,10 +632,15 @@ static bool tegra_exa_prepare_composite_3d(int op,
 
             if (src_picture->transform) {
                 tegra->scratch.transform_src = *src_picture->transform;
+                tegra->scratch.transform_src_type =
+                    tegra_exa_transform_type(&tegra->scratch.transform_src);
 
-                if (src_sel == TEX_CLIPPED)
+                if (src_sel == TEX_CLIPPED) {
                     pixman_transform_invert(&tegra->scratch.transform_src_inv,
                                             &tegra->scratch.transform_src);
+                    tegra->scratch.transform_src_inv_type =
+                        tegra_exa_transform_type(&tegra->scratch.transform_src_inv);
+                }
 
                 draw_state.src.transform_coords = true;
             }
@@ -649,10 +708,15 @@ static bool tegra_exa_prepare_composite_3d(int op,
 
             if (mask_picture->transform) {
                 tegra->scratch.transform_mask = *mask_picture->transform;
+                tegra->scratch.transform_mask_type =
+                    tegra_exa_transform_type(&tegra->scratch.transform_mask);
 
-                if (mask_sel == TEX_CLIPPED)
+                if (mask_sel == TEX_CLIPPED) {
                     pixman_transform_invert(&tegra->scratch.transform_mask_inv,
                                             &tegra->scratch.transform_mask);
+                    tegra->scratch.transform_mask_inv_type =
+                        tegra_exa_transform_type(&tegra->scratch.transform_mask_inv);
+                }
 
                 draw_state.mask.transform_coords = true;
             }
@@ -711,17 +775,21 @@ fail:
     return false;
 }
 
-static void tegra_exa_composite_3d(PixmapPtr pdst,
-                                   int src_x, int src_y,
-                                   int mask_x, int mask_y,
-                                   int dst_x, int dst_y,
-                                   int width, int height)
+static void tegra_exa_composite_3d_rect(PixmapPtr pdst,
+                                        int src_x, int src_y,
+                                        int mask_x, int mask_y,
+                                        int dst_x, int dst_y,
+                                        int width, int height)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pdst->drawable.pScreen);
     struct tegra_exa *tegra = TegraPTR(pScrn)->exa;
     struct tegra_3d_state *state = &tegra->gr3d_state;
     PictTransformPtr mask_t = NULL, mask_t_inv = NULL;
     PictTransformPtr src_t = NULL, src_t_inv = NULL;
+    enum tegra_transform_type mask_type = TEGRA_TRANSFORM_IDENTITY;
+    enum tegra_transform_type mask_inv_type = TEGRA_TRANSFORM_IDENTITY;
+    enum tegra_transform_type src_type = TEGRA_TRANSFORM_IDENTITY;
+    enum tegra_transform_type src_inv_type = TEGRA_TRANSFORM_IDENTITY;
     struct tegra_3d_draw_state *draw_state = &state->new;
     float dst_left, dst_right, dst_top, dst_bottom;
     float src_left  = 0, src_right  = 0, src_top  = 0, src_bottom = 0;
@@ -730,6 +798,7 @@ static void tegra_exa_composite_3d(PixmapPtr pdst,
     bool push_src = !!tegra->scratch.src;
     int swidth = 0, sheight = 0;
     int mwidth = 0, mheight = 0;
+    int mask_offset_x = 0, mask_offset_y = 0;
     struct tegra_box src_untransformed = {0}, mask_untransformed = {0};
     struct tegra_box src_transformed = {0}, mask_transformed = {0};
     struct tegra_box src = {0}, mask = {0};
@@ -740,15 +809,10 @@ static void tegra_exa_composite_3d(PixmapPtr pdst,
     if (draw_state->optimized_out)
         goto degenerate;
 
-    /* if attributes buffer is full, do nothing for now (TODO better job) */
-    if (tegra_exa_attributes_buffer_is_full(&tegra->scratch)) {
-        ERROR_MSG("FIXME: attributes buffer is full\n");
-        return;
-    }
-
     if (dst_x == 0 && dst_y == 0 &&
         pdst->drawable.width == width &&
-        pdst->drawable.height == height)
+        pdst->drawable.height == height &&
+        !tegra->scratch.mask_atlas)
         draw_state->dst_full_cover = 1;
 
     dst.x0 = dst_x;
@@ -762,13 +826,23 @@ static void tegra_exa_composite_3d(PixmapPtr pdst,
     if (draw_state->src.transform_coords) {
         src_t = &tegra->scratch.transform_src;
         src_t_inv = &tegra->scratch.transform_src_inv;
+        src_type = tegra->scratch.transform_src_type;
+        src_inv_type = tegra->scratch.transform_src_inv_type;
     }
 
     if (draw_state->mask.transform_coords) {
         mask_t = &tegra->scratch.transform_mask;
         mask_t_inv = &tegra->scratch.transform_mask_inv;
+        mask_type = tegra->scratch.transform_mask_type;
+        mask_inv_type = tegra->scratch.transform_mask_inv_type;
     }
 
+    if (src_type == TEGRA_TRANSFORM_GENERAL ||
+        mask_type == TEGRA_TRANSFORM_GENERAL)
+        tegra->stats.num_3d_general_transformed_rects++;
+    else if (src_t || mask_t)
+        tegra->stats.num_3d_fast_transformed_rects++;
+
     if (push_src) {
         swidth = tegra->scratch.src->drawable.width;
         sheight = tegra->scratch.src->drawable.height;
@@ -780,8 +854,15 @@ static void tegra_exa_composite_3d(PixmapPtr pdst,
     }
 
     if (push_mask) {
-        mwidth = tegra->scratch.mask->drawable.width;
-        mheight = tegra->scratch.mask->drawable.height;
+        if (tegra->scratch.mask_atlas) {
+            mwidth = tegra->scratch.mask_atlas_width;
+            mheight = tegra->scratch.mask_atlas_height;
+            mask_offset_x = tegra->scratch.mask_atlas_x;
+            mask_offset_y = tegra->scratch.mask_atlas_y;
+        } else {
+            mwidth = tegra->scratch.mask->drawable.width;
+            mheight = tegra->scratch.mask->drawable.height;
+        }
 
         mask.x0 = mask_x;
         mask.y0 = mask_y;
@@ -789,8 +870,37 @@ static void tegra_exa_composite_3d(PixmapPtr pdst,
         mask.y1 = mask_y + height;
     }
 
+    /*
+     * Atlas area surrounding the glyph belongs to other glyphs, hence
+     * clip drawing to the glyph's area. Atlas is used only by operations
+     * that discard the clipped area, so result is the same.
+     */
+    if (push_mask && tegra->scratch.mask_atlas) {
+        struct tegra_box glyph = { 0, 0, mwidth, mheight };
+
+        tegra_exa_apply_clip(&dst, &glyph, dst_x - mask_x, dst_y - mask_y);
+
+        if (tegra_exa_is_degenerate(&dst))
+            goto degenerate;
+
+        tegra_exa_apply_clip(&mask, &dst, mask_x - dst_x, mask_y - dst_y);
+
+        if (push_src) {
+            tegra_exa_apply_clip(&src, &dst, src_x - dst_x, src_y - dst_y);
+
+            src_x = src.x0;
+            src_y = src.y0;
+        }
+
+        dst_x = dst.x0;
+        dst_y = dst.y0;
+
+        mask_x = mask.x0;
+        mask_y = mask.y0;
+    }
+
     if (push_src) {
-        tegra_exa_apply_transform(src_t, &src, &src_transformed);
+        tegra_exa_apply_transform(src_t, src_type, &src, &src_transformed);
 
         /*
          * EXA doesn't clip transparent areas for us, hence we're doing
@@ -804,7 +914,8 @@ static void tegra_exa_composite_3d(PixmapPtr pdst,
             if (tegra_exa_is_degenerate(&src_transformed))
                 goto degenerate;
 
-            tegra_exa_get_untransformed(src_t_inv, &src_transformed, &src_untransformed);
+            tegra_exa_get_untransformed(src_t_inv, src_inv_type,
+                                        &src_transformed, &src_untransformed);
             tegra_exa_apply_clip(&dst, &src_untransformed, dst_x - src_x, dst_y - src_y);
             tegra_exa_apply_clip(&mask, &dst, mask_x - dst_x, mask_y - dst_y);
             tegra_exa_apply_clip(&src, &dst, src_x - dst_x, src_y - dst_y);
@@ -821,7 +932,7 @@ static void tegra_exa_composite_3d(PixmapPtr pdst,
     }
 
     if (push_mask) {
-        tegra_exa_apply_transform(mask_t, &mask, &mask_transformed);
+        tegra_exa_apply_transform(mask_t, mask_type, &mask, &mask_transformed);
 
         if (draw_state->discards_clip && clip_mask) {
             tegra_exa_clip_to_pixmap_area(tegra->scratch.mask,
@@ -830,10 +941,11 @@ static void tegra_exa_composite_3d(PixmapPtr pdst,
             if (tegra_exa_is_degenerate(&mask_transformed))
                 goto degenerate;
 
-            tegra_exa_get_untransformed(mask_t_inv, &mask_transformed, &mask_untransformed);
+            tegra_exa_get_untransformed(mask_t_inv, mask_inv_type,
+                                        &mask_transformed, &mask_untransformed);
             tegra_exa_apply_clip(&dst, &mask_untransformed, dst_x - mask_x, dst_y - mask_y);
             tegra_exa_apply_clip(&src, &dst, src_x - dst_x, src_y - dst_y);
-            tegra_exa_apply_transform(src_t, &src, &src_transformed);
+            tegra_exa_apply_transform(src_t, src_type, &src, &src_transformed);
         }
     }
 
@@ -869,10 +981,10 @@ static void tegra_exa_composite_3d(PixmapPtr pdst,
         if (mheight > 1 && (mask_transformed.y1 < 0 || mask_transformed.y1 > mheight))
             draw_state->mask.coords_wrap = true;
 
-        mask_left   = mask.x0;
-        mask_right  = mask.x1;
-        mask_bottom = mask.y0;
-        mask_top    = mask.y1;
+        mask_left   = mask.x0 + mask_offset_x;
+        mask_right  = mask.x1 + mask_offset_x;
+        mask_bottom = mask.y0 + mask_offset_y;
+        mask_top    = mask.y1 + mask_offset_y;
     }
 
     dst_left   = (float) (dst.x0 * 2) / pdst->drawable.width  - 1.0f;
@@ -917,7 +1029,45 @@ degenerate:
               draw_state->optimized_out);
 }
 
-static void tegra_exa_done_composite_3d(PixmapPtr pdst)
+static bool tegra_exa_3d_rects_same_mapping(const struct tegra_3d_rect *a,
+                                            const struct tegra_3d_rect *b)
+{
+    return a->src_x  - a->dst_x == b->src_x  - b->dst_x &&
+           a->src_y  - a->dst_y == b->src_y  - b->dst_y &&
+           a->mask_x - a->dst_x == b->mask_x - b->dst_x &&
+           a->mask_y - a->dst_y == b->mask_y - b->dst_y;
+}
+
+static void tegra_exa_3d_state_add_draw(struct tegra_3d_state *state,
+                                        unsigned int first_vtx,
+                                        const struct tegra_box *scissor)
+{
+    struct tegra_3d_draw *draw = NULL;
+
+    if (state->num_draws)
+        draw = &state->draws[state->num_draws - 1];
+
+    /* unscissored quads that follow each other are drawn at once */
+    if (!scissor && draw && !draw->scissored &&
+        draw->first_vtx + draw->vtx_cnt == first_vtx) {
+        draw->vtx_cnt += 6;
+        return;
+    }
+
+    draw = &state->draws[state->num_draws++];
+    draw->first_vtx = first_vtx;
+    draw->vtx_cnt = 6;
+    draw->scissored = !!scissor;
+
+    if (scissor) {
+        draw->scissor_x = scissor->x0;
+        draw->scissor_y = scissor->y0;
+        draw->scissor_width = scissor->x1 - scissor->x0;
+        draw->scissor_height = scissor->y1 - scissor->y0;
+    }
+}
+
+static void tegra_exa_composite_3d_submit(PixmapPtr pdst)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pdst->drawable.pScreen);
     struct tegra_exa *tegra = TegraPTR(pScrn)->exa;
@@ -943,7 +1093,8 @@ static void tegra_exa_done_composite_3d(PixmapPtr pdst)
             *
             *      See TegraGR3D_DrawPrimitives() in gr3d.c
             */
-            tegra_exa_replace_pixmaps_fence(TEGRA_3D, fence, &tegra->scratch, pdst,
+            tegra_exa_replace_pixmaps_fence(TEGRA_3D, fence, &tegra->scratch,
+                                            tegra->scratch.dst_bands, 0, pdst,
                                             2, tegra->scratch.src, tegra->scratch.mask);
         }
 
@@ -951,6 +1102,214 @@ static void tegra_exa_done_composite_3d(PixmapPtr pdst)
         tegra_exa_3d_state_reset(&tegra->gr3d_state);
     }
 
+    tegra->gr3d_state.num_draws = 0;
+}
+
+/*
+ * Attributes buffer is shared by all deferred 3d jobs. Once it's full, the
+ * vertices pushed so far are submitted together with the deferred jobs and
+ * the operation continues in a new job, using a new attributes buffer.
+ */
+static bool tegra_exa_composite_3d_split(PixmapPtr pdst)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pdst->drawable.pScreen);
+    struct tegra_exa *tegra = TegraPTR(pScrn)->exa;
+    struct tegra_3d_state *state = &tegra->gr3d_state;
+    struct tegra_3d_rect rects[TEGRA_3D_MAX_QUEUED_RECTS];
+    struct tegra_3d_draw_state draw_state = state->new;
+    unsigned int num_rects = state->num_rects;
+
+    /* queued rects are cleared by the state reset */
+    memcpy(rects, state->rects, sizeof(*rects) * num_rects);
+
+    tegra_exa_composite_3d_submit(pdst);
+
+    if (tegra_exa_3d_state_deferred(state))
+        tegra_exa_submit_deferred_3d_jobs(state);
+
+    tegra->stats.num_3d_split_ops++;
+
+    /* the rest of rects may not cover whole destination */
+    draw_state.dst_full_cover = 0;
+    tegra->scratch.ops = 0;
+
+    if (!tegra_exa_3d_state_append(state, tegra, &draw_state)) {
+        ERROR_MSG("failed to continue 3d operation, rects dropped\n");
+        return false;
+    }
+
+    memcpy(state->rects, rects, sizeof(*rects) * num_rects);
+    state->num_rects = num_rects;
+
+    return true;
+}
+
+static void tegra_exa_composite_3d_flush_rects(PixmapPtr pdst)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pdst->drawable.pScreen);
+    struct tegra_exa *tegra = TegraPTR(pScrn)->exa;
+    struct tegra_3d_state *state = &tegra->gr3d_state;
+    struct tegra_3d_draw_state *draw_state = &state->new;
+    struct tegra_3d_rect *first, *rect;
+    unsigned int i, end, first_vtx;
+    struct tegra_box bbox, box;
+    bool dst_full_cover;
+
+    for (i = 0; i < state->num_rects; i = end) {
+        first = &state->rects[i];
+
+        for (end = i + 1; end < state->num_rects; end++) {
+            if (!tegra_exa_3d_rects_same_mapping(first, &state->rects[end]))
+                break;
+        }
+
+        if (tegra_exa_attributes_buffer_is_full(&tegra->scratch) &&
+            !tegra_exa_composite_3d_split(pdst))
+            break;
+
+        /*
+         * Keep one spare draw for the unscissored rects, which may follow
+         * the scissored ones.
+         */
+        if (end - i >= TEGRA_3D_SCISSOR_MIN_RECTS &&
+            state->num_draws + end - i < TEGRA_3D_MAX_DRAWS) {
+            bbox.x0 = first->dst_x;
+            bbox.y0 = first->dst_y;
+            bbox.x1 = first->dst_x + first->width;
+            bbox.y1 = first->dst_y + first->height;
+
+            for (rect = first + 1; rect < &state->rects[end]; rect++) {
+                bbox.x0 = min(bbox.x0, rect->dst_x);
+                bbox.y0 = min(bbox.y0, rect->dst_y);
+                bbox.x1 = max(bbox.x1, rect->dst_x + rect->width);
+                bbox.y1 = max(bbox.y1, rect->dst_y + rect->height);
+            }
+
+            /* bounding quad doesn't cover whole area, scissor does clipping */
+            dst_full_cover = draw_state->dst_full_cover;
+            first_vtx = tegra->scratch.vtx_cnt;
+
+            tegra_exa_composite_3d_rect(pdst,
+                                        bbox.x0 + first->src_x - first->dst_x,
+                                        bbox.y0 + first->src_y - first->dst_y,
+                                        bbox.x0 + first->mask_x - first->dst_x,
+                                        bbox.y0 + first->mask_y - first->dst_y,
+                                        bbox.x0, bbox.y0,
+                                        bbox.x1 - bbox.x0,
+                                        bbox.y1 - bbox.y0);
+
+            draw_state->dst_full_cover = dst_full_cover;
+
+            if (tegra->scratch.vtx_cnt == first_vtx)
+                continue;
+
+            for (rect = first; rect < &state->rects[end]; rect++) {
+                box.x0 = rect->dst_x;
+                box.y0 = rect->dst_y;
+                box.x1 = rect->dst_x + rect->width;
+                box.y1 = rect->dst_y + rect->height;
+
+                tegra_exa_clip_to_pixmap_area(pdst, &box, &box);
+
+                if (!tegra_exa_is_degenerate(&box))
+                    tegra_exa_3d_state_add_draw(state, first_vtx, &box);
+            }
+
+            tegra->stats.num_3d_scissored_rects += end - i;
+            continue;
+        }
+
+        for (rect = first; rect < &state->rects[end]; rect++) {
+            if (tegra_exa_attributes_buffer_is_full(&tegra->scratch) &&
+                !tegra_exa_composite_3d_split(pdst))
+                goto out;
+
+            first_vtx = tegra->scratch.vtx_cnt;
+
+            tegra_exa_composite_3d_rect(pdst,
+                                        rect->src_x, rect->src_y,
+                                        rect->mask_x, rect->mask_y,
+                                        rect->dst_x, rect->dst_y,
+                                        rect->width, rect->height);
+
+            if (tegra->scratch.vtx_cnt != first_vtx)
+                tegra_exa_3d_state_add_draw(state, first_vtx, NULL);
+        }
+    }
+
+out:
+    state->num_rects = 0;
+}
+
+/*
+ * EXA hands out clip boxes one by one, hence they are queued here. Adjacent
+ * boxes sharing the same texture coordinates mapping are merged into a
+ * single rect, the rest is split into vertices or scissored when queue is
+ * flushed.
+ */
+static void tegra_exa_composite_3d(PixmapPtr pdst,
+                                   int src_x, int src_y,
+                                   int mask_x, int mask_y,
+                                   int dst_x, int dst_y,
+                                   int width, int height)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pdst->drawable.pScreen);
+    struct tegra_exa *tegra = TegraPTR(pScrn)->exa;
+    struct tegra_3d_state *state = &tegra->gr3d_state;
+    struct tegra_3d_rect new_rect, *rect;
+
+    if (state->new.optimized_out) {
+        ACCEL_MSG("src %dx%d mask %dx%d w:h %d:%d optimized out\n",
+                  src_x, src_y, mask_x, mask_y, width, height);
+        return;
+    }
+
+    tegra_exa_solid_tiles_update(pdst, dst_x, dst_y,
+                                 dst_x + width, dst_y + height, false, 0);
+
+    new_rect.src_x  = src_x;
+    new_rect.src_y  = src_y;
+    new_rect.mask_x = mask_x;
+    new_rect.mask_y = mask_y;
+    new_rect.dst_x  = dst_x;
+    new_rect.dst_y  = dst_y;
+    new_rect.width  = width;
+    new_rect.height = height;
+
+    if (state->num_rects) {
+        rect = &state->rects[state->num_rects - 1];
+
+        if (tegra_exa_3d_rects_same_mapping(rect, &new_rect)) {
+            if (rect->dst_y == dst_y && rect->height == height &&
+                rect->dst_x + rect->width == dst_x) {
+                rect->width += width;
+                tegra->stats.num_3d_merged_rects++;
+                return;
+            }
+
+            if (rect->dst_x == dst_x && rect->width == width &&
+                rect->dst_y + rect->height == dst_y) {
+                rect->height += height;
+                tegra->stats.num_3d_merged_rects++;
+                return;
+            }
+        }
+    }
+
+    if (state->num_rects == TEGRA_3D_MAX_QUEUED_RECTS)
+        tegra_exa_composite_3d_flush_rects(pdst);
+
+    state->rects[state->num_rects++] = new_rect;
+}
+
+static void tegra_exa_done_composite_3d(PixmapPtr pdst)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pdst->drawable.pScreen);
+    struct tegra_exa *tegra = TegraPTR(pScrn)->exa;
+
+    tegra_exa_composite_3d_flush_rects(pdst);
+    tegra_exa_composite_3d_submit(pdst);
+
     tegra_exa_cool_pixmap(tegra->scratch.src,  false);
     tegra_exa_cool_pixmap(tegra->scratch.mask, false);
     tegra_exa_cool_pixmap(pdst, true);
@@ -81,7 +81,20 @@ static void tegra_exa_3d_state_reset(struct tegra_3d_state *state)
 
     tegra_exa_release_optimized_3d_state(state);
 
-    memset(state, 0, sizeof(*state));
+    /* queues are large, hence clear only the used slots */
+    memset(state->rects, 0, sizeof(*state->rects) * state->num_rects);
+    memset(state->draws, 0, sizeof(*state->draws) * state->num_draws);
+    memset(state->ops, 0, sizeof(*state->ops) * state->num_ops);
+    memset(state->queued_draws, 0,
+           sizeof(*state->queued_draws) * state->num_queued_draws);
+
+    /* pixmap slots are cleared by tegra_exa_release_optimized_3d_state() */
+    memset(state, 0, offsetof(struct tegra_3d_state, rects));
+
+    state->num_rects = 0;
+    state->num_draws = 0;
+    state->num_ops = 0;
+    state->num_queued_draws = 0;
     state->clean = true;
 
     tegra_exa_exit_optimization_3d_state(exa);
@@ -99,12 +112,14 @@ tegra_exa_reselect_program(struct tegra_3d_state *state)
     return tegra_exa_select_optimized_gr3d_program(state, true);
 }
 
-static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
+static void tegra_exa_3d_state_emit_op(struct tegra_3d_state *state,
+                                       struct tegra_3d_op *op)
 {
-    struct tegra_exa_scratch *scratch = state->scratch;
+    struct tegra_attrib_bo *attribs = &state->scratch->attribs;
+    struct tegra_3d_draw_state *new = &op->state;
     struct tegra_stream *cmds = state->cmds;
-    const struct shader_program *prog;
     struct tegra_texture_state *tex;
+    struct tegra_3d_draw *draw;
     unsigned attrs_num, attribs_offset, attrs_id;
     bool wrap_mirrored_repeat = false;
     bool wrap_clamp_to_edge = true;
@@ -112,29 +127,7 @@ static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
     bool vtx_gpu_cache_invalidate;
     uint32_t attrs_out = 0;
     uint32_t attrs_in = 0;
-    unsigned const_id;
-
-    if (state->clean)
-        return;
-
-    prog = tegra_exa_reselect_program(state);
-
-    if (!prog) {
-        if (!state->new.optimized_out)
-            ERROR_MSG("BUG: no shader selected for op %u\n", state->new.op);
-
-        /*
-         * attrib_offset is updated below, hence now attrib_offset points at
-         * position where previous job ended in the attributes buffer and we
-         * can use it in order to restore the iterator position if this drawing
-         * operation is skipped entirely.
-         */
-        scratch->attrib_itr = scratch->attrib_offset / 2;
-        scratch->vtx_cnt = 0;
-        return;
-    }
-
-    state->new.prog = prog;
+    unsigned const_id, i;
 
     const_id = 0;
 
@@ -148,15 +141,11 @@ static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
 
         state->inited = true;
 
-        assert(state->num_jobs == 0);
-
         vtx_mem_cache_invalidate = true;
         vtx_gpu_cache_invalidate = true;
     } else {
         const_id++;
 
-        assert(state->num_jobs > 0);
-
         /*
          * Apparently GR3D has two caches for vertices: one for fetched memory,
          * and other (smaller cache) for pre-processed vertices that hides
@@ -185,13 +174,13 @@ static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
     attrs_in |= 1 << attrs_id;
     attrs_out |= 1 << attrs_id;
 
-    if (scratch->src) {
+    if (op->src_attrib) {
         attrs_id += 1;
         attrs_in |= 1 << attrs_id;
         attrs_out |= 1 << 1;
     }
 
-    if (scratch->mask) {
+    if (op->mask_attrib) {
         attrs_id += 1;
         attrs_in |= 1 << attrs_id;
         attrs_out |= 1 << 1;
@@ -208,41 +197,37 @@ static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
      */
     tgr3d_set_vp_attributes_inout_mask(cmds, attrs_in, attrs_out);
 
-    attrs_num = 1 + !!scratch->src + !!scratch->mask;
-    attribs_offset = scratch->attrib_offset;
+    attrs_num = 1 + !!op->src_attrib + !!op->mask_attrib;
+    attribs_offset = op->attrib_offset;
     attrs_id = 0;
 
     DEBUG_MSG("attribs_offset %u\n", attribs_offset);
 
-    tgr3d_set_vp_attrib_buf(cmds, attrs_id, scratch->attribs.bo,
+    tgr3d_set_vp_attrib_buf(cmds, attrs_id, attribs->bo,
                             attribs_offset, TGR3D_ATTRIB_TYPE_FLOAT16,
                             2, 4 * attrs_num, false);
 
-    if (scratch->src) {
+    if (op->src_attrib) {
         attribs_offset += 4;
         attrs_id += 1;
 
-        tgr3d_set_vp_attrib_buf(cmds, attrs_id, scratch->attribs.bo,
+        tgr3d_set_vp_attrib_buf(cmds, attrs_id, attribs->bo,
                                 attribs_offset, TGR3D_ATTRIB_TYPE_FLOAT16,
                                 2, 4 * attrs_num, false);
     }
 
-    if (scratch->mask) {
+    if (op->mask_attrib) {
         attribs_offset += 4;
         attrs_id += 1;
 
-        tgr3d_set_vp_attrib_buf(cmds, attrs_id, scratch->attribs.bo,
+        tgr3d_set_vp_attrib_buf(cmds, attrs_id, attribs->bo,
                                 attribs_offset, TGR3D_ATTRIB_TYPE_FLOAT16,
                                 2, 4 * attrs_num, false);
     }
 
-    scratch->attrib_offset = scratch->attrib_itr * 2;
-
-    tex = &state->new.src;
+    tex = &new->src;
 
     if (tex->pix) {
-        tegra_exa_flush_deferred_2d_operations(tex->pix, true, false, true);
-
         if (tex->pix != state->cur.src.pix ||
             tex->format != state->cur.src.format ||
             tex->tex_sel != state->cur.src.tex_sel ||
@@ -289,18 +274,18 @@ static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
          * A special case of blend_src to optimize shader a tad, maybe will
          * apply similar thing to other shaders as well later on.
          */
-        if (prog == &prog_blend_src_clipped_src_solid_mask ||
-            prog == &prog_blend_src_solid_mask)
+        if (new->prog == &prog_blend_src_clipped_src_solid_mask ||
+            new->prog == &prog_blend_src_solid_mask)
         {
-            if (state->new.dst.alpha && tex->alpha)
+            if (new->dst.alpha && tex->alpha)
                 tgr3d_upload_const_fp(cmds, 5, FX10x2(0, 0));
 
-            if (state->new.dst.alpha && !tex->alpha) {
-                tgr3d_upload_const_fp(cmds, 5, FX10x2((state->new.mask.solid >> 24) / 255.0f, 0));
-                state->new.mask.solid &= 0x00fffffff;
+            if (new->dst.alpha && !tex->alpha) {
+                tgr3d_upload_const_fp(cmds, 5, FX10x2((new->mask.solid >> 24) / 255.0f, 0));
+                new->mask.solid &= 0x00fffffff;
             }
 
-            if (!state->new.dst.alpha)
+            if (!new->dst.alpha)
                 tgr3d_upload_const_fp(cmds, 5, FX10x2(-1, 0));
         } else {
             tgr3d_upload_const_fp(cmds, 5, FX10x2(tex->alpha, 0));
@@ -308,16 +293,16 @@ static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
 
         if (tex->transform_coords) {
             tgr3d_upload_const_vp(cmds, const_id++,
-                                  pixman_fixed_to_double(scratch->transform_src.matrix[0][0]),
-                                  pixman_fixed_to_double(scratch->transform_src.matrix[0][1]),
-                                  pixman_fixed_to_double(scratch->transform_src.matrix[0][2]),
-                                  tex->pix->drawable.width * pixman_fixed_to_double(scratch->transform_src.matrix[2][2]));
+                                  pixman_fixed_to_double(op->transform_src.matrix[0][0]),
+                                  pixman_fixed_to_double(op->transform_src.matrix[0][1]),
+                                  pixman_fixed_to_double(op->transform_src.matrix[0][2]),
+                                  tex->pix->drawable.width * pixman_fixed_to_double(op->transform_src.matrix[2][2]));
 
             tgr3d_upload_const_vp(cmds, const_id++,
-                                  pixman_fixed_to_double(scratch->transform_src.matrix[1][0]),
-                                  pixman_fixed_to_double(scratch->transform_src.matrix[1][1]),
-                                  pixman_fixed_to_double(scratch->transform_src.matrix[1][2]),
-                                  tex->pix->drawable.height * pixman_fixed_to_double(scratch->transform_src.matrix[2][2]));
+                                  pixman_fixed_to_double(op->transform_src.matrix[1][0]),
+                                  pixman_fixed_to_double(op->transform_src.matrix[1][1]),
+                                  pixman_fixed_to_double(op->transform_src.matrix[1][2]),
+                                  tex->pix->drawable.height * pixman_fixed_to_double(op->transform_src.matrix[2][2]));
         } else {
             tgr3d_upload_const_vp(cmds, const_id++, 1.0f, 0.0f, 0.0f, tex->pix->drawable.width);
             tgr3d_upload_const_vp(cmds, const_id++, 0.0f, 1.0f, 0.0f, tex->pix->drawable.height);
@@ -327,11 +312,9 @@ static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
         tgr3d_upload_const_fp(cmds, 1, FX10x2(RED(tex->solid), ALPHA(tex->solid)));
     }
 
-    tex = &state->new.mask;
+    tex = &new->mask;
 
     if (tex->pix) {
-        tegra_exa_flush_deferred_2d_operations(tex->pix, true, false, true);
-
         if (tex->pix != state->cur.mask.pix ||
             tex->format != state->cur.mask.format ||
             tex->tex_sel != state->cur.mask.tex_sel ||
@@ -379,16 +362,16 @@ static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
 
         if (tex->transform_coords) {
             tgr3d_upload_const_vp(cmds, const_id++,
-                                  pixman_fixed_to_double(scratch->transform_mask.matrix[0][0]),
-                                  pixman_fixed_to_double(scratch->transform_mask.matrix[0][1]),
-                                  pixman_fixed_to_double(scratch->transform_mask.matrix[0][2]),
-                                  tex->pix->drawable.width * pixman_fixed_to_double(scratch->transform_mask.matrix[2][2]));
+                                  pixman_fixed_to_double(op->transform_mask.matrix[0][0]),
+                                  pixman_fixed_to_double(op->transform_mask.matrix[0][1]),
+                                  pixman_fixed_to_double(op->transform_mask.matrix[0][2]),
+                                  tex->pix->drawable.width * pixman_fixed_to_double(op->transform_mask.matrix[2][2]));
 
             tgr3d_upload_const_vp(cmds, const_id++,
-                                  pixman_fixed_to_double(scratch->transform_mask.matrix[1][0]),
-                                  pixman_fixed_to_double(scratch->transform_mask.matrix[1][1]),
-                                  pixman_fixed_to_double(scratch->transform_mask.matrix[1][2]),
-                                  tex->pix->drawable.height * pixman_fixed_to_double(scratch->transform_mask.matrix[2][2]));
+                                  pixman_fixed_to_double(op->transform_mask.matrix[1][0]),
+                                  pixman_fixed_to_double(op->transform_mask.matrix[1][1]),
+                                  pixman_fixed_to_double(op->transform_mask.matrix[1][2]),
+                                  tex->pix->drawable.height * pixman_fixed_to_double(op->transform_mask.matrix[2][2]));
         } else {
             tgr3d_upload_const_vp(cmds, const_id++, 1.0f, 0.0f, 0.0f, tex->pix->drawable.width);
             tgr3d_upload_const_vp(cmds, const_id++, 0.0f, 1.0f, 0.0f, tex->pix->drawable.height);
@@ -398,14 +381,15 @@ static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
         tgr3d_upload_const_fp(cmds, 3, FX10x2(RED(tex->solid), ALPHA(tex->solid)));
     }
 
-    tex = &state->new.dst;
+    tex = &new->dst;
 
-    tgr3d_upload_const_fp(cmds, 8, FX10x2(tex->alpha, state->new.src.tex_sel == TEX_CLIPPED));
+    tgr3d_upload_const_fp(cmds, 8, FX10x2(tex->alpha, new->src.tex_sel == TEX_CLIPPED));
 
     if (tex->pix != state->cur.dst.pix) {
         tgr3d_set_scissor(cmds, 0, 0,
                           tex->pix->drawable.width,
                           tex->pix->drawable.height);
+        state->scissor_dirty = false;
 
         tgr3d_set_viewport_bias_scale(cmds, 0.0f, 0.0f, 0.5f,
                                       tex->pix->drawable.width,
@@ -416,18 +400,128 @@ static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
                                 tegra_exa_pixmap_bo(tex->pix),
                                 tegra_exa_pixmap_offset(tex->pix),
                                 tex->format, exaGetPixmapPitch(tex->pix),
+                                tegra_exa_pixmap_is_tiled(tex->pix),
                                 tegra_exa_pixmap_is_from_pool(tex->pix));
+    }
 
-        tegra_exa_flush_deferred_2d_operations(tex->pix, true, true, true);
+    if (new->prog != state->cur.prog)
+        tgr3d_upload_program(cmds, new->prog);
+
+    for (i = 0; i < op->num_draws; i++) {
+        draw = &state->queued_draws[op->first_draw + i];
+
+        if (draw->scissored) {
+            tgr3d_set_scissor(cmds, draw->scissor_x, draw->scissor_y,
+                              draw->scissor_width, draw->scissor_height);
+            state->scissor_dirty = true;
+        } else if (state->scissor_dirty) {
+            tgr3d_set_scissor(cmds, 0, 0,
+                              tex->pix->drawable.width,
+                              tex->pix->drawable.height);
+            state->scissor_dirty = false;
+        }
+
+        tgr3d_draw_primitives(cmds, draw->first_vtx, draw->vtx_cnt);
     }
 
-    if (state->new.prog != state->cur.prog)
-        tgr3d_upload_program(cmds, state->new.prog);
+    tegra_exa_3d_state_tex_cache_written(state, new->dst.pix);
+
+    state->cur = *new;
+}
+
+
+/*
+ * Queued operations are emitted in the order selected by
+ * tegra_exa_3d_state_next_op(), which groups operations sharing the
+ * state without breaking dependencies between them.
+ */
+static void tegra_exa_3d_state_emit_ops(struct tegra_3d_state *state)
+{
+    struct tegra_3d_op *op;
+    unsigned int i, next;
+
+    for (i = 0; i < state->num_ops; i++) {
+        next = tegra_exa_3d_state_next_op(state);
+        op = &state->ops[next];
 
-    tgr3d_draw_primitives(cmds, 0, scratch->vtx_cnt);
+        if (next != i)
+            state->exa->stats.num_3d_reordered_ops++;
 
+        tegra_exa_3d_state_emit_op(state, op);
+        op->emitted = true;
+    }
+
+    state->num_queued_draws = 0;
+    state->num_ops = 0;
+}
+
+static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
+{
+    struct tegra_exa_scratch *scratch = state->scratch;
+    const struct shader_program *prog;
+    struct tegra_3d_op *op;
+
+    if (state->clean)
+        return;
+
+    prog = tegra_exa_reselect_program(state);
+
+    if (!prog) {
+        if (!state->new.optimized_out)
+            ERROR_MSG("BUG: no shader selected for op %u\n", state->new.op);
+
+        /*
+         * attrib_offset is updated below, hence now attrib_offset points at
+         * position where previous job ended in the attributes buffer and we
+         * can use it in order to restore the iterator position if this drawing
+         * operation is skipped entirely.
+         */
+        scratch->attrib_itr = scratch->attrib_offset / 2;
+        scratch->vtx_cnt = 0;
+        state->num_draws = 0;
+        return;
+    }
+
+    state->new.prog = prog;
+
+    if (state->num_ops == TEGRA_3D_MAX_QUEUED_OPS ||
+        state->num_queued_draws + state->num_draws > TEGRA_3D_MAX_QUEUED_DRAWS)
+        tegra_exa_3d_state_emit_ops(state);
+
+    /* 3D job shall be executed after the deferred 2D operations */
+    if (state->new.src.pix)
+        tegra_exa_flush_deferred_2d_operations(state->new.src.pix,
+                                               true, false, true);
+
+    if (state->new.mask.pix)
+        tegra_exa_flush_deferred_2d_operations(state->new.mask.pix,
+                                               true, false, true);
+
+    tegra_exa_flush_deferred_2d_operations(state->new.dst.pix,
+                                           true, true, true);
+
+    op = &state->ops[state->num_ops++];
+    op->state = state->new;
+    op->src_attrib = !!scratch->src;
+    op->mask_attrib = !!scratch->mask;
+    op->attrib_offset = scratch->attrib_offset;
+    op->first_draw = state->num_queued_draws;
+    op->num_draws = state->num_draws;
+    op->emitted = false;
+
+    if (state->new.src.transform_coords)
+        op->transform_src = scratch->transform_src;
+
+    if (state->new.mask.transform_coords)
+        op->transform_mask = scratch->transform_mask;
+
+    memcpy(&state->queued_draws[op->first_draw], state->draws,
+           sizeof(*state->draws) * state->num_draws);
+    state->num_queued_draws += state->num_draws;
+
+    scratch->attrib_offset = scratch->attrib_itr * 2;
     scratch->vtx_cnt = 0;
-    state->cur = state->new;
+    state->num_draws = 0;
 
     tegra_exa_optimize_alpha_component(&state->new);
 }
@@ -563,6 +657,8 @@ tegra_exa_submit_3d_state(struct tegra_3d_state *state)
     pScrn = xf86ScreenToScrn(state->new.dst.pix->drawable.pScreen);
     tegra = TegraPTR(pScrn)->exa;
 
+    tegra_exa_3d_state_emit_ops(state);
+
     tegra->stats.num_3d_jobs_bytes += tegra_stream_pushbuf_size(state->cmds);
 
     /*
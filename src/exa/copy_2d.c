@@ -21,6 +21,11 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#define DISABLE_ROTATE_MERGE        false
+
+/* minimal percentage of the merged box that is covered by the source boxes */
+#define TEGRA_ROTATE_MERGE_COVERAGE 75
+
 static const uint8_t rop3[] = {
     0x00, /* GXclear */
     0x88, /* GXand */
@@ -40,6 +45,12 @@ static const uint8_t rop3[] = {
     0xff, /* GXset */
 };
 
+/* ROP3 result depends on the destination (D = 0xaa) */
+static bool tegra_exa_rop_reads_dst(int op)
+{
+    return ((rop3[op] >> 1) ^ rop3[op]) & 0x55;
+}
+
 static uint32_t sb_offset(PixmapPtr pix, unsigned xpos, unsigned ypos)
 {
     unsigned bytes_per_pixel = pix->drawable.bitsPerPixel >> 3;
@@ -52,6 +63,304 @@ static uint32_t sb_offset(PixmapPtr pix, unsigned xpos, unsigned ypos)
     return tegra_exa_pixmap_offset(pix) + offset;
 }
 
+static uint32_t tegra_exa_2d_tilemode(PixmapPtr src_pixmap,
+                                      PixmapPtr dst_pixmap)
+{
+    uint32_t tilemode = 0;
+
+    /*
+     * [20:20] destination write tile mode (0: linear, 1: tiled)
+     * [ 0: 0] tile mode Y/RGB (0: linear, 1: tiled)
+     */
+    if (src_pixmap && tegra_exa_pixmap_is_tiled(src_pixmap))
+        tilemode |= 1 << 0;
+
+    if (dst_pixmap && tegra_exa_pixmap_is_tiled(dst_pixmap))
+        tilemode |= 1 << 20;
+
+    return tilemode;
+}
+
+static void tegra_exa_2d_surface_from_pixmap(PixmapPtr pix,
+                                             struct tegra_2d_surface *surf)
+{
+    surf->bo     = tegra_exa_pixmap_bo(pix);
+    surf->offset = tegra_exa_pixmap_offset(pix);
+    surf->pitch  = exaGetPixmapPitch(pix);
+    surf->tiled  = tegra_exa_pixmap_is_tiled(pix);
+    surf->pool   = tegra_exa_pixmap_is_from_pool(pix);
+}
+
+/*
+ * Emits a self-contained blit of a single rectangle with the given ROP3,
+ * blit doesn't depend on the previously programmed state. Stream shall be
+ * begun by the caller.
+ */
+static void
+tegra_exa_copy_2d_emit_rop_blit(struct tegra_stream *cmds, unsigned int bpp,
+                                uint8_t rop,
+                                const struct tegra_2d_surface *dst,
+                                int dst_x, int dst_y,
+                                const struct tegra_2d_surface *src,
+                                int src_x, int src_y,
+                                int width, int height)
+{
+    tegra_stream_prep(cmds, 20);
+    tegra_stream_push_setclass(cmds, HOST1X_CLASS_GR2D);
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x9, 0x9));
+    tegra_stream_push(cmds, 0x0000003a); /* trigger */
+    tegra_stream_push(cmds, 0x00000000); /* cmdsel */
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x01e, 0x7));
+    tegra_stream_push(cmds, 0x00000000); /* controlsecond */
+    tegra_stream_push(cmds, /* controlmain */
+                      (1 << 20) | ((bpp >> 4) << 16));
+    tegra_stream_push(cmds, rop); /* ropfade */
+    tegra_stream_push(cmds, HOST1X_OPCODE_NONINCR(0x046, 1));
+    tegra_stream_push(cmds, /* tilemode, see tegra_exa_2d_tilemode() */
+                      (dst->tiled ? 1 << 20 : 0) | (src->tiled ? 1 << 0 : 0));
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x2b, 0x149));
+    tegra_stream_push_reloc(cmds, dst->bo, dst->offset, true, dst->pool);
+    tegra_stream_push(cmds, dst->pitch); /* dstst */
+    tegra_stream_push_reloc(cmds, src->bo, src->offset, false, src->pool);
+    tegra_stream_push(cmds, src->pitch); /* srcst */
+    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(0x37, 0x4));
+    tegra_stream_push(cmds, height << 16 | width); /* srcsize */
+    tegra_stream_push(cmds, height << 16 | width); /* dstsize */
+    tegra_stream_push(cmds, src_y << 16 | src_x); /* srcps */
+    tegra_stream_push(cmds, dst_y << 16 | dst_x); /* dstps */
+}
+
+/*
+ * Emits a self-contained GXcopy of a single rectangle, used by the jobs
+ * that copy outside of the regular copy operation (glyph uploads, readback
+ * prefetches, detiling). Stream shall be begun by the caller.
+ */
+static void
+tegra_exa_copy_2d_emit_blit(struct tegra_stream *cmds, unsigned int bpp,
+                            const struct tegra_2d_surface *dst,
+                            int dst_x, int dst_y,
+                            const struct tegra_2d_surface *src,
+                            int src_x, int src_y,
+                            int width, int height)
+{
+    tegra_exa_copy_2d_emit_rop_blit(cmds, bpp, rop3[GXcopy],
+                                    dst, dst_x, dst_y, src, src_x, src_y,
+                                    width, height);
+}
+
+/* self-contained counterpart of the solid-fill, color is the ROP's source */
+static void
+tegra_exa_copy_2d_emit_fill(struct tegra_stream *cmds, unsigned int bpp,
+                            uint8_t rop, Pixel color,
+                            const struct tegra_2d_surface *dst,
+                            int dst_x, int dst_y, int width, int height)
+{
+    tegra_stream_prep(cmds, 18);
+    tegra_stream_push_setclass(cmds, HOST1X_CLASS_GR2D);
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x9, 0x9));
+    tegra_stream_push(cmds, 0x0000003a); /* trigger */
+    tegra_stream_push(cmds, 0x00000000); /* cmdsel */
+    tegra_stream_push(cmds, HOST1X_OPCODE_NONINCR(0x35, 1));
+    tegra_stream_push(cmds, color);
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x1e, 0x7));
+    tegra_stream_push(cmds, 0x00000000); /* controlsecond */
+    tegra_stream_push(cmds, /* controlmain, see tegra_exa_solid_2d_emit_setup() */
+                      ((bpp >> 4) << 16) | (1 << 6));
+    tegra_stream_push(cmds, rop); /* ropfade */
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x2b, 0x9));
+    tegra_stream_push_reloc(cmds, dst->bo, dst->offset, true, dst->pool);
+    tegra_stream_push(cmds, dst->pitch); /* dstst */
+    tegra_stream_push(cmds, HOST1X_OPCODE_NONINCR(0x46, 1));
+    tegra_stream_push(cmds, dst->tiled ? 1 << 20 : 0); /* tilemode */
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x38, 0x5));
+    tegra_stream_push(cmds, height << 16 | width); /* dstsize */
+    tegra_stream_push(cmds, dst_y << 16 | dst_x); /* dstps */
+}
+
+static void
+tegra_exa_copy_2d_emit_setup(struct tegra_stream *cmds,
+                             PixmapPtr src_pixmap, PixmapPtr dst_pixmap,
+                             int op, enum tegra_2d_orientation orientation)
+{
+    int fr_mode;
+
+    if (orientation == TEGRA2D_IDENTITY)
+        fr_mode = 0; /* DISABLE */
+    else if (src_pixmap != dst_pixmap)
+        fr_mode = 1; /* SRC_DST_COPY */
+    else
+        fr_mode = 2; /* SQUARE */
+
+    tegra_stream_prep(cmds, orientation == TEGRA2D_IDENTITY ? 14 : 12);
+    tegra_stream_push_setclass(cmds, HOST1X_CLASS_GR2D);
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x9, 0x9));
+    tegra_stream_push(cmds, orientation == TEGRA2D_IDENTITY ?
+                            0x0000003a : 0x00000037 ); /* trigger */
+    tegra_stream_push(cmds, 0x00000000); /* cmdsel */
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x01e, 0x5));
+    tegra_stream_push(cmds, /* controlsecond */
+                    orientation << 26 | fr_mode << 24);
+    tegra_stream_push(cmds, rop3[op]); /* ropfade */
+    tegra_stream_push(cmds, HOST1X_OPCODE_NONINCR(0x046, 1));
+    tegra_stream_push(cmds, /* tilemode */
+                      tegra_exa_2d_tilemode(src_pixmap, dst_pixmap));
+
+    if (orientation == TEGRA2D_IDENTITY) {
+        tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x2b, 0x149));
+
+        tegra_stream_push_reloc(cmds, tegra_exa_pixmap_bo(dst_pixmap),
+                                tegra_exa_pixmap_offset(dst_pixmap), true,
+                                tegra_exa_pixmap_is_from_pool(dst_pixmap));
+        tegra_stream_push(cmds, exaGetPixmapPitch(dst_pixmap)); /* dstst */
+
+        tegra_stream_push_reloc(cmds, tegra_exa_pixmap_bo(src_pixmap),
+                                tegra_exa_pixmap_offset(src_pixmap), false,
+                                tegra_exa_pixmap_is_from_pool(src_pixmap));
+        tegra_stream_push(cmds, exaGetPixmapPitch(src_pixmap)); /* srcst */
+    } else {
+        tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x2b, 0x108));
+        tegra_stream_push(cmds, exaGetPixmapPitch(dst_pixmap)); /* dstst */
+        tegra_stream_push(cmds, exaGetPixmapPitch(src_pixmap)); /* srcst */
+    }
+}
+
+static void tegra_exa_release_planemask_tmp(ScreenPtr screen,
+                                            struct tegra_exa *tegra)
+{
+    struct tegra_pixmap *priv;
+
+    if (!tegra->planemask_tmp)
+        return;
+
+    priv = exaGetPixmapDriverPrivate(tegra->planemask_tmp);
+    priv->freezer_lockcnt--;
+
+    screen->DestroyPixmap(tegra->planemask_tmp);
+    tegra->planemask_tmp = NULL;
+}
+
+static PixmapPtr tegra_exa_copy_2d_planemask_tmp(struct tegra_exa *tegra,
+                                                 PixmapPtr dst_pixmap)
+{
+    ScreenPtr screen = dst_pixmap->drawable.pScreen;
+    PixmapPtr tmp = tegra->planemask_tmp;
+    struct tegra_pixmap *priv;
+
+    if (tmp && tmp->drawable.bitsPerPixel == dst_pixmap->drawable.bitsPerPixel)
+        return tmp;
+
+    tegra_exa_release_planemask_tmp(screen, tegra);
+
+    tmp = screen->CreatePixmap(screen, TEGRA_PLANEMASK_TMP_SIZE,
+                               TEGRA_PLANEMASK_TMP_SIZE,
+                               dst_pixmap->drawable.depth, 0);
+    if (!tmp)
+        return NULL;
+
+    priv = exaGetPixmapDriverPrivate(tmp);
+    priv->no_tiling = true;
+
+    tegra_exa_thaw_pixmap2(tmp, THAW_ACCEL, THAW_ALLOC);
+
+    if (priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK) {
+        screen->DestroyPixmap(tmp);
+        return NULL;
+    }
+
+    /* intermediate pixmap shall never be compressed by the fridge */
+    priv->freezer_lockcnt++;
+
+    tegra->planemask_tmp = tmp;
+
+    return tmp;
+}
+
+/*
+ * ROP3 of the second pass of the planemasked copy, which blits destination
+ * into the intermediate pixmap holding the source. Roles of S and D are
+ * swapped by the blit, result is rop(S, D) ^ D.
+ */
+static uint8_t tegra_exa_planemask_rop3(int op)
+{
+    unsigned int i, s, d;
+    uint8_t rop = 0;
+
+    for (i = 0; i < 8; i++) {
+        s = (i >> 1) & 1;
+        d = i & 1;
+
+        if (((rop3[op] >> ((i & 4) | (d << 1) | s)) & 1) ^ s)
+            rop |= 1 << i;
+    }
+
+    return rop;
+}
+
+/*
+ * GR2D doesn't have a planemask. Planemasked copy, which is
+ * D = (rop(S, D) & pm) | (D & ~pm), is done in four passes via the
+ * intermediate pixmap T:
+ *
+ *   T = S
+ *   T = rop(S, D) ^ D
+ *   T = T & pm
+ *   D = D ^ T
+ *
+ * Every pass reads the result of the previous one. Rect is processed in
+ * chunks of the intermediate pixmap's size, ordered like the blit directions
+ * of an overlapping copy.
+ */
+static void tegra_exa_copy_2d_emit_masked_rect(struct tegra_exa *tegra,
+                                               PixmapPtr dst_pixmap,
+                                               int src_x, int src_y,
+                                               int dst_x, int dst_y,
+                                               int width, int height)
+{
+    struct tegra_exa_scratch *scratch = &tegra->scratch;
+    unsigned int bpp = dst_pixmap->drawable.bitsPerPixel;
+    uint8_t rop = tegra_exa_planemask_rop3(scratch->rop);
+    struct tegra_2d_surface src, dst, tmp;
+    struct tegra_stream *cmds = tegra->cmds;
+    int cx, cy, x, y, w, h;
+
+    tegra_exa_2d_surface_from_pixmap(scratch->src, &src);
+    tegra_exa_2d_surface_from_pixmap(dst_pixmap, &dst);
+    tegra_exa_2d_surface_from_pixmap(scratch->planemask_tmp, &tmp);
+
+    for (cy = 0; cy < height; cy += h) {
+        h = min(height - cy, TEGRA_PLANEMASK_TMP_SIZE);
+        y = dst_y > src_y ? height - cy - h : cy;
+
+        for (cx = 0; cx < width; cx += w) {
+            w = min(width - cx, TEGRA_PLANEMASK_TMP_SIZE);
+            x = dst_x > src_x ? width - cx - w : cx;
+
+            tegra_stream_sync(cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE, true);
+            tegra_exa_copy_2d_emit_rop_blit(cmds, bpp, rop3[GXcopy],
+                                            &tmp, 0, 0,
+                                            &src, src_x + x, src_y + y,
+                                            w, h);
+
+            tegra_stream_sync(cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE, true);
+            tegra_exa_copy_2d_emit_rop_blit(cmds, bpp, rop,
+                                            &tmp, 0, 0,
+                                            &dst, dst_x + x, dst_y + y,
+                                            w, h);
+
+            tegra_stream_sync(cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE, true);
+            tegra_exa_copy_2d_emit_fill(cmds, bpp, rop3[GXand],
+                                        scratch->planemask,
+                                        &tmp, 0, 0, w, h);
+
+            tegra_stream_sync(cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE, true);
+            tegra_exa_copy_2d_emit_rop_blit(cmds, bpp, rop3[GXxor],
+                                            &dst, dst_x + x, dst_y + y,
+                                            &tmp, 0, 0,
+                                            w, h);
+        }
+    }
+}
+
 static bool
 tegra_exa_prepare_copy_2d_ext(PixmapPtr src_pixmap, PixmapPtr dst_pixmap,
                               int op, Pixel planemask)
@@ -61,38 +370,19 @@ tegra_exa_prepare_copy_2d_ext(PixmapPtr src_pixmap, PixmapPtr dst_pixmap,
     enum tegra_2d_orientation orientation;
     struct tegra_pixmap *priv;
     unsigned int bpp;
-    int fr_mode;
+    bool masked;
     int err;
 
     ACCEL_MSG("\n");
 
     orientation = tegra->scratch.orientation;
+    masked = !EXA_PM_IS_SOLID(&dst_pixmap->drawable, planemask);
 
-    if (orientation == TEGRA2D_IDENTITY)
-        fr_mode = 0; /* DISABLE */
-    else if (src_pixmap != dst_pixmap)
-        fr_mode = 1; /* SRC_DST_COPY */
-    else
-        fr_mode = 2; /* SQUARE */
-
-    /*
-     * It should be possible to support this, but let's bail for now
-     */
-    if (planemask != FB_ALLONES) {
+    if (masked && orientation != TEGRA2D_IDENTITY) {
         FALLBACK_MSG("unsupported planemask 0x%08lx\n", planemask);
         return false;
     }
 
-    /*
-     * It should be possible to support all GX* raster operations given the
-     * mapping in the rop3 table, but none other than GXcopy have been
-     * validated.
-     */
-    if (op != GXcopy) {
-        FALLBACK_MSG("unsupported operation %d\n", op);
-        return false;
-    }
-
     /*
      * Some restrictions apply to the hardware accelerated copying.
      */
@@ -104,6 +394,24 @@ tegra_exa_prepare_copy_2d_ext(PixmapPtr src_pixmap, PixmapPtr dst_pixmap,
         return false;
     }
 
+    tegra->scratch.planemask_tmp = NULL;
+
+    /* intermediate is allocated first, allocation may evict pixmaps */
+    if (masked) {
+        tegra->scratch.planemask_tmp =
+                tegra_exa_copy_2d_planemask_tmp(tegra, dst_pixmap);
+
+        if (!tegra->scratch.planemask_tmp) {
+            FALLBACK_MSG("failed to allocate planemask intermediate\n");
+            return false;
+        }
+
+        if (bpp < 32)
+            planemask &= (1u << bpp) - 1;
+
+        tegra->scratch.planemask = planemask;
+    }
+
     tegra_exa_thaw_pixmap2(src_pixmap, THAW_ACCEL, THAW_ALLOC);
     tegra_exa_thaw_pixmap2(dst_pixmap, THAW_ACCEL, THAW_ALLOC);
 
@@ -141,48 +449,39 @@ tegra_exa_prepare_copy_2d_ext(PixmapPtr src_pixmap, PixmapPtr dst_pixmap,
               dst_pixmap->devKind,
               priv->scanout);
 
-    err = tegra_stream_begin(tegra->cmds, tegra->gr2d);
-    if (err < 0)
-        return false;
-
-    tegra_stream_prep(tegra->cmds, orientation == TEGRA2D_IDENTITY ? 14 : 12);
-    tegra_stream_push_setclass(tegra->cmds, HOST1X_CLASS_GR2D);
-    tegra_stream_push(tegra->cmds, HOST1X_OPCODE_MASK(0x9, 0x9));
-    tegra_stream_push(tegra->cmds, orientation == TEGRA2D_IDENTITY ?
-                                   0x0000003a : 0x00000037 ); /* trigger */
-    tegra_stream_push(tegra->cmds, 0x00000000); /* cmdsel */
-    tegra_stream_push(tegra->cmds, HOST1X_OPCODE_MASK(0x01e, 0x5));
-    tegra_stream_push(tegra->cmds, /* controlsecond */
-                    orientation << 26 | fr_mode << 24);
-    tegra_stream_push(tegra->cmds, rop3[op]); /* ropfade */
-    tegra_stream_push(tegra->cmds, HOST1X_OPCODE_NONINCR(0x046, 1));
-    /*
-     * [20:20] destination write tile mode (0: linear, 1: tiled)
-     * [ 0: 0] tile mode Y/RGB (0: linear, 1: tiled)
-     */
-    tegra_stream_push(tegra->cmds, 0x00000000); /* tilemode */
-
-    if (orientation == TEGRA2D_IDENTITY) {
-        tegra_stream_push(tegra->cmds, HOST1X_OPCODE_MASK(0x2b, 0x149));
+    /* FR unit addresses data linearly */
+    if (orientation != TEGRA2D_IDENTITY) {
+        tegra_exa_detile_pixmap(src_pixmap);
+        tegra_exa_detile_pixmap(dst_pixmap);
+    }
 
-        tegra_stream_push_reloc(tegra->cmds, tegra_exa_pixmap_bo(dst_pixmap),
-                                tegra_exa_pixmap_offset(dst_pixmap), true,
-                                tegra_exa_pixmap_is_from_pool(dst_pixmap));
-        tegra_stream_push(tegra->cmds, exaGetPixmapPitch(dst_pixmap)); /* dstst */
+    if (masked)
+        tegra->stats.num_2d_planemask_copies++;
 
-        tegra_stream_push_reloc(tegra->cmds, tegra_exa_pixmap_bo(src_pixmap),
-                                tegra_exa_pixmap_offset(src_pixmap), false,
-                                tegra_exa_pixmap_is_from_pool(src_pixmap));
-        tegra_stream_push(tegra->cmds, exaGetPixmapPitch(src_pixmap)); /* srcst */
-    } else {
-        tegra_stream_push(tegra->cmds, HOST1X_OPCODE_MASK(0x2b, 0x108));
-        tegra_stream_push(tegra->cmds, exaGetPixmapPitch(dst_pixmap)); /* dstst */
-        tegra_stream_push(tegra->cmds, exaGetPixmapPitch(src_pixmap)); /* srcst */
-    }
+    tegra->scratch.rop = op;
+    tegra->scratch.xor_pass = false;
+    tegra->scratch.read_dst = tegra_exa_rop_reads_dst(op);
 
-    if (tegra->cmds->status != TEGRADRM_STREAM_CONSTRUCT) {
-        tegra_stream_cleanup(tegra->cmds);
-        return false;
+    /*
+     * Only plain copies are batched, FR unit is used by the rotation and
+     * planemasked copy programs every pass by itself.
+     */
+    tegra->scratch.batched = orientation == TEGRA2D_IDENTITY && !masked &&
+                             tegra_exa_2d_state_begin_op(tegra, dst_pixmap,
+                                                         src_pixmap);
+    if (!tegra->scratch.batched) {
+        err = tegra_stream_begin(tegra->cmds, tegra->gr2d);
+        if (err < 0)
+            return false;
+
+        if (!masked)
+            tegra_exa_copy_2d_emit_setup(tegra->cmds, src_pixmap,
+                                         dst_pixmap, op, orientation);
+
+        if (tegra->cmds->status != TEGRADRM_STREAM_CONSTRUCT) {
+            tegra_stream_cleanup(tegra->cmds);
+            return false;
+        }
     }
 
     tegra->scratch.src = src_pixmap;
@@ -190,7 +489,13 @@ tegra_exa_prepare_copy_2d_ext(PixmapPtr src_pixmap, PixmapPtr dst_pixmap,
     tegra->scratch.src_y = -1;
     tegra->scratch.dst_x = -1;
     tegra->scratch.dst_y = -1;
+    tegra->scratch.written_x0 = 0;
+    tegra->scratch.written_y0 = 0;
+    tegra->scratch.written_x1 = 0;
+    tegra->scratch.written_y1 = 0;
     tegra->scratch.ops = 0;
+    tegra->scratch.dst_bands = 0;
+    tegra->scratch.src_bands = 0;
 
     return true;
 }
@@ -212,12 +517,62 @@ tegra_exa_prepare_copy_2d(PixmapPtr src_pixmap, PixmapPtr dst_pixmap,
     return false;
 }
 
-static void tegra_exa_copy_2d_ext(PixmapPtr dst_pixmap, int src_x, int src_y,
-                                  int dst_x, int dst_y, int width, int height)
+/*
+ * GR2D job is synced once at the end, but copying within the same pixmap
+ * or a raster operation that reads the destination may read data written
+ * by a previous blit of the job. In that case the blit shall wait for
+ * completion of the previous operations.
+ */
+static void tegra_exa_copy_2d_sync_read(struct tegra_exa *tegra,
+                                        int src_x, int src_y,
+                                        int width, int height)
+{
+    struct tegra_exa_scratch *scratch = &tegra->scratch;
+
+    if (scratch->written_x1 <= scratch->written_x0 ||
+        scratch->written_y1 <= scratch->written_y0)
+        return;
+
+    if (src_x >= scratch->written_x1 || src_x + width <= scratch->written_x0 ||
+        src_y >= scratch->written_y1 || src_y + height <= scratch->written_y0)
+        return;
+
+    tegra_stream_sync(tegra->cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE, true);
+
+    scratch->written_x0 = 0;
+    scratch->written_y0 = 0;
+    scratch->written_x1 = 0;
+    scratch->written_y1 = 0;
+}
+
+static void tegra_exa_copy_2d_written(struct tegra_exa *tegra,
+                                      int dst_x, int dst_y,
+                                      int width, int height)
+{
+    struct tegra_exa_scratch *scratch = &tegra->scratch;
+
+    if (scratch->written_x1 <= scratch->written_x0 ||
+        scratch->written_y1 <= scratch->written_y0) {
+        scratch->written_x0 = dst_x;
+        scratch->written_y0 = dst_y;
+        scratch->written_x1 = dst_x + width;
+        scratch->written_y1 = dst_y + height;
+        return;
+    }
+
+    scratch->written_x0 = min(scratch->written_x0, dst_x);
+    scratch->written_y0 = min(scratch->written_y0, dst_y);
+    scratch->written_x1 = max(scratch->written_x1, dst_x + width);
+    scratch->written_y1 = max(scratch->written_y1, dst_y + height);
+}
+
+static void tegra_exa_copy_2d_ext_emit_box(struct tegra_exa *tegra,
+                                           PixmapPtr dst_pixmap,
+                                           const BoxRec *grid)
 {
-    ScrnInfoPtr pScrn = xf86ScreenToScrn(dst_pixmap->drawable.pScreen);
-    struct tegra_exa *tegra = TegraPTR(pScrn)->exa;
     int tsrc_x, tsrc_y, tdst_x, tdst_y, twidth, theight;
+    int src_x, src_y, dst_x, dst_y, width, height;
+    int dst_width, dst_height;
     struct drm_tegra_bo * src_bo;
     struct drm_tegra_bo * dst_bo;
     PixmapPtr src_pixmap;
@@ -225,10 +580,6 @@ static void tegra_exa_copy_2d_ext(PixmapPtr dst_pixmap, int src_x, int src_y,
     unsigned cell_size;
     unsigned bpp;
     PictVector v;
-    BoxRec grid;
-
-    ACCEL_MSG("src %dx%d dst %dx%d w:h %d:%d\n",
-              src_x, src_y, dst_x, dst_y, width, height);
 
     src_pixmap = tegra->scratch.src;
     src_bo     = tegra_exa_pixmap_bo(src_pixmap);
@@ -236,25 +587,14 @@ static void tegra_exa_copy_2d_ext(PixmapPtr dst_pixmap, int src_x, int src_y,
     bpp        = dst_pixmap->drawable.bitsPerPixel;
     cell_size  = 16 / (bpp >> 3);
 
-    /*
-     * From TRM 29.2.3 comment to FR_MODE:
-     *
-     * Source and destination base address must be 128-bit word aligned
-     * engine works on FR_BLOCK granularity: transformed surface width in
-     * multiples of 16-bytes, transformed surface height in multiples of
-     * 16/8/4 lines for bpp8/bpp16/bpp32.
-     */
-
-    grid.x1 = TEGRA_ROUND_DOWN(dst_x, cell_size);
-    grid.y1 = TEGRA_ROUND_DOWN(dst_y, cell_size);
-    grid.x2 = TEGRA_ROUND_UP(dst_x + width,  cell_size);
-    grid.y2 = TEGRA_ROUND_UP(dst_y + height, cell_size);
+    dst_width  = grid->x2 - grid->x1;
+    dst_height = grid->y2 - grid->y1;
 
-    twidth  = grid.x2 - grid.x1;
-    theight = grid.y2 - grid.y1;
+    twidth  = dst_width;
+    theight = dst_height;
 
-    tdst_x = grid.x1;
-    tdst_y = grid.y1;
+    tdst_x = grid->x1;
+    tdst_y = grid->y1;
 
     v.vector[0] = tdst_x << 16;
     v.vector[1] = tdst_y << 16;
@@ -305,6 +645,13 @@ static void tegra_exa_copy_2d_ext(PixmapPtr dst_pixmap, int src_x, int src_y,
     width   = twidth  - 1;
     height  = theight - 1;
 
+    if (src_pixmap == dst_pixmap)
+        tegra_exa_copy_2d_sync_read(tegra, src_x, src_y, twidth, theight);
+
+    if (tegra->scratch.read_dst)
+        tegra_exa_copy_2d_sync_read(tegra, dst_x, dst_y,
+                                    dst_width, dst_height);
+
     tegra_stream_prep(tegra->cmds, 11);
 
     if (tegra->scratch.dst_x != dst_x || tegra->scratch.dst_y != dst_y) {
@@ -340,23 +687,168 @@ static void tegra_exa_copy_2d_ext(PixmapPtr dst_pixmap, int src_x, int src_y,
     tegra_stream_push(tegra->cmds, controlmain);
     tegra_stream_push(tegra->cmds, HOST1X_OPCODE_NONINCR(0x37, 0x1));
     tegra_stream_push(tegra->cmds, height << 16 | width); /* srcsize */
-    tegra_stream_sync(tegra->cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE, true);
 
-    tegra->scratch.ops++;
+    if (src_pixmap == dst_pixmap || tegra->scratch.read_dst)
+        tegra_exa_copy_2d_written(tegra, dst_x, dst_y,
+                                  dst_width, dst_height);
+
+    tegra_exa_solid_tiles_update(dst_pixmap, grid->x1, grid->y1,
+                                 grid->x2, grid->y2, false, 0);
+
+    tegra->stats.num_2d_rotate_blits++;
 }
 
-static void tegra_exa_copy_2d(PixmapPtr dst_pixmap, int src_x, int src_y,
-                              int dst_x, int dst_y, int width, int height)
+static inline unsigned int tegra_exa_box_area(const BoxRec *box)
+{
+    return (box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static inline bool tegra_exa_box_contains(const BoxRec *a, const BoxRec *b)
+{
+    return a->x1 <= b->x1 && a->y1 <= b->y1 &&
+           a->x2 >= b->x2 && a->y2 >= b->y2;
+}
+
+/*
+ * Two boxes are merged into their bounding box if that doesn't add too
+ * much of the untouched area, fetching the extra lines is cheaper than
+ * a separate blit of the FR unit.
+ */
+static bool tegra_exa_rotate_boxes_mergeable(const BoxRec *a, const BoxRec *b,
+                                             BoxRec *merged)
+{
+    unsigned int covered, overlap = 0;
+    BoxRec ext;
+
+    ext.x1 = min(a->x1, b->x1);
+    ext.y1 = min(a->y1, b->y1);
+    ext.x2 = max(a->x2, b->x2);
+    ext.y2 = max(a->y2, b->y2);
+
+    if (a->x1 < b->x2 && b->x1 < a->x2 && a->y1 < b->y2 && b->y1 < a->y2)
+        overlap = (min(a->x2, b->x2) - max(a->x1, b->x1)) *
+                  (min(a->y2, b->y2) - max(a->y1, b->y1));
+
+    covered = tegra_exa_box_area(a) + tegra_exa_box_area(b) - overlap;
+
+    if (covered * 100 < tegra_exa_box_area(&ext) * TEGRA_ROTATE_MERGE_COVERAGE)
+        return false;
+
+    *merged = ext;
+
+    return true;
+}
+
+static void tegra_exa_flush_rotate_boxes(struct tegra_exa *tegra,
+                                         PixmapPtr dst_pixmap)
+{
+    unsigned int i;
+
+    for (i = 0; i < tegra->num_rotate_boxes; i++)
+        tegra_exa_copy_2d_ext_emit_box(tegra, dst_pixmap,
+                                       &tegra->rotate_boxes[i]);
+
+    tegra->num_rotate_boxes = 0;
+}
+
+/*
+ * Shadow update of rotated CRTC copies every damaged box, each box is
+ * expanded to the FR_BLOCK granularity. Boxes are queued up till the end
+ * of operation, boxes that are covered by others are dropped and close
+ * boxes are merged into larger ones.
+ */
+static void tegra_exa_queue_rotate_box(struct tegra_exa *tegra,
+                                       PixmapPtr dst_pixmap, BoxRec box)
+{
+    BoxRec merged;
+    unsigned int i;
+
+    tegra->stats.num_2d_rotate_boxes++;
+
+    if (DISABLE_ROTATE_MERGE) {
+        tegra_exa_copy_2d_ext_emit_box(tegra, dst_pixmap, &box);
+        return;
+    }
+
+restart:
+    for (i = 0; i < tegra->num_rotate_boxes; i++) {
+        if (tegra_exa_box_contains(&tegra->rotate_boxes[i], &box)) {
+            tegra->stats.num_2d_rotate_boxes_skipped++;
+            return;
+        }
+
+        if (tegra_exa_box_contains(&box, &tegra->rotate_boxes[i]))
+            tegra->stats.num_2d_rotate_boxes_skipped++;
+        else if (tegra_exa_rotate_boxes_mergeable(&tegra->rotate_boxes[i],
+                                                  &box, &merged))
+            tegra->stats.num_2d_rotate_boxes_merged++;
+        else
+            continue;
+
+        if (!tegra_exa_box_contains(&box, &tegra->rotate_boxes[i]))
+            box = merged;
+
+        tegra->rotate_boxes[i] = tegra->rotate_boxes[--tegra->num_rotate_boxes];
+
+        /* grown box may cover or merge other boxes now */
+        goto restart;
+    }
+
+    if (tegra->num_rotate_boxes == TEGRA_ARRAY_SIZE(tegra->rotate_boxes))
+        tegra_exa_flush_rotate_boxes(tegra, dst_pixmap);
+
+    tegra->rotate_boxes[tegra->num_rotate_boxes++] = box;
+}
+
+static void tegra_exa_copy_2d_ext(PixmapPtr dst_pixmap, int src_x, int src_y,
+                                  int dst_x, int dst_y, int width, int height)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(dst_pixmap->drawable.pScreen);
     struct tegra_exa *tegra = TegraPTR(pScrn)->exa;
-    uint32_t controlmain;
+    unsigned cell_size;
+    BoxRec grid;
 
     ACCEL_MSG("src %dx%d dst %dx%d w:h %d:%d\n",
               src_x, src_y, dst_x, dst_y, width, height);
 
-    if (tegra_exa_optimize_copy_op(dst_pixmap, dst_x, dst_y, width, height))
-        return;
+    cell_size = 16 / (dst_pixmap->drawable.bitsPerPixel >> 3);
+
+    /*
+     * From TRM 29.2.3 comment to FR_MODE:
+     *
+     * Source and destination base address must be 128-bit word aligned
+     * engine works on FR_BLOCK granularity: transformed surface width in
+     * multiples of 16-bytes, transformed surface height in multiples of
+     * 16/8/4 lines for bpp8/bpp16/bpp32.
+     */
+
+    grid.x1 = TEGRA_ROUND_DOWN(dst_x, cell_size);
+    grid.y1 = TEGRA_ROUND_DOWN(dst_y, cell_size);
+    grid.x2 = TEGRA_ROUND_UP(dst_x + width,  cell_size);
+    grid.y2 = TEGRA_ROUND_UP(dst_y + height, cell_size);
+
+    tegra_exa_queue_rotate_box(tegra, dst_pixmap, grid);
+
+    tegra->scratch.ops++;
+}
+
+static void tegra_exa_copy_2d_emit_rect(struct tegra_exa *tegra,
+                                        PixmapPtr dst_pixmap,
+                                        int src_x, int src_y,
+                                        int dst_x, int dst_y,
+                                        int width, int height)
+{
+    PixmapPtr src_pixmap = tegra->scratch.src;
+    uint32_t controlmain;
+
+    if (src_pixmap == dst_pixmap)
+        tegra_exa_copy_2d_sync_read(tegra, src_x, src_y, width, height);
+
+    if (tegra->scratch.read_dst)
+        tegra_exa_copy_2d_sync_read(tegra, dst_x, dst_y, width, height);
+
+    if (src_pixmap == dst_pixmap || tegra->scratch.read_dst)
+        tegra_exa_copy_2d_written(tegra, dst_x, dst_y, width, height);
 
     /*
      * [20:20] source color depth (0: mono, 1: same)
@@ -386,7 +878,35 @@ static void tegra_exa_copy_2d(PixmapPtr dst_pixmap, int src_x, int src_y,
     tegra_stream_push(tegra->cmds, height << 16 | width); /* dstsize */
     tegra_stream_push(tegra->cmds, src_y << 16 | src_x); /* srcps */
     tegra_stream_push(tegra->cmds, dst_y << 16 | dst_x); /* dstps */
-    tegra_stream_sync(tegra->cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE, true);
+}
+
+static void tegra_exa_copy_2d(PixmapPtr dst_pixmap, int src_x, int src_y,
+                              int dst_x, int dst_y, int width, int height)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(dst_pixmap->drawable.pScreen);
+    struct tegra_exa *tegra = TegraPTR(pScrn)->exa;
+
+    ACCEL_MSG("src %dx%d dst %dx%d w:h %d:%d\n",
+              src_x, src_y, dst_x, dst_y, width, height);
+
+    tegra->scratch.dst_bands |= tegra_exa_pixmap_bands(dst_pixmap, dst_y,
+                                                       height);
+    tegra->scratch.src_bands |= tegra_exa_pixmap_bands(tegra->scratch.src,
+                                                       src_y, height);
+
+    if (tegra_exa_optimize_copy_op(dst_pixmap, src_x, src_y,
+                                   dst_x, dst_y, width, height))
+        return;
+
+    if (tegra->scratch.planemask_tmp)
+        tegra_exa_copy_2d_emit_masked_rect(tegra, dst_pixmap, src_x, src_y,
+                                           dst_x, dst_y, width, height);
+    else if (tegra->scratch.batched)
+        tegra_exa_2d_state_add_rect(tegra, src_x, src_y, dst_x, dst_y,
+                                    width, height);
+    else
+        tegra_exa_copy_2d_emit_rect(tegra, dst_pixmap, src_x, src_y,
+                                    dst_x, dst_y, width, height);
 
     tegra->scratch.ops++;
 }
@@ -403,14 +923,21 @@ static void tegra_exa_done_copy_2d(PixmapPtr dst_pixmap)
 
     tegra_exa_complete_copy_optimization(dst_pixmap);
 
-    if (tegra->scratch.ops && tegra->cmds->status == TEGRADRM_STREAM_CONSTRUCT) {
+    if (tegra->scratch.batched) {
+        if (tegra->scratch.ops && dst_priv->scanout)
+            tegra->stats.num_2d_copy_jobs_to_scanout++;
+
+        tegra_exa_2d_state_finish_op(tegra);
+    } else if (tegra->scratch.ops && tegra->cmds->status == TEGRADRM_STREAM_CONSTRUCT) {
         tegra->stats.num_2d_copy_jobs_bytes += tegra_stream_pushbuf_size(tegra->cmds);
         tegra_stream_end(tegra->cmds);
 
-        tegra_exa_wait_pixmaps(TEGRA_3D, dst_pixmap, 1, tegra->scratch.src);
+        tegra_exa_wait_pixmaps(TEGRA_3D, dst_pixmap, 2, tegra->scratch.src,
+                               tegra->scratch.planemask_tmp);
 
         explicit_fence = tegra_exa_get_explicit_fence(TEGRA_3D, dst_pixmap,
-                                                      1, tegra->scratch.src);
+                                                      2, tegra->scratch.src,
+                                                      tegra->scratch.planemask_tmp);
 
         PROFILE_START(copy);
         fence = tegra_exa_stream_submit(tegra, TEGRA_2D, explicit_fence);
@@ -419,7 +946,10 @@ static void tegra_exa_done_copy_2d(PixmapPtr dst_pixmap)
         TEGRA_FENCE_PUT(explicit_fence);
 
         tegra_exa_replace_pixmaps_fence(TEGRA_2D, fence, &tegra->scratch,
-                                        dst_pixmap, 1, tegra->scratch.src);
+                                        tegra->scratch.dst_bands,
+                                        tegra->scratch.src_bands,
+                                        dst_pixmap, 2, tegra->scratch.src,
+                                        tegra->scratch.planemask_tmp);
 
         if (dst_priv->scanout)
             tegra->stats.num_2d_copy_jobs_to_scanout++;
@@ -432,6 +962,8 @@ static void tegra_exa_done_copy_2d(PixmapPtr dst_pixmap)
     tegra_exa_cool_pixmap(tegra->scratch.src, false);
     tegra_exa_cool_pixmap(dst_pixmap, true);
 
+    tegra->scratch.planemask_tmp = NULL;
+
     ACCEL_MSG("\n");
 }
 
@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) Dmitry Osipenko
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define DISABLE_COST_CALIBRATION    false
+
+/* calibration surface is 256x256 at 32bpp */
+#define TEGRA_COST_CALIBRATION_SIZE     (256 * 1024)
+#define TEGRA_COST_CALIBRATION_PASSES   4
+
+/* queued jobs beyond that are likely to be completed by the time we wait */
+#define TEGRA_COST_MAX_QUEUE_DEPTH      8
+
+/*
+ * Defaults are used if calibration fails, they match the former static
+ * thresholds: CPU-fill is preferred for regions smaller than 128KB.
+ */
+static void tegra_exa_cost_model_defaults(struct tegra_exa_cost_model *cost)
+{
+    cost->cpu_ns_per_kb = 250;
+    cost->cpu_wc_ns_per_kb = 500;
+    cost->cpu_map_ns = 20000;
+    cost->job_ns[TEGRA_2D] = 60000;
+    cost->job_ns[TEGRA_3D] = 60000;
+    cost->ns_per_kb[TEGRA_2D] = 30;
+    cost->ns_per_kb[TEGRA_3D] = 30;
+    cost->sync_ns = 60000;
+    cost->calibrated = false;
+}
+
+static uint32_t tegra_exa_cost_elapsed_ns(const struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return timespec_diff(start, &end) * 1000;
+}
+
+static uint32_t tegra_exa_cost_measure_cpu_fill(void *ptr)
+{
+    struct timespec start;
+    unsigned int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < TEGRA_COST_CALIBRATION_PASSES; i++)
+        memset(ptr, i, TEGRA_COST_CALIBRATION_SIZE);
+
+    return tegra_exa_cost_elapsed_ns(&start) / TEGRA_COST_CALIBRATION_PASSES;
+}
+
+static int tegra_exa_cost_measure_2d_fill(struct tegra_exa *exa,
+                                          struct drm_tegra_bo *bo,
+                                          unsigned int width,
+                                          unsigned int height,
+                                          uint32_t *time_ns)
+{
+    struct tegra_stream *cmds = exa->cmds;
+    struct timespec start;
+    int err;
+
+    err = tegra_stream_begin(cmds, exa->gr2d);
+    if (err < 0)
+        return err;
+
+    tegra_stream_prep(cmds, 16);
+    tegra_stream_push_setclass(cmds, HOST1X_CLASS_GR2D);
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x9, 0x9));
+    tegra_stream_push(cmds, 0x0000003a); /* trigger */
+    tegra_stream_push(cmds, 0x00000000); /* cmdsel */
+    tegra_stream_push(cmds, HOST1X_OPCODE_NONINCR(0x35, 1));
+    tegra_stream_push(cmds, 0x00000000);
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x1e, 0x7));
+    tegra_stream_push(cmds, 0x00000000); /* controlsecond */
+    tegra_stream_push(cmds, (2 << 16) | (1 << 6) | (1 << 2)); /* controlmain */
+    tegra_stream_push(cmds, rop3[GXcopy]); /* ropfade */
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x2b, 0x9));
+    tegra_stream_push_reloc(cmds, bo, 0, true, false);
+    tegra_stream_push(cmds, 256 * 4); /* dstst */
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x38, 0x5));
+    tegra_stream_push(cmds, height << 16 | width); /* dstsize */
+    tegra_stream_push(cmds, 0x00000000); /* dstps */
+
+    if (cmds->status != TEGRADRM_STREAM_CONSTRUCT) {
+        tegra_stream_cleanup(cmds);
+        return -1;
+    }
+
+    tegra_stream_end(cmds);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    err = tegra_stream_flush(cmds, NULL);
+    if (err < 0)
+        return err;
+
+    *time_ns = tegra_exa_cost_elapsed_ns(&start);
+
+    return 0;
+}
+
+/*
+ * Short microbenchmark performed at startup. GR3D shares the Host1x job
+ * submission path and the memory bandwidth with GR2D, hence it's assumed
+ * to match GR2D, which is much simpler to exercise.
+ */
+static void tegra_exa_calibrate_cost_model(struct tegra_exa *exa)
+{
+    struct tegra_exa_cost_model *cost = &exa->cost;
+    uint32_t job_ns, fill_ns, cpu_ns, wc_ns, map_ns;
+    struct drm_tegra_bo *bo;
+    struct timespec start;
+    void *ptr;
+    int err;
+
+    tegra_exa_cost_model_defaults(cost);
+
+    if (DISABLE_COST_CALIBRATION)
+        return;
+
+    ptr = malloc(TEGRA_COST_CALIBRATION_SIZE);
+    if (!ptr)
+        return;
+
+    /* first pass faults pages in */
+    memset(ptr, 0, TEGRA_COST_CALIBRATION_SIZE);
+    cpu_ns = tegra_exa_cost_measure_cpu_fill(ptr);
+    free(ptr);
+
+    err = drm_tegra_bo_new(&bo, exa->scratch.drm, exa->default_drm_bo_flags,
+                           TEGRA_COST_CALIBRATION_SIZE);
+    if (err)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    err = drm_tegra_bo_map(bo, &ptr);
+    if (err)
+        goto unref;
+
+    memset(ptr, 0, TEGRA_COST_CALIBRATION_SIZE);
+    map_ns = tegra_exa_cost_elapsed_ns(&start);
+
+    wc_ns = tegra_exa_cost_measure_cpu_fill(ptr);
+
+    /* first job may take a slow path of the kernel driver */
+    err = tegra_exa_cost_measure_2d_fill(exa, bo, 16, 16, &job_ns);
+    if (err)
+        goto unmap;
+
+    err = tegra_exa_cost_measure_2d_fill(exa, bo, 16, 16, &job_ns);
+    if (err)
+        goto unmap;
+
+    err = tegra_exa_cost_measure_2d_fill(exa, bo, 256, 256, &fill_ns);
+    if (err)
+        goto unmap;
+
+    cost->cpu_ns_per_kb = max(cpu_ns / 256, 1u);
+    cost->cpu_wc_ns_per_kb = max(wc_ns / 256, 1u);
+    cost->cpu_map_ns = map_ns > wc_ns ? map_ns - wc_ns : 0;
+    cost->job_ns[TEGRA_2D] = job_ns;
+    cost->job_ns[TEGRA_3D] = job_ns;
+    cost->ns_per_kb[TEGRA_2D] = max(fill_ns > job_ns ?
+                                    (fill_ns - job_ns) / 256 : 0, 1u);
+    cost->ns_per_kb[TEGRA_3D] = cost->ns_per_kb[TEGRA_2D];
+    cost->sync_ns = job_ns;
+    cost->calibrated = true;
+unmap:
+    drm_tegra_bo_unmap(bo);
+unref:
+    drm_tegra_bo_unref(bo);
+}
+
+static void tegra_exa_release_cost_model(struct tegra_exa *exa)
+{
+    unsigned int i;
+
+    for (i = 0; i < TEGRA_ENGINES_NUM; i++) {
+        TEGRA_FENCE_PUT(exa->cost.last_fence[i]);
+        exa->cost.last_fence[i] = NULL;
+    }
+}
+
+/* number of jobs that were submitted since engine was observed idling */
+static unsigned int tegra_exa_cost_queue_depth(struct tegra_exa *exa,
+                                               enum host1x_engine engine)
+{
+    struct tegra_exa_cost_model *cost = &exa->cost;
+
+    if (cost->queued_jobs[engine] &&
+        TEGRA_FENCE_COMPLETED(cost->last_fence[engine])) {
+        TEGRA_FENCE_PUT(cost->last_fence[engine]);
+        cost->last_fence[engine] = NULL;
+        cost->queued_jobs[engine] = 0;
+    }
+
+    return min(cost->queued_jobs[engine], TEGRA_COST_MAX_QUEUE_DEPTH);
+}
+
+static bool tegra_exa_cost_pixmap_busy_on(struct tegra_exa *exa,
+                                          struct tegra_pixmap *pixmap,
+                                          enum host1x_engine engine)
+{
+    if (pixmap->type < TEGRA_EXA_PIXMAP_TYPE_BO)
+        return false;
+
+    if (!TEGRA_FENCE_COMPLETED(pixmap->fence_write[engine]) ||
+        !TEGRA_FENCE_COMPLETED(pixmap->fence_read[engine]))
+        return true;
+
+    if (engine == TEGRA_2D)
+        return tegra_exa_pixmap_is_in_deferred_2d_state(&exa->gr2d_state,
+                                                        pixmap);
+
+    return tegra_exa_pixmap_is_in_deferred_3d_state(&exa->gr3d_state, pixmap);
+}
+
+static bool tegra_exa_cost_pixmap_mapped(struct tegra_pixmap *pixmap)
+{
+    struct tegra_pixmap_pool *pool;
+
+    if (pixmap->type == TEGRA_EXA_PIXMAP_TYPE_BO)
+        return drm_tegra_bo_mapped(pixmap->bo);
+
+    if (pixmap->type == TEGRA_EXA_PIXMAP_TYPE_POOL) {
+        pool = to_tegra_pool(pixmap->pool_entry.pool);
+        return drm_tegra_bo_mapped(pool->bo);
+    }
+
+    return true;
+}
+
+static uint32_t tegra_exa_cost_cpu(struct tegra_exa *exa,
+                                   struct tegra_pixmap *pixmap,
+                                   unsigned int bytes, bool mapped)
+{
+    struct tegra_exa_cost_model *cost = &exa->cost;
+    uint32_t ns;
+
+    /* sysmem is cached, DRM BOs are mapped write-combined */
+    if (pixmap->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK)
+        ns = bytes / 1024 * cost->cpu_ns_per_kb;
+    else
+        ns = bytes / 1024 * cost->cpu_wc_ns_per_kb;
+
+    if (!mapped)
+        ns += cost->cpu_map_ns;
+
+    /* CPU shall wait for the GPU jobs */
+    if (tegra_exa_cost_pixmap_busy_on(exa, pixmap, TEGRA_2D) ||
+        tegra_exa_cost_pixmap_busy_on(exa, pixmap, TEGRA_3D))
+        ns += cost->sync_ns;
+
+    return ns;
+}
+
+static uint32_t tegra_exa_cost_hw(struct tegra_exa *exa,
+                                  enum host1x_engine engine,
+                                  struct tegra_pixmap *pixmap,
+                                  unsigned int bytes)
+{
+    enum host1x_engine other = engine == TEGRA_2D ? TEGRA_3D : TEGRA_2D;
+    struct tegra_exa_cost_model *cost = &exa->cost;
+    uint32_t ns;
+
+    ns = bytes / 1024 * cost->ns_per_kb[engine];
+    ns += tegra_exa_cost_queue_depth(exa, engine) * cost->job_ns[engine];
+
+    /* 3D operations are merged into the pending job */
+    if (engine != TEGRA_3D || !exa->gr3d_state.num_ops)
+        ns += cost->job_ns[engine];
+
+    if (tegra_exa_cost_pixmap_busy_on(exa, pixmap, other))
+        ns += cost->sync_ns;
+
+    return ns;
+}
+
+/*
+ * Returns true if the region of pixmap should be filled by CPU rather than
+ * by GR2D. Caller is responsible for the hard restrictions, like tiling.
+ */
+static bool tegra_exa_cost_prefer_cpu_fill(struct tegra_exa *exa,
+                                           struct tegra_pixmap *pixmap,
+                                           unsigned int bytes, bool mapped)
+{
+    bool cpu;
+
+    if (pixmap->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK)
+        return true;
+
+    cpu = tegra_exa_cost_cpu(exa, pixmap, bytes, mapped) <
+          tegra_exa_cost_hw(exa, TEGRA_2D, pixmap, bytes);
+
+    if (cpu)
+        exa->stats.num_cost_cpu_choices++;
+    else
+        exa->stats.num_cost_2d_choices++;
+
+    return cpu;
+}
+
+/*
+ * Both engines are capable to perform the composite operation, select
+ * the cheapest one. Size of the operation isn't known at the preparation
+ * time, the whole destination is accounted.
+ */
+static enum host1x_engine
+tegra_exa_cost_select_composite_engine(struct tegra_exa *exa, PixmapPtr dst)
+{
+    struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(dst);
+    unsigned int bytes = tegra_exa_pixmap_size(priv);
+
+    if (tegra_exa_cost_hw(exa, TEGRA_3D, priv, bytes) <
+        tegra_exa_cost_hw(exa, TEGRA_2D, priv, bytes)) {
+        exa->stats.num_cost_3d_choices++;
+        return TEGRA_3D;
+    }
+
+    exa->stats.num_cost_2d_choices++;
+
+    return TEGRA_2D;
+}
+
+/* vim: set et sts=4 sw=4 ts=4: */
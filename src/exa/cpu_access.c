@@ -20,17 +20,222 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#define DISABLE_COPY_ON_WRITE       false
+#define TEGRA_COW_MAX_SIZE          (4 * 1024 * 1024)
+#define DISABLE_SHADOW_ACCESS       false
+#define TEGRA_SHADOW_MAX_SIZE       (256 * 1024)
+
 static PROFILE_DEF(cpu_access);
 
-static bool tegra_exa_prepare_cpu_access(PixmapPtr pixmap, int idx, void **ptr,
-                                         bool cancel_optimizations)
+/*
+ * CPU writing to a pixmap that is read by HW has to wait for the readers.
+ * Instead, pixmap's data is copied into a new BO and the old BO is retired
+ * to the freelist, where it stays until readers are done with it.
+ */
+static bool tegra_exa_pixmap_copy_on_write(TegraPtr tegra, PixmapPtr pixmap,
+                                           uint32_t bands)
+{
+    struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(pixmap);
+    struct tegra_exa *exa = tegra->exa;
+    struct tegra_pixmap *retired;
+    void *src, *dst;
+    unsigned int size, i;
+    bool busy = false;
+    int err;
+
+    if (DISABLE_COPY_ON_WRITE)
+        return false;
+
+    /* exported BOs can't be replaced */
+    if (priv->type != TEGRA_EXA_PIXMAP_TYPE_BO || priv->tiled ||
+        priv->scanout || priv->dri || !priv->accel)
+        return false;
+
+    size = tegra_exa_pixmap_size(priv);
+    if (size > TEGRA_COW_MAX_SIZE)
+        return false;
+
+    /* writers have to be awaited anyway */
+    for (i = 0; i < TEGRA_ENGINES_NUM; i++) {
+        if (!TEGRA_FENCE_COMPLETED(priv->fence_write[i]))
+            return false;
+
+        if ((priv->bands_read[i] & bands) &&
+            !TEGRA_FENCE_COMPLETED(priv->fence_read[i]))
+            busy = true;
+    }
+
+    if (!busy)
+        return false;
+
+    if (tegra_exa_pixmap_is_in_deferred_2d_state(&exa->gr2d_state, priv) ||
+        tegra_exa_pixmap_is_in_deferred_3d_state(&exa->gr3d_state, priv))
+        return false;
+
+    retired = calloc(1, sizeof(*retired));
+    if (!retired)
+        return false;
+
+    retired->type = TEGRA_EXA_PIXMAP_TYPE_BO;
+    retired->bo = priv->bo;
+    retired->sparse = priv->sparse;
+
+    if (!tegra_exa_pixmap_allocate_from_bo(tegra, priv, size))
+        goto err_free;
+
+    err = drm_tegra_bo_map(retired->bo, &src);
+    if (err < 0)
+        goto err_unref;
+
+    err = drm_tegra_bo_map(priv->bo, &dst);
+    if (err < 0) {
+        drm_tegra_bo_unmap(retired->bo);
+        goto err_unref;
+    }
+
+    tegra_memcpy_vfp_threaded(dst, src, size, tegra_memcpy_vfp_aligned);
+
+    drm_tegra_bo_unmap(priv->bo);
+    drm_tegra_bo_unmap(retired->bo);
+
+    for (i = 0; i < TEGRA_ENGINES_NUM; i++) {
+        retired->fence_read[i]  = priv->fence_read[i];
+        retired->fence_write[i] = priv->fence_write[i];
+
+        priv->fence_read[i]  = NULL;
+        priv->fence_write[i] = NULL;
+    }
+
+    /* released by tegra_exa_clean_up_pixmaps_freelist() */
+    retired->tegra_data = true;
+    retired->accel = true;
+    retired->destroyed = true;
+    tegra_exa_pixmaps_freelist_add(exa, retired, size);
+
+    /* readback refers to the retired BO */
+    tegra_exa_readback_forget(exa, priv);
+
+    exa->stats.num_cpu_copy_on_writes++;
+    exa->stats.num_cpu_copy_on_writes_bytes += size;
+
+    return true;
+
+err_unref:
+    drm_tegra_bo_unref(priv->bo);
+err_free:
+    priv->bo = retired->bo;
+    priv->sparse = retired->sparse;
+    free(retired);
+
+    return false;
+}
+
+/*
+ * Pixmap's data is mapped write-combined, CPU reads from that memory are
+ * very slow and fb's read-modify-write operations (blending of AA text
+ * and alike) take a hit on every pixel. Small pixmaps are downloaded into
+ * a cached shadow buffer for the time of fallback, the snapshot of the
+ * downloaded data tells which rows were modified and need to be written
+ * back.
+ */
+static void tegra_exa_shadow_cpu_access(struct tegra_exa *exa,
+                                        PixmapPtr pixmap,
+                                        struct tegra_pixmap *priv,
+                                        void **ptr)
+{
+    unsigned int size;
+    char *shadow;
+
+    if (DISABLE_SHADOW_ACCESS)
+        return;
+
+    /* exported pixmaps are accessed behind our back */
+    if (!*ptr || priv->shadow || priv->tiled || priv->scanout || priv->dri)
+        return;
+
+    size = tegra_exa_pixmap_size(priv);
+    if (size > TEGRA_SHADOW_MAX_SIZE)
+        return;
+
+    if (posix_memalign((void **)&shadow, 128, size * 2))
+        return;
+
+    if (!tegra_memcpy_vfp_copy_is_safe(shadow, *ptr, size)) {
+        free(shadow);
+        return;
+    }
+
+    tegra_memcpy_vfp_aligned_dst_cached(shadow, *ptr, size);
+    memcpy(shadow + size, shadow, size);
+
+    priv->shadow = shadow;
+    priv->shadow_map = *ptr;
+    *ptr = shadow;
+
+    exa->stats.num_cpu_shadow_accesses++;
+}
+
+static void tegra_exa_finish_shadow_cpu_access(struct tegra_exa *exa,
+                                               PixmapPtr pixmap,
+                                               struct tegra_pixmap *priv)
+{
+    unsigned int pitch = exaGetPixmapPitch(pixmap);
+    unsigned int size = tegra_exa_pixmap_size(priv);
+    char *snapshot = (char *)priv->shadow + size;
+    char *shadow = priv->shadow;
+    unsigned int start, end;
+    char *dst;
+    int y1, y2;
+
+    for (y1 = 0; y1 < pixmap->drawable.height; y1++) {
+        if (memcmp(shadow + y1 * pitch, snapshot + y1 * pitch, pitch))
+            break;
+    }
+
+    for (y2 = pixmap->drawable.height - 1; y2 > y1; y2--) {
+        if (memcmp(shadow + y2 * pitch, snapshot + y2 * pitch, pitch))
+            break;
+    }
+
+    /* rows outside of the modified range may be written by HW */
+    if (y1 < pixmap->drawable.height) {
+        start = y1 * pitch;
+        end = (y2 + 1) * pitch;
+        dst = (char *)priv->shadow_map + start;
+
+        if (tegra_memcpy_vfp_copy_is_safe(dst, shadow + start, end - start))
+            tegra_memcpy_vfp_aligned_src_cached(dst, shadow + start,
+                                                end - start);
+        else
+            tegra_memcpy_vfp_unaligned(dst, shadow + start, end - start);
+
+        exa->stats.num_cpu_shadow_writeback_bytes += end - start;
+    }
+
+    free(priv->shadow);
+    priv->shadow = NULL;
+    priv->shadow_map = NULL;
+}
+
+/*
+ * Prepares pixmap for CPU access to the given rows, HW jobs that don't
+ * touch the rows aren't waited for. The shadow is allowed only for EXA
+ * fallbacks, whose access pattern is unknown.
+ */
+static bool tegra_exa_prepare_cpu_access_rows(PixmapPtr pixmap, int idx,
+                                              void **ptr,
+                                              bool cancel_optimizations,
+                                              int y, int height,
+                                              bool allow_shadow)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pixmap->drawable.pScreen);
     struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(pixmap);
     TegraPtr tegra = TegraPTR(pScrn);
     struct tegra_exa *exa = tegra->exa;
+    bool shadow;
     bool write = false;
     bool accel = false;
+    uint32_t bands;
     int err;
 
     FALLBACK_MSG("pixmap %p idx %d type %u %d:%d:%d %p\n",
@@ -59,6 +264,10 @@ static bool tegra_exa_prepare_cpu_access(PixmapPtr pixmap, int idx, void **ptr,
 
     tegra_exa_thaw_pixmap(pixmap, accel);
 
+    /* CPU may write anything, solid areas aren't known anymore */
+    if (cancel_optimizations && write)
+        tegra_exa_solid_tiles_invalidate(priv);
+
     if (priv->type == TEGRA_EXA_PIXMAP_TYPE_FALLBACK) {
         PROFILE_START(cpu_access);
         *ptr = priv->fallback;
@@ -68,17 +277,37 @@ static bool tegra_exa_prepare_cpu_access(PixmapPtr pixmap, int idx, void **ptr,
     if (cancel_optimizations)
         tegra_exa_flush_deferred_operations(pixmap, false, write, true);
 
+    /*
+     * Tiled data is converted to the linear layout in-place, hence all
+     * HW operations must be completed beforehand.
+     */
+    if (priv->tiled) {
+        tegra_exa_flush_deferred_operations(pixmap, false, true, true);
+        TEGRA_PIXMAP_WAIT_READ_FENCES(priv);
+    }
+
     /*
      * EXA doesn't sync for Upload/DownloadFromScreen, assuming that HW
      * will take care of the fencing.
      *
      * Wait for the HW operations to be completed.
      */
+    shadow = allow_shadow && cancel_optimizations && idx == EXA_PREPARE_DEST;
+
+    /* shadow snapshots the whole pixmap */
+    if (priv->tiled || shadow)
+        bands = TEGRA_FENCE_BANDS_ALL;
+    else
+        bands = tegra_exa_pixmap_bands(pixmap, y, height);
+
     switch (idx) {
     default:
     case EXA_PREPARE_DEST:
     case EXA_PREPARE_AUX_DEST:
-        TEGRA_PIXMAP_WAIT_READ_FENCES(priv);
+        if (cancel_optimizations)
+            tegra_exa_pixmap_copy_on_write(tegra, pixmap, bands);
+
+        tegra_exa_pixmap_wait_bands(exa, priv, bands, true);
 
         if (cancel_optimizations) {
             if (priv->state.alpha_0)
@@ -99,7 +328,7 @@ static bool tegra_exa_prepare_cpu_access(PixmapPtr pixmap, int idx, void **ptr,
     case EXA_PREPARE_AUX_SRC:
     case EXA_PREPARE_AUX_MASK:
     case EXA_NUM_PREPARE_INDICES:
-        TEGRA_PIXMAP_WAIT_WRITE_FENCES(priv);
+        tegra_exa_pixmap_wait_bands(exa, priv, bands, false);
 
         if (!cancel_optimizations && !write)
             exa->stats.num_cpu_read_accesses++;
@@ -107,6 +336,10 @@ static bool tegra_exa_prepare_cpu_access(PixmapPtr pixmap, int idx, void **ptr,
 
     if (priv->type == TEGRA_EXA_PIXMAP_TYPE_POOL) {
         *ptr = tegra_exa_pixmap_pool_map_entry(&priv->pool_entry);
+
+        if (shadow)
+            tegra_exa_shadow_cpu_access(exa, pixmap, priv, ptr);
+
         PROFILE_START(cpu_access);
         return true;
     }
@@ -123,6 +356,12 @@ static bool tegra_exa_prepare_cpu_access(PixmapPtr pixmap, int idx, void **ptr,
 
         PROFILE_STOP(mmap);
 
+        if (priv->tiled)
+            tegra_exa_detile_pixmap_data(priv, *ptr);
+
+        if (shadow)
+            tegra_exa_shadow_cpu_access(exa, pixmap, priv, ptr);
+
         PROFILE_START(cpu_access);
         return true;
     }
@@ -130,13 +369,43 @@ static bool tegra_exa_prepare_cpu_access(PixmapPtr pixmap, int idx, void **ptr,
     return false;
 }
 
+static bool tegra_exa_prepare_cpu_access(PixmapPtr pixmap, int idx, void **ptr,
+                                         bool cancel_optimizations)
+{
+    return tegra_exa_prepare_cpu_access_rows(pixmap, idx, ptr,
+                                             cancel_optimizations,
+                                             0, pixmap->drawable.height,
+                                             cancel_optimizations);
+}
+
 static void tegra_exa_finish_cpu_access(PixmapPtr pixmap, int idx)
 {
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pixmap->drawable.pScreen);
     struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(pixmap);
+    TegraPtr tegra = TegraPTR(pScrn);
+    bool write = false;
     int err;
 
     PROFILE_STOP(cpu_access);
 
+    switch (idx) {
+    default:
+    case EXA_PREPARE_DEST:
+    case EXA_PREPARE_AUX_DEST:
+        write = true;
+        break;
+
+    case EXA_PREPARE_SRC:
+    case EXA_PREPARE_MASK:
+    case EXA_PREPARE_AUX_SRC:
+    case EXA_PREPARE_AUX_MASK:
+    case EXA_NUM_PREPARE_INDICES:
+        break;
+    }
+
+    if (priv->shadow)
+        tegra_exa_finish_shadow_cpu_access(tegra->exa, pixmap, priv);
+
     if (priv->type == TEGRA_EXA_PIXMAP_TYPE_BO) {
         err = drm_tegra_bo_unmap(priv->bo);
         if (err < 0)
@@ -146,7 +415,7 @@ static void tegra_exa_finish_cpu_access(PixmapPtr pixmap, int idx)
     if (priv->type == TEGRA_EXA_PIXMAP_TYPE_POOL)
         tegra_exa_pixmap_pool_unmap_entry(&priv->pool_entry);
 
-    tegra_exa_cool_pixmap(pixmap, true);
+    tegra_exa_cool_pixmap(pixmap, write);
 
     FALLBACK_MSG("pixmap %p idx %d\n", pixmap, idx);
 }
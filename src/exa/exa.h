@@ -77,8 +77,6 @@
 #define INFO_MSG2(fmt, args...)                                             \
     xf86DrvMsg(-1, X_INFO, fmt, ##args)
 
-#define TEGRA_EXA_CPU_FILL_MIN_SIZE     (128 * 1024)
-
 #define PROFILE                         0
 #define PROFILE_GPU                     0
 
@@ -181,6 +179,39 @@ struct tegra_pixmap_3d_state {
     bool read : 1;
 };
 
+#define TEGRA_3D_MAX_QUEUED_RECTS   32
+#define TEGRA_3D_MAX_DRAWS          128
+
+struct tegra_3d_rect {
+    int src_x, src_y;
+    int mask_x, mask_y;
+    int dst_x, dst_y;
+    int width, height;
+};
+
+struct tegra_3d_draw {
+    unsigned int first_vtx;
+    unsigned int vtx_cnt;
+    int scissor_x, scissor_y;
+    int scissor_width, scissor_height;
+    bool scissored;
+};
+
+#define TEGRA_3D_MAX_QUEUED_OPS     16
+#define TEGRA_3D_MAX_QUEUED_DRAWS   256
+
+struct tegra_3d_op {
+    struct tegra_3d_draw_state state;
+    PictTransform transform_src;
+    PictTransform transform_mask;
+    unsigned int attrib_offset;
+    unsigned int first_draw;
+    unsigned int num_draws;
+    bool src_attrib : 1;
+    bool mask_attrib : 1;
+    bool emitted : 1;
+};
+
 struct tegra_3d_state {
     struct tegra_exa *exa;
     struct tegra_exa_scratch *scratch;
@@ -195,11 +226,79 @@ struct tegra_3d_state {
     bool submitted : 1;
     bool inited : 1;
     bool clean : 1;
+    bool scissor_dirty : 1;
+
+    /*
+     * Fields above are zeroed on reset, only the used slots of the
+     * arrays below are cleared, see tegra_exa_3d_state_reset().
+     */
+
+    /* composite rects queued for the current operation */
+    struct tegra_3d_rect rects[TEGRA_3D_MAX_QUEUED_RECTS];
+    unsigned int num_rects;
+
+    /* draw calls of the current operation */
+    struct tegra_3d_draw draws[TEGRA_3D_MAX_DRAWS];
+    unsigned int num_draws;
+
+    /* finalized operations, emitted to cmdstream on submission */
+    struct tegra_3d_op ops[TEGRA_3D_MAX_QUEUED_OPS];
+    unsigned int num_ops;
+
+    struct tegra_3d_draw queued_draws[TEGRA_3D_MAX_QUEUED_DRAWS];
+    unsigned int num_queued_draws;
 
     /* (textures + render targets) minus one buffer for vertex attributes */
     struct tegra_pixmap_3d_state pixmaps[DRM_TEGRA_BO_TABLE_MAX_ENTRIES_NUM - 1];
 };
 
+#define TEGRA_2D_MAX_QUEUED_OPS     64
+#define TEGRA_2D_MAX_QUEUED_RECTS   512
+#define TEGRA_ROTATE_MAX_BOXES      32
+
+struct tegra_2d_rect {
+    int src_x, src_y;
+    int dst_x, dst_y;
+    int width, height;
+};
+
+struct tegra_2d_op {
+    PixmapPtr dst;
+    PixmapPtr src;              /* NULL for solid-fill */
+    Pixel color;
+    Pixel xor_color;            /* color of the planemask GXxor pass */
+    bool xor_pass;
+    int rop;
+    unsigned int first_rect;
+    unsigned int num_rects;
+    struct tegra_fence *wait_fence; /* 3d job the operation depends on */
+};
+
+struct tegra_pixmap_2d_state {
+    struct tegra_pixmap *pixmap;
+    unsigned int refcnt;
+    bool written : 1;           /* written by GR2D since last sync */
+    bool write : 1;
+    bool read : 1;
+};
+
+struct tegra_2d_state {
+    struct tegra_exa *exa;
+    struct tegra_fence *explicit_fence;
+    bool recording : 1;
+
+    /* finalized operations, the recorded operation follows them */
+    struct tegra_2d_op ops[TEGRA_2D_MAX_QUEUED_OPS];
+    unsigned int num_ops;
+
+    struct tegra_2d_rect rects[TEGRA_2D_MAX_QUEUED_RECTS];
+    unsigned int num_rects;
+
+    /* each pixmap takes at most one entry of the job's BO table */
+    struct tegra_pixmap_2d_state pixmaps[DRM_TEGRA_BO_TABLE_MAX_ENTRIES_NUM];
+    unsigned int num_pixmaps;
+};
+
 struct tegra_attrib_bo {
     struct drm_tegra_bo *bo;
     __fp16 *map;
@@ -220,6 +319,14 @@ enum tegra_2d_composite_op {
     TEGRA2D_NONE,
     TEGRA2D_SOLID,
     TEGRA2D_COPY,
+    TEGRA2D_COPY_TRANSLATE,
+};
+
+enum tegra_transform_type {
+    TEGRA_TRANSFORM_IDENTITY,
+    TEGRA_TRANSFORM_TRANSLATE,
+    TEGRA_TRANSFORM_SCALE,
+    TEGRA_TRANSFORM_GENERAL,
 };
 
 struct tegra_exa_scratch {
@@ -236,6 +343,10 @@ struct tegra_exa_scratch {
             PictTransform transform_mask_inv;
         };
     };
+    enum tegra_transform_type transform_src_type;
+    enum tegra_transform_type transform_src_inv_type;
+    enum tegra_transform_type transform_mask_type;
+    enum tegra_transform_type transform_mask_inv_type;
     struct drm_tegra *drm;
     unsigned attrib_offset;
     unsigned attrib_itr;
@@ -247,16 +358,44 @@ struct tegra_exa_scratch {
     PixmapPtr src;
     unsigned ops;
     Pixel color;
+    Pixel xor_color;            /* second pass of the planemasked fill */
+    bool xor_pass;
+    bool read_dst;              /* raster operation reads destination */
+    Pixel planemask;            /* partial planemask of the copy */
+    PixmapPtr planemask_tmp;    /* intermediate of the planemasked copy */
+    int rop;
+    uint32_t dst_bands;         /* bands of destination accessed by operation */
+    uint32_t src_bands;         /* bands of source read by operation */
+    int translate_x;            /* integer translation of composite source */
+    int translate_y;
+    bool clear_2d;              /* out-of-bounds source area being cleared */
+    bool tiles_fill;            /* copy from solid tiles turned into a fill */
+    Pixel tiles_fill_color;
     int src_x;
     int src_y;
     int dst_x;
     int dst_y;
+    int written_x0;             /* area written by GR2D since last sync */
+    int written_y0;
+    int written_x1;
+    int written_y1;
+    bool batched;               /* operation is recorded into exa->gr2d_state */
+    bool mask_atlas;
+    int mask_atlas_x;
+    int mask_atlas_y;
+    int mask_atlas_width;
+    int mask_atlas_height;
 };
 
 struct tegra_pixmap_pool {
     struct drm_tegra_bo *bo;
     struct xorg_list entry;
     struct mem_pool pool;
+    void *window;
+    void *window_retired;
+    unsigned long window_size;
+    unsigned long window_retired_size;
+    unsigned int window_users;
     bool heavy : 1;
     bool light : 1;
     bool persistent : 1;
@@ -267,9 +406,33 @@ enum {
     TEGRA_OPT_SOLID,
     TEGRA_OPT_COPY,
     TEGRA_OPT_3D,
+    TEGRA_OPT_2D,
+    TEGRA_OPT_CLEAR,
     TEGRA_OPT_NUM,
 };
 
+enum {
+    TEGRA_GLYPH_ATLAS_A8,
+    TEGRA_GLYPH_ATLAS_ARGB,
+    TEGRA_GLYPH_ATLAS_NUM,
+};
+
+struct tegra_glyph_atlas_shelf {
+    uint16_t x;
+    uint16_t y;
+    uint16_t height;
+};
+
+struct tegra_glyph_atlas {
+    PixmapPtr pixmap;
+    unsigned int generation;
+    unsigned int num_shelves;
+    unsigned int next_y;
+    bool broken;
+
+    struct tegra_glyph_atlas_shelf shelves[256];
+};
+
 struct tegra_optimization_state {
     struct tegra_stream *cmds_tmp;
     struct tegra_stream *cmds;
@@ -287,10 +450,21 @@ struct tegra_exa_stats {
     uint64_t num_pixmaps_allocations_bo_bytes;
     uint64_t num_pixmaps_allocations_bo_reused;
     uint64_t num_pixmaps_allocations_bo_reused_bytes;
+    uint64_t num_pixmaps_allocations_freelist;
+    uint64_t num_pixmaps_allocations_freelist_bytes;
     uint64_t num_pixmaps_allocations_pool;
     uint64_t num_pixmaps_allocations_pool_bytes;
     uint64_t num_pixmaps_allocations_fallback;
     uint64_t num_pixmaps_allocations_fallback_bytes;
+    uint64_t num_arena_slabs_allocated;
+    uint64_t num_arena_slabs_released;
+    uint64_t num_arena_purged_bytes;
+    uint64_t num_pixmaps_allocations_tiled;
+    uint64_t num_pixmaps_detiled;
+    uint64_t num_pixmaps_detiled_bytes;
+    uint64_t num_detiled_copies;
+    uint64_t num_detiled_copies_bytes;
+    uint64_t num_detiled_copies_hits;
     uint64_t num_pixmaps_resurrected;
     uint64_t num_pixmaps_resurrected_bytes;
     uint64_t num_pixmaps_compressed;
@@ -306,15 +480,115 @@ struct tegra_exa_stats {
     uint64_t num_screen_uploaded_bytes;
     uint64_t num_screen_downloads;
     uint64_t num_screen_downloaded_bytes;
+    uint64_t num_readback_prefetches;
+    uint64_t num_readback_prefetched_bytes;
+    uint64_t num_readback_hits;
     uint64_t num_2d_copy_jobs;
     uint64_t num_2d_copy_jobs_bytes;
     uint64_t num_2d_copy_jobs_to_scanout;
+    uint64_t num_2d_rotate_boxes;
+    uint64_t num_2d_rotate_boxes_merged;
+    uint64_t num_2d_rotate_boxes_skipped;
+    uint64_t num_2d_rotate_blits;
     uint64_t num_2d_solid_jobs;
     uint64_t num_2d_solid_jobs_bytes;
+    uint64_t num_2d_rop_ops;
+    uint64_t num_2d_two_pass_fills;
+    uint64_t num_2d_planemask_copies;
+    uint64_t num_2d_solid_tiles_fills_skipped;
+    uint64_t num_2d_solid_tiles_copies_skipped;
+    uint64_t num_2d_solid_tiles_copies_filled;
+    uint64_t num_2d_batched_ops;
+    uint64_t num_hw_fence_waits;
+    uint64_t num_cpu_fence_waits;
+    uint64_t num_cpu_fence_waits_skipped;
+    uint64_t num_2d_batched_jobs;
+    uint64_t num_2d_batched_jobs_bytes;
     uint64_t num_3d_jobs;
     uint64_t num_3d_jobs_bytes;
+    uint64_t num_3d_merged_rects;
+    uint64_t num_3d_scissored_rects;
+    uint64_t num_3d_fast_transformed_rects;
+    uint64_t num_3d_general_transformed_rects;
+    uint64_t num_3d_reordered_ops;
+    uint64_t num_3d_split_ops;
     uint64_t num_cpu_read_accesses;
     uint64_t num_cpu_write_accesses;
+    uint64_t num_cpu_copy_on_writes;
+    uint64_t num_cpu_copy_on_writes_bytes;
+    uint64_t num_cpu_shadow_accesses;
+    uint64_t num_cpu_shadow_writeback_bytes;
+    uint64_t num_glyph_atlas_hits;
+    uint64_t num_glyph_atlas_uploads;
+    uint64_t num_glyph_atlas_upload_bytes;
+    uint64_t num_glyph_atlas_resets;
+    uint64_t num_cost_cpu_choices;
+    uint64_t num_cost_2d_choices;
+    uint64_t num_cost_3d_choices;
+};
+
+/* endpoint of a standalone GR2D copy, pixmap's data or a bare BO */
+struct tegra_2d_surface {
+    struct drm_tegra_bo *bo;
+    uint32_t offset;
+    unsigned int pitch;
+    bool tiled;
+    bool pool;                  /* BO is shared by the pool's pixmaps */
+};
+
+/* copy of the repeatedly downloaded pixmap area, made ahead of time */
+struct tegra_readback {
+    struct tegra_pixmap *pixmap;
+    struct drm_tegra_bo *bo;
+    void *map;
+    unsigned int size;
+    unsigned int pitch;
+    struct tegra_fence *fence;  /* GR2D job that writes the readback data */
+    unsigned write_gen;         /* pixmap's generation of the readback data */
+    unsigned int hits;          /* number of downloads of the same area */
+    bool valid;                 /* BO contains the pixmap's area */
+    bool armed;                 /* area was downloaded since last prefetch */
+    int x, y, width, height;
+    int pix_width, pix_height;  /* pixmap's size at the time of tracking */
+    struct drm_tegra_bo *pix_bo; /* pixmap's storage at the time of prefetch */
+    unsigned long pix_offset;
+};
+
+#define TEGRA_DETILED_COPIES_NUM                2
+
+/* planemasked copy goes via intermediate pixmap in chunks of this size */
+#define TEGRA_PLANEMASK_TMP_SIZE                256
+
+/* linear copy of a tiled pixmap, GR3D samples it instead of the pixmap */
+struct tegra_detiled_copy {
+    struct tegra_pixmap *pixmap;    /* tiled source */
+    PixmapPtr copy;
+    unsigned write_gen;             /* source's generation of the copy data */
+    unsigned int last_use;
+};
+
+/* estimated latencies of the engines, calibrated at startup */
+struct tegra_exa_cost_model {
+    uint32_t cpu_ns_per_kb;             /* cached sysmem */
+    uint32_t cpu_wc_ns_per_kb;          /* write-combined DRM BO */
+    uint32_t cpu_map_ns;
+    uint32_t job_ns[TEGRA_ENGINES_NUM]; /* job submission and completion */
+    uint32_t ns_per_kb[TEGRA_ENGINES_NUM];
+    uint32_t sync_ns;                   /* waiting for the other engine */
+    unsigned int queued_jobs[TEGRA_ENGINES_NUM];
+    struct tegra_fence *last_fence[TEGRA_ENGINES_NUM];
+    bool calibrated;
+};
+
+#define TEGRA_ARENA_CLASSES     16
+
+#define TEGRA_FREELIST_BINS     32
+
+struct tegra_arena_slab;
+
+struct tegra_arena_class {
+    struct xorg_list partial;           /* slabs having free objects */
+    struct tegra_arena_slab *empty;     /* cached empty slab */
 };
 
 struct tegra_exa {
@@ -339,6 +613,8 @@ struct tegra_exa {
     tjhandle jpegDecompressor;
 #endif
 
+    struct tegra_arena_class arena[TEGRA_ARENA_CLASSES];
+
     unsigned release_count;
     unsigned long default_drm_bo_flags;
 
@@ -346,9 +622,19 @@ struct tegra_exa {
     ScreenBlockHandlerProcPtr block_handler;
     DestroyPixmapProcPtr destroy_pixmap;
 
-    struct xorg_list pixmaps_freelist;
+    /* BO and pool pixmaps, binned by size and ordered by insertion time */
+    struct xorg_list pixmaps_freelist[2][TEGRA_FREELIST_BINS];
+    unsigned long pixmaps_freelist_size;
 
+    struct tegra_2d_state gr2d_state;
+    BoxRec rotate_boxes[TEGRA_ROTATE_MAX_BOXES];
+    unsigned int num_rotate_boxes;
     struct tegra_3d_state gr3d_state;
+    struct tegra_glyph_atlas glyph_atlas[TEGRA_GLYPH_ATLAS_NUM];
+    struct tegra_readback readback;
+    struct tegra_detiled_copy detiled[TEGRA_DETILED_COPIES_NUM];
+    unsigned int detiled_use;
+    PixmapPtr planemask_tmp;
 
     bool has_iommu_bug;
     bool has_iommu;
@@ -358,6 +644,7 @@ struct tegra_exa {
     bool in_2d_flush;
 
     struct tegra_exa_stats stats;
+    struct tegra_exa_cost_model cost;
 
     struct _TegraRec *tegra;
     bool prefer_sparse_bo_alloc;
@@ -373,6 +660,16 @@ struct tegra_exa {
 #define TEGRA_EXA_COMPRESSION_JPEG              3
 #define TEGRA_EXA_COMPRESSION_PNG               4
 
+#define TEGRA_SOLID_TILES_DIM                   8
+
+#define TEGRA_FENCE_BANDS                       32
+#define TEGRA_FENCE_BANDS_ALL                   0xffffffffU
+
+struct tegra_solid_tiles {
+    uint64_t solid;             /* tile is completely filled with a solid color */
+    Pixel color[TEGRA_SOLID_TILES_DIM * TEGRA_SOLID_TILES_DIM];
+};
+
 struct tegra_pixmap_upload_buffer {
     unsigned int refcount;
     void *data;
@@ -391,6 +688,8 @@ struct tegra_pixmap {
     bool accel : 1;             /* pixmap acceleratable */
     bool cold : 1;              /* pixmap scheduled for compression */
     bool dri : 1;               /* pixmap's BO was exported */
+    bool tiled : 1;             /* pixmap's data is in 16x16 tiled layout */
+    bool no_tiling : 1;         /* pixmap's data shall be linear */
 
     unsigned crtc : 1;          /* pixmap's CRTC ID (for display rotation) */
 
@@ -403,8 +702,26 @@ struct tegra_pixmap {
         bool solid_fill : 1;    /* whole pixmap is filled with a solid color */
 
         Pixel solid_color;
+
+        struct tegra_solid_tiles *tiles;
     } state;
 
+    unsigned glyph_atlas_gen;   /* pixmap's data is cached in glyph atlas if matches atlas generation */
+    unsigned write_gen;         /* incremented on each write to pixmap's data */
+
+    /*
+     * Horizontal bands of pixmap accessed by the incomplete jobs of
+     * each engine, valid while the corresponding fence is set.
+     */
+    uint32_t bands_write[TEGRA_ENGINES_NUM];
+    uint32_t bands_read[TEGRA_ENGINES_NUM];
+
+    uint16_t glyph_atlas_x;
+    uint16_t glyph_atlas_y;
+
+    void *shadow;               /* cached copy of data given to CPU fallback */
+    void *shadow_map;           /* mapping of pixmap's data backing the shadow */
+
     union {
         struct {
             union {
@@ -424,7 +741,10 @@ struct tegra_pixmap {
             time_t last_use; /* in seconds */
             union {
                 struct xorg_list fridge_entry;
-                struct xorg_list freelist_entry;
+                struct {
+                    struct xorg_list freelist_entry;
+                    unsigned freelist_size;
+                };
             };
         };
 
@@ -433,6 +753,7 @@ struct tegra_pixmap {
             unsigned compressed_size;
             unsigned compression_type;
             unsigned compression_fmt;
+            bool compressed_565;    /* data was expanded to 32bpp for compression */
         };
     };
 
@@ -493,6 +814,13 @@ tegra_exa_stream_submit(struct tegra_exa *tegra, enum host1x_engine engine,
     else
         out_fence = tegra_stream_submit(engine, tegra->cmds, explicit_fence);
 
+    /* track engine's queue depth for the cost model */
+    if (out_fence) {
+        TEGRA_FENCE_PUT(tegra->cost.last_fence[engine]);
+        tegra->cost.last_fence[engine] = TEGRA_FENCE_GET(out_fence, NULL);
+        tegra->cost.queued_jobs[engine]++;
+    }
+
     DEBUG_MSG("engine %u explicit_fence %p out_fence %p\n",
               engine, explicit_fence, out_fence);
 
@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define DISABLE_GLYPH_ATLAS                 false
+
+#define TEGRA_GLYPH_ATLAS_MAX_GLYPH_SIZE    64
+#define TEGRA_GLYPH_ATLAS_PADDING           1
+
+/*
+ * Text rendering results in a lot of tiny composite operations, each
+ * using a separate glyph pixmap for the mask. Every glyph then takes
+ * a texture re-binding and occupies a slot in the deferred 3d job's
+ * table of BOs, which quickly runs out and forces the job's submission.
+ *
+ * Glyph atlas is a large pixmap into which glyphs are copied by GR2D on
+ * first use, the composite operation then samples mask from the atlas
+ * and thus the whole string is drawn using a single mask texture.
+ *
+ * Atlas is packed into horizontal shelves. Atlas is wiped out entirely
+ * once it's full, the generation number invalidates all cached glyphs.
+ */
+
+static bool tegra_exa_glyph_atlas_create(ScreenPtr screen,
+                                         struct tegra_glyph_atlas *atlas,
+                                         unsigned int size,
+                                         unsigned int depth)
+{
+    struct tegra_pixmap *priv;
+    PixmapPtr pixmap;
+
+    pixmap = screen->CreatePixmap(screen, size, size, depth, 0);
+    if (!pixmap)
+        goto fail;
+
+    /* atlas is sampled by GR3D, which needs linear data */
+    priv = exaGetPixmapDriverPrivate(pixmap);
+    priv->no_tiling = true;
+
+    tegra_exa_thaw_pixmap2(pixmap, THAW_ACCEL, THAW_ALLOC);
+
+    if (priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK) {
+        screen->DestroyPixmap(pixmap);
+        goto fail;
+    }
+
+    tegra_exa_detile_pixmap(pixmap);
+
+    /* atlas shall never be compressed by the fridge */
+    priv->freezer_lockcnt++;
+
+    atlas->pixmap = pixmap;
+    atlas->num_shelves = 0;
+    atlas->next_y = 0;
+
+    if (++atlas->generation == 0)
+        atlas->generation = 1;
+
+    DEBUG_MSG("created %ux%u:%u glyph atlas %p\n", size, size, depth, pixmap);
+
+    return true;
+
+fail:
+    ERROR_MSG("failed to create %ux%u:%u glyph atlas\n", size, size, depth);
+
+    /* don't try again */
+    atlas->broken = true;
+
+    return false;
+}
+
+static void tegra_exa_glyph_atlas_reset(struct tegra_exa *tegra,
+                                        struct tegra_glyph_atlas *atlas)
+{
+    struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(atlas->pixmap);
+
+    DEBUG_MSG("atlas %p is full, resetting\n", atlas->pixmap);
+
+    /*
+     * Old glyphs may be still in use by a deferred 3d job or by a job
+     * that is in-flight, they are going to be overwritten now.
+     */
+    tegra_exa_flush_deferred_operations(atlas->pixmap, true, true, false);
+    TEGRA_PIXMAP_WAIT_READ_FENCES(priv);
+
+    atlas->num_shelves = 0;
+    atlas->next_y = 0;
+
+    if (++atlas->generation == 0)
+        atlas->generation = 1;
+
+    tegra->stats.num_glyph_atlas_resets++;
+}
+
+static bool tegra_exa_glyph_atlas_alloc(struct tegra_glyph_atlas *atlas,
+                                        unsigned int width,
+                                        unsigned int height,
+                                        unsigned int *x, unsigned int *y)
+{
+    unsigned int atlas_height = atlas->pixmap->drawable.height;
+    unsigned int atlas_width = atlas->pixmap->drawable.width;
+    struct tegra_glyph_atlas_shelf *shelf, *best = NULL;
+    unsigned int i;
+
+    width  += TEGRA_GLYPH_ATLAS_PADDING;
+    height += TEGRA_GLYPH_ATLAS_PADDING;
+
+    /* pick the lowest shelf that fits the glyph */
+    for (i = 0; i < atlas->num_shelves; i++) {
+        shelf = &atlas->shelves[i];
+
+        if (shelf->height < height || shelf->x + width > atlas_width)
+            continue;
+
+        if (!best || shelf->height < best->height)
+            best = shelf;
+    }
+
+    /* don't waste space of a too tall shelf if there is room for a new one */
+    height = TEGRA_ALIGN(height, 4);
+
+    if (best && best->height > height * 3 / 2 &&
+        atlas->num_shelves < TEGRA_ARRAY_SIZE(atlas->shelves) &&
+        atlas->next_y + height <= atlas_height)
+        best = NULL;
+
+    if (!best) {
+        if (atlas->num_shelves == TEGRA_ARRAY_SIZE(atlas->shelves))
+            return false;
+
+        if (atlas->next_y + height > atlas_height)
+            return false;
+
+        best = &atlas->shelves[atlas->num_shelves++];
+        best->y = atlas->next_y;
+        best->height = height;
+        best->x = 0;
+
+        atlas->next_y += height;
+    }
+
+    *x = best->x;
+    *y = best->y;
+
+    best->x += width;
+
+    return true;
+}
+
+static bool tegra_exa_glyph_atlas_upload(struct tegra_exa *tegra,
+                                         struct tegra_glyph_atlas *atlas,
+                                         PixmapPtr glyph,
+                                         unsigned int x, unsigned int y)
+{
+    struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(glyph);
+    unsigned int height = glyph->drawable.height;
+    unsigned int width = glyph->drawable.width;
+    unsigned int bpp = glyph->drawable.bitsPerPixel;
+    PixmapPtr pixmap = atlas->pixmap;
+    struct tegra_2d_surface dst, src;
+    struct tegra_fence *explicit_fence;
+    struct tegra_fence *fence;
+    int err;
+
+    tegra_exa_thaw_pixmap2(glyph, THAW_ACCEL, THAW_ALLOC);
+
+    if (priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK)
+        return false;
+
+    /*
+     * Glyph's data must be up-to-date and glyph's fences must belong to
+     * submitted jobs, hence flush out everything related to the glyph.
+     */
+    tegra_exa_flush_deferred_operations(glyph, true, true, true);
+
+    /* atlas is written directly, bypassing the solid tiles tracking */
+    tegra_exa_solid_tiles_invalidate(exaGetPixmapDriverPrivate(pixmap));
+
+    err = tegra_stream_begin(tegra->cmds, tegra->gr2d);
+    if (err < 0)
+        return false;
+
+    tegra_exa_2d_surface_from_pixmap(pixmap, &dst);
+    tegra_exa_2d_surface_from_pixmap(glyph, &src);
+
+    tegra_exa_copy_2d_emit_blit(tegra->cmds, bpp, &dst, x, y, &src, 0, 0,
+                                width, height);
+
+    if (tegra->cmds->status != TEGRADRM_STREAM_CONSTRUCT) {
+        tegra_stream_cleanup(tegra->cmds);
+        return false;
+    }
+
+    tegra->stats.num_glyph_atlas_upload_bytes += tegra_stream_pushbuf_size(tegra->cmds);
+    tegra_stream_end(tegra->cmds);
+
+    /*
+     * The atlas area is unused, hence there is no need to wait for the
+     * atlas readers. Note that atlas may be in the deferred 3d state and
+     * its fences may belong to a job that isn't submitted yet.
+     */
+    tegra_exa_wait_pixmaps(TEGRA_3D, glyph, 0);
+
+    explicit_fence = tegra_exa_get_explicit_fence(TEGRA_3D, glyph, 0);
+    fence = tegra_exa_stream_submit(tegra, TEGRA_2D, explicit_fence);
+    TEGRA_FENCE_PUT(explicit_fence);
+
+    tegra_exa_replace_pixmaps_fence(TEGRA_2D, fence, &tegra->scratch, 0, 0,
+                                    pixmap, 1, glyph);
+
+    tegra->stats.num_glyph_atlas_uploads++;
+
+    return true;
+}
+
+static PixmapPtr tegra_exa_glyph_atlas_lookup(struct tegra_exa *tegra,
+                                              int op,
+                                              PicturePtr mask_picture,
+                                              PixmapPtr pmask,
+                                              unsigned int *x,
+                                              unsigned int *y)
+{
+    ScreenPtr screen;
+    struct tegra_glyph_atlas *atlas;
+    struct tegra_pixmap *priv;
+    unsigned int width, height;
+
+    if (DISABLE_GLYPH_ATLAS)
+        return NULL;
+
+    if (!mask_picture || !mask_picture->pDrawable || !pmask)
+        return NULL;
+
+    /*
+     * Atlas area that is outside of the glyph belongs to other glyphs,
+     * hence the drawing area is clipped to the glyph and this works only
+     * if operation doesn't touch the clipped area.
+     */
+    if (op >= TEGRA_ARRAY_SIZE(composite_cfgs) ||
+        !composite_cfgs[op].discards_clipped_area)
+        return NULL;
+
+    if (mask_picture->repeat || mask_picture->transform ||
+        mask_picture->alphaMap || mask_picture->filter == PictFilterBilinear)
+        return NULL;
+
+    width  = pmask->drawable.width;
+    height = pmask->drawable.height;
+
+    if (width  > TEGRA_GLYPH_ATLAS_MAX_GLYPH_SIZE ||
+        height > TEGRA_GLYPH_ATLAS_MAX_GLYPH_SIZE)
+        return NULL;
+
+    switch (pmask->drawable.bitsPerPixel) {
+    case 8:
+        atlas = &tegra->glyph_atlas[TEGRA_GLYPH_ATLAS_A8];
+        break;
+    case 32:
+        atlas = &tegra->glyph_atlas[TEGRA_GLYPH_ATLAS_ARGB];
+        break;
+    default:
+        return NULL;
+    }
+
+    if (atlas->broken)
+        return NULL;
+
+    priv = exaGetPixmapDriverPrivate(pmask);
+
+    if (priv->scanout || priv->state.solid_fill)
+        return NULL;
+
+    if (tegra_exa_texture_optimized_out(mask_picture, pmask,
+                                        &composite_cfgs[op]))
+        return NULL;
+
+    if (atlas->pixmap && priv->glyph_atlas_gen == atlas->generation)
+        goto hit;
+
+    screen = pmask->drawable.pScreen;
+
+    if (!atlas->pixmap) {
+        if (atlas == &tegra->glyph_atlas[TEGRA_GLYPH_ATLAS_A8]) {
+            if (!tegra_exa_glyph_atlas_create(screen, atlas, 1024, 8))
+                return NULL;
+        } else {
+            if (!tegra_exa_glyph_atlas_create(screen, atlas, 512, 32))
+                return NULL;
+        }
+    }
+
+    if (!tegra_exa_glyph_atlas_alloc(atlas, width, height, x, y)) {
+        tegra_exa_glyph_atlas_reset(tegra, atlas);
+
+        if (!tegra_exa_glyph_atlas_alloc(atlas, width, height, x, y))
+            return NULL;
+    }
+
+    if (!tegra_exa_glyph_atlas_upload(tegra, atlas, pmask, *x, *y))
+        return NULL;
+
+    priv->glyph_atlas_gen = atlas->generation;
+    priv->glyph_atlas_x = *x;
+    priv->glyph_atlas_y = *y;
+
+    return atlas->pixmap;
+
+hit:
+    *x = priv->glyph_atlas_x;
+    *y = priv->glyph_atlas_y;
+
+    tegra->stats.num_glyph_atlas_hits++;
+
+    return atlas->pixmap;
+}
+
+static void tegra_exa_glyph_atlas_invalidate(struct tegra_pixmap *pixmap)
+{
+    pixmap->glyph_atlas_gen = 0;
+}
+
+static void tegra_exa_release_glyph_atlas(ScreenPtr screen,
+                                          struct tegra_exa *tegra)
+{
+    struct tegra_glyph_atlas *atlas;
+    struct tegra_pixmap *priv;
+    unsigned int i;
+
+    for (i = 0; i < TEGRA_GLYPH_ATLAS_NUM; i++) {
+        atlas = &tegra->glyph_atlas[i];
+
+        if (!atlas->pixmap)
+            continue;
+
+        priv = exaGetPixmapDriverPrivate(atlas->pixmap);
+        priv->freezer_lockcnt--;
+
+        screen->DestroyPixmap(atlas->pixmap);
+        atlas->pixmap = NULL;
+    }
+}
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -61,23 +61,73 @@ static bool tegra_exa_simple_transform_scale(PictTransformPtr t)
     return true;
 }
 
-static void tegra_exa_apply_transform(PictTransformPtr t,
-                                      struct tegra_box *in,
-                                      struct tegra_box *out_transformed)
+/*
+ * Transformation is classified once per composite operation, which allows
+ * to skip the generic 3d point transformation for each rect corner in the
+ * common cases of a translation or scaling.
+ */
+static enum tegra_transform_type tegra_exa_transform_type(PictTransformPtr t)
+{
+    if (!t)
+        return TEGRA_TRANSFORM_IDENTITY;
+
+    if (t->matrix[2][0] || t->matrix[2][1] ||
+        t->matrix[2][2] != pixman_fixed_1 ||
+        t->matrix[0][1] || t->matrix[1][0])
+        return TEGRA_TRANSFORM_GENERAL;
+
+    if (t->matrix[0][0] == pixman_fixed_1 &&
+        t->matrix[1][1] == pixman_fixed_1) {
+        if (!t->matrix[0][2] && !t->matrix[1][2])
+            return TEGRA_TRANSFORM_IDENTITY;
+
+        if (!pixman_fixed_frac(t->matrix[0][2]) &&
+            !pixman_fixed_frac(t->matrix[1][2]))
+            return TEGRA_TRANSFORM_TRANSLATE;
+    }
+
+    return TEGRA_TRANSFORM_SCALE;
+}
+
+static void tegra_exa_transform_box(PictTransformPtr t,
+                                    enum tegra_transform_type type,
+                                    struct tegra_box *in,
+                                    struct tegra_box *out)
 {
     PictVector v;
 
-    if (t) {
-        ACCEL_MSG("orig: %d:%d  %d:%d\n", in->x0, in->y0, in->x1, in->y1);
+    switch (type) {
+    case TEGRA_TRANSFORM_IDENTITY:
+        *out = *in;
+        break;
+
+    case TEGRA_TRANSFORM_TRANSLATE:
+        out->x0 = in->x0 + pixman_fixed_to_int(t->matrix[0][2]);
+        out->y0 = in->y0 + pixman_fixed_to_int(t->matrix[1][2]);
+        out->x1 = in->x1 + pixman_fixed_to_int(t->matrix[0][2]);
+        out->y1 = in->y1 + pixman_fixed_to_int(t->matrix[1][2]);
+        break;
 
+    /*
+     * Result is identical to PictureTransformPoint3d() since coordinates are
+     * integers and the rounding term is discarded by the fixed-point
+     * conversion. All four coordinates are transformed at once by NEON.
+     */
+    case TEGRA_TRANSFORM_SCALE:
+        tegra_transform_scale_boxes(&out->x0, &in->x0, 1,
+                                    t->matrix[0][0], t->matrix[1][1],
+                                    t->matrix[0][2], t->matrix[1][2]);
+        break;
+
+    case TEGRA_TRANSFORM_GENERAL:
         v.vector[0] = pixman_int_to_fixed(in->x0);
         v.vector[1] = pixman_int_to_fixed(in->y0);
         v.vector[2] = pixman_int_to_fixed(1);
 
         PictureTransformPoint3d(t, &v);
 
-        out_transformed->x0 = pixman_fixed_to_int(v.vector[0]);
-        out_transformed->y0 = pixman_fixed_to_int(v.vector[1]);
+        out->x0 = pixman_fixed_to_int(v.vector[0]);
+        out->y0 = pixman_fixed_to_int(v.vector[1]);
 
         v.vector[0] = pixman_int_to_fixed(in->x1);
         v.vector[1] = pixman_int_to_fixed(in->y1);
@@ -85,20 +135,31 @@ static void tegra_exa_apply_transform(PictTransformPtr t,
 
         PictureTransformPoint3d(t, &v);
 
-        out_transformed->x1 = pixman_fixed_to_int(v.vector[0]);
-        out_transformed->y1 = pixman_fixed_to_int(v.vector[1]);
+        out->x1 = pixman_fixed_to_int(v.vector[0]);
+        out->y1 = pixman_fixed_to_int(v.vector[1]);
+        break;
+    }
+}
 
+static void tegra_exa_apply_transform(PictTransformPtr t,
+                                      enum tegra_transform_type type,
+                                      struct tegra_box *in,
+                                      struct tegra_box *out_transformed)
+{
+    if (!t)
+        type = TEGRA_TRANSFORM_IDENTITY;
+
+    if (type != TEGRA_TRANSFORM_IDENTITY)
+        ACCEL_MSG("orig: %d:%d  %d:%d\n", in->x0, in->y0, in->x1, in->y1);
+
+    tegra_exa_transform_box(t, type, in, out_transformed);
+
+    if (type != TEGRA_TRANSFORM_IDENTITY)
         ACCEL_MSG("transformed: %d:%d  %d:%d\n",
                   out_transformed->x0,
                   out_transformed->y0,
                   out_transformed->x1,
                   out_transformed->y1);
-    } else {
-        out_transformed->x0 = in->x0;
-        out_transformed->y0 = in->y0;
-        out_transformed->x1 = in->x1;
-        out_transformed->y1 = in->y1;
-    }
 }
 
 static void tegra_exa_clip_to_pixmap_area(PixmapPtr pix,
@@ -130,41 +191,21 @@ static void tegra_exa_clip_to_pixmap_area(PixmapPtr pix,
 }
 
 static void tegra_exa_get_untransformed(PictTransformPtr t_inv,
+                                        enum tegra_transform_type type,
                                         struct tegra_box *in,
                                         struct tegra_box *out_untransformed)
 {
-    PictVector v;
-
-    if (t_inv) {
-        v.vector[0] = pixman_int_to_fixed(in->x0);
-        v.vector[1] = pixman_int_to_fixed(in->y0);
-        v.vector[2] = pixman_int_to_fixed(1);
-
-        PictureTransformPoint3d(t_inv, &v);
-
-        out_untransformed->x0 = pixman_fixed_to_int(v.vector[0]);
-        out_untransformed->y0 = pixman_fixed_to_int(v.vector[1]);
-
-        v.vector[0] = pixman_int_to_fixed(in->x1);
-        v.vector[1] = pixman_int_to_fixed(in->y1);
-        v.vector[2] = pixman_int_to_fixed(1);
+    if (!t_inv)
+        type = TEGRA_TRANSFORM_IDENTITY;
 
-        PictureTransformPoint3d(t_inv, &v);
-
-        out_untransformed->x1 = pixman_fixed_to_int(v.vector[0]);
-        out_untransformed->y1 = pixman_fixed_to_int(v.vector[1]);
+    tegra_exa_transform_box(t_inv, type, in, out_untransformed);
 
+    if (type != TEGRA_TRANSFORM_IDENTITY)
         ACCEL_MSG("untransformed: %d:%d  %d:%d\n",
                   out_untransformed->x0,
                   out_untransformed->y0,
                   out_untransformed->x1,
                   out_untransformed->y1);
-    } else {
-        out_untransformed->x0 = in->x0;
-        out_untransformed->y0 = in->y0;
-        out_untransformed->x1 = in->x1;
-        out_untransformed->y1 = in->y1;
-    }
 }
 
 static void tegra_exa_apply_clip(struct tegra_box *in_out,
@@ -190,11 +231,39 @@ static inline bool tegra_exa_is_degenerate(struct tegra_box *b)
     return (b->x0 >= b->x1 || b->y0 >= b->y1);
 }
 
+/*
+ * Job of the current stream waits for the fence on hardware if stream
+ * supports that, otherwise CPU waits for the fence. The awaited fence is
+ * kept by pixmap in the former case, it's completed by the time the job
+ * completes.
+ */
+static void tegra_exa_wait_fence(struct tegra_exa *exa,
+                                 struct tegra_fence **fence)
+{
+    if (!*fence)
+        return;
+
+    if (TEGRA_FENCE_COMPLETED(*fence)) {
+        TEGRA_FENCE_PUT(*fence);
+        *fence = NULL;
+        return;
+    }
+
+    if (!tegra_stream_wait_fence(exa->cmds, *fence, true)) {
+        exa->stats.num_hw_fence_waits++;
+        return;
+    }
+
+    TEGRA_WAIT_AND_PUT_FENCE(*fence);
+    exa->stats.num_cpu_fence_waits++;
+}
+
 static void
 tegra_exa_wait_pixmaps(enum host1x_engine engine, PixmapPtr dst_pix,
                        int num_src_pixmaps, ...)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(dst_pix->drawable.pScreen);
+    struct tegra_exa *exa = TegraPTR(pScrn)->exa;
     struct tegra_pixmap *priv;
     PixmapPtr pix_arg;
     int drm_ver;
@@ -212,18 +281,91 @@ tegra_exa_wait_pixmaps(enum host1x_engine engine, PixmapPtr dst_pix,
             continue;
 
         priv = exaGetPixmapDriverPrivate(pix_arg);
-        TEGRA_WAIT_AND_PUT_FENCE(priv->fence_write[engine]);
+        tegra_exa_wait_fence(exa, &priv->fence_write[engine]);
     }
     va_end(ap);
 
     priv = exaGetPixmapDriverPrivate(dst_pix);
-    TEGRA_WAIT_AND_PUT_FENCE(priv->fence_write[engine]);
-    TEGRA_WAIT_AND_PUT_FENCE(priv->fence_read[engine]);
+    tegra_exa_wait_fence(exa, &priv->fence_write[engine]);
+    tegra_exa_wait_fence(exa, &priv->fence_read[engine]);
+}
+
+/*
+ * Returns mask of the pixmap's horizontal bands covered by the rows,
+ * fences are tracked per band in order to let CPU access rows that
+ * aren't touched by the incomplete jobs without waiting for them.
+ */
+static uint32_t tegra_exa_pixmap_bands(PixmapPtr pixmap, int y, int height)
+{
+    int band_height = (pixmap->drawable.height + TEGRA_FENCE_BANDS - 1) /
+                            TEGRA_FENCE_BANDS;
+    int y1 = max(y, 0);
+    int y2 = min(y + height, pixmap->drawable.height);
+    unsigned int first, last;
+
+    if (!band_height)
+        return TEGRA_FENCE_BANDS_ALL;
+
+    if (y1 >= y2)
+        return 0;
+
+    first = y1 / band_height;
+    last  = (y2 - 1) / band_height;
+
+    return (TEGRA_FENCE_BANDS_ALL << first) &
+           (TEGRA_FENCE_BANDS_ALL >> (TEGRA_FENCE_BANDS - 1 - last));
+}
+
+/*
+ * Has to be invoked before the pixmap's fence is replaced with the fence
+ * of a new job. Bands of the completed jobs are forgotten once the fence
+ * is put, unknown bands are assumed to cover the whole pixmap.
+ */
+static void tegra_exa_pixmap_add_fence_bands(struct tegra_fence *pixmap_fence,
+                                             uint32_t *pixmap_bands,
+                                             uint32_t bands)
+{
+    if (!bands)
+        bands = TEGRA_FENCE_BANDS_ALL;
+
+    if (pixmap_fence)
+        *pixmap_bands |= bands;
+    else
+        *pixmap_bands = bands;
+}
+
+/*
+ * Waits for the engines' jobs that access the bands, either readers or
+ * writers of pixmap.
+ */
+static void tegra_exa_pixmap_wait_bands(struct tegra_exa *exa,
+                                        struct tegra_pixmap *priv,
+                                        uint32_t bands, bool readers)
+{
+    struct tegra_fence **fences;
+    uint32_t *fence_bands;
+    unsigned int i;
+
+    fences      = readers ? priv->fence_read : priv->fence_write;
+    fence_bands = readers ? priv->bands_read : priv->bands_write;
+
+    for (i = 0; i < TEGRA_ENGINES_NUM; i++) {
+        if (!fences[i])
+            continue;
+
+        if (fence_bands[i] & bands)
+            TEGRA_WAIT_AND_PUT_FENCE(fences[i]);
+        else
+            exa->stats.num_cpu_fence_waits_skipped++;
+    }
 }
 
 static void tegra_exa_replace_pixmaps_fence(enum host1x_engine engine,
                                             struct tegra_fence *fence,
-                                            void *opaque, PixmapPtr dst_pix,
+                                            void *opaque,
+                                            uint32_t dst_bands,
+                                            uint32_t src_bands,
+                                            PixmapPtr dst_pix,
                                             int num_src_pixmaps, ...)
 {
     struct tegra_pixmap *priv;
@@ -232,6 +374,9 @@ static void tegra_exa_replace_pixmaps_fence(enum host1x_engine engine,
 
     priv = exaGetPixmapDriverPrivate(dst_pix);
 
+    tegra_exa_pixmap_add_fence_bands(priv->fence_write[engine],
+                                     &priv->bands_write[engine], dst_bands);
+
     if (priv->fence_write[engine] != fence) {
         TEGRA_FENCE_PUT(priv->fence_write[engine]);
         priv->fence_write[engine] = TEGRA_FENCE_GET(fence, opaque);
@@ -245,6 +390,9 @@ static void tegra_exa_replace_pixmaps_fence(enum host1x_engine engine,
 
         priv = exaGetPixmapDriverPrivate(pix_arg);
 
+        tegra_exa_pixmap_add_fence_bands(priv->fence_read[engine],
+                                         &priv->bands_read[engine], src_bands);
+
         if (priv->fence_read[engine] != fence) {
             TEGRA_FENCE_PUT(priv->fence_read[engine]);
             priv->fence_read[engine] = TEGRA_FENCE_GET(fence, opaque);
@@ -20,36 +20,45 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#define DISABLE_READBACK_PREFETCH   false
+#define TEGRA_READBACK_MIN_HITS     2
+#define TEGRA_READBACK_MAX_SIZE     (16 * 1024 * 1024)
+
 static void
-tegra_exa_select_copy_func(char *dst, const char *src, int line_len,
+tegra_exa_select_copy_func(char *dst, int dst_pitch,
+                           const char *src, int src_pitch,
+                           int line_len, int height,
                            bool download, bool src_cached, bool dst_cached,
-                           tegra_vfp_func *pvfp_func, bool *pvfp_threaded)
+                           tegra_vfp_2d_func *pvfp_func, bool *pvfp_threaded)
 {
-    tegra_vfp_func vfp_func;
+    tegra_vfp_2d_func vfp_func;
     bool vfp_threaded;
     bool vfp_safe;
 
-    vfp_safe = tegra_memcpy_vfp_copy_is_safe(dst, src, line_len);
+    /* all lines share the alignment of the first line */
+    vfp_safe = tegra_memcpy_vfp_copy_is_safe(dst, src, line_len) &&
+               (height == 1 || (TEGRA_ALIGNED(src_pitch, 128) &&
+                                TEGRA_ALIGNED(dst_pitch, 128)));
 
     if (vfp_safe && download && !src_cached) {
         vfp_threaded    = true;
-        vfp_func        = tegra_memcpy_vfp_aligned;
+        vfp_func        = tegra_copy_block_vfp_2_pass_2d;
 
     } else if (vfp_safe && !src_cached && dst_cached) {
         vfp_threaded    = true;
-        vfp_func        = tegra_memcpy_vfp_aligned_dst_cached;
+        vfp_func        = tegra_copy_block_vfp_2d;
 
     } else if (vfp_safe && src_cached && !dst_cached) {
         vfp_threaded    = false;
-        vfp_func        = tegra_memcpy_vfp_aligned_src_cached;
+        vfp_func        = tegra_copy_block_vfp_arm_2d;
 
     } else if (download && !src_cached) {
         vfp_threaded    = true;
-        vfp_func        = tegra_memcpy_vfp_unaligned;
+        vfp_func        = tegra_memcpy_vfp_unaligned_2d;
 
     } else {
         vfp_threaded    = false;
-        vfp_func        = NULL;
+        vfp_func        = tegra_memcpy_2d;
     }
 
     *pvfp_threaded      = vfp_threaded;
@@ -61,7 +70,7 @@ tegra_exa_copy_screen(const char *src, int src_pitch, int height,
                       bool download, bool src_cached, bool dst_cached,
                       char *dst, int dst_pitch, int line_len)
 {
-    tegra_vfp_func vfp_func;
+    tegra_vfp_2d_func vfp_func;
     bool vfp_threaded;
     char pname[128];
 
@@ -78,29 +87,313 @@ tegra_exa_copy_screen(const char *src, int src_pitch, int height,
     PROFILE_SET_NAME(screen_load, pname);
     PROFILE_START(screen_load);
 
-    while (height--) {
-        tegra_exa_select_copy_func(dst, src, line_len,
-                                   download, src_cached, dst_cached,
-                                   &vfp_func, &vfp_threaded);
-
-        if (vfp_func) {
-            if (vfp_threaded)
-                tegra_memcpy_vfp_threaded(dst, src, line_len, vfp_func);
-            else
-                vfp_func(dst, src, line_len);
-        } else {
-            memcpy(dst, src, line_len);
+    /* copying variant is chosen once for the whole area */
+    tegra_exa_select_copy_func(dst, dst_pitch, src, src_pitch,
+                               line_len, height,
+                               download, src_cached, dst_cached,
+                               &vfp_func, &vfp_threaded);
+
+    if (vfp_threaded)
+        tegra_memcpy_vfp_threaded_2d(dst, dst_pitch, src, src_pitch,
+                                     line_len, height, vfp_func);
+    else
+        vfp_func(dst, dst_pitch, src, src_pitch, line_len, height);
+
+    PROFILE_STOP(screen_load);
+
+    return true;
+}
+
+static void tegra_exa_release_readback(struct tegra_exa *exa)
+{
+    struct tegra_readback *rb = &exa->readback;
+
+    TEGRA_WAIT_AND_PUT_FENCE(rb->fence);
+
+    if (rb->bo) {
+        drm_tegra_bo_unmap(rb->bo);
+        drm_tegra_bo_unref(rb->bo);
+        rb->bo = NULL;
+    }
+
+    rb->pixmap = NULL;
+    rb->valid = false;
+}
+
+static void tegra_exa_readback_forget(struct tegra_exa *exa,
+                                      struct tegra_pixmap *priv)
+{
+    struct tegra_readback *rb = &exa->readback;
+
+    if (rb->pixmap == priv) {
+        rb->pixmap = NULL;
+        rb->valid = false;
+        rb->armed = false;
+        rb->hits = 0;
+    }
+}
+
+/*
+ * Pixmap could be resized or moved to a different storage since the area
+ * was recorded, the readback is meaningless then.
+ */
+static bool tegra_exa_readback_stale(struct tegra_readback *rb, PixmapPtr pix)
+{
+    struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(pix);
+
+    if (rb->pix_width != pix->drawable.width ||
+        rb->pix_height != pix->drawable.height)
+        return true;
+
+    if (!rb->valid)
+        return false;
+
+    if (priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK)
+        return true;
+
+    return rb->pix_bo != tegra_exa_pixmap_bo(pix) ||
+           rb->pix_offset != tegra_exa_pixmap_offset(pix);
+}
+
+/* returns false if nothing is left of the area within the pixmap */
+static bool tegra_exa_readback_clip(struct tegra_readback *rb, PixmapPtr pix)
+{
+    int x1 = max(rb->x, 0);
+    int y1 = max(rb->y, 0);
+    int x2 = min(rb->x + rb->width, pix->drawable.width);
+    int y2 = min(rb->y + rb->height, pix->drawable.height);
+
+    if (x2 <= x1 || y2 <= y1)
+        return false;
+
+    rb->x      = x1;
+    rb->y      = y1;
+    rb->width  = x2 - x1;
+    rb->height = y2 - y1;
+
+    return true;
+}
+
+/*
+ * Screenshot and screen recording tools download the same area of the
+ * same pixmap over and over again. Such downloads are tracked and the area
+ * is copied by GR2D into a linear BO from the block handler, the next
+ * download then reads out the already detiled data without waiting for
+ * the pixmap's rendering.
+ */
+static void tegra_exa_readback_track(PixmapPtr pix, int x, int y, int w, int h)
+{
+    struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(pix);
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pix->drawable.pScreen);
+    struct tegra_exa *exa = TegraPTR(pScrn)->exa;
+    struct tegra_readback *rb = &exa->readback;
+
+    if (DISABLE_READBACK_PREFETCH)
+        return;
+
+    /* exported pixmaps are written behind our back */
+    if (priv->dri)
+        return;
+
+    if (rb->pixmap == priv && !tegra_exa_readback_stale(rb, pix) &&
+        rb->x <= x && rb->y <= y &&
+        rb->x + rb->width >= x + w && rb->y + rb->height >= y + h) {
+        rb->hits++;
+    } else {
+        rb->pixmap     = priv;
+        rb->valid      = false;
+        rb->hits       = 1;
+        rb->x          = x;
+        rb->y          = y;
+        rb->width      = w;
+        rb->height     = h;
+        rb->pix_width  = pix->drawable.width;
+        rb->pix_height = pix->drawable.height;
+
+        if (!tegra_exa_readback_clip(rb, pix)) {
+            tegra_exa_readback_forget(exa, priv);
+            return;
         }
+    }
+
+    rb->armed = true;
+}
+
+static bool tegra_exa_download_prefetched(PixmapPtr pix,
+                                          int x, int y, int w, int h,
+                                          char *usr, int usr_pitch)
+{
+    struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(pix);
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pix->drawable.pScreen);
+    struct tegra_exa *exa = TegraPTR(pScrn)->exa;
+    struct tegra_readback *rb = &exa->readback;
+    int cpp = pix->drawable.bitsPerPixel >> 3;
+    char *src;
+
+    if (!rb->valid || rb->pixmap != priv || rb->write_gen != priv->write_gen)
+        return false;
 
-        src += src_pitch;
-        dst += dst_pitch;
+    if (tegra_exa_readback_stale(rb, pix) || !tegra_exa_readback_clip(rb, pix)) {
+        tegra_exa_readback_forget(exa, priv);
+        return false;
     }
 
-    PROFILE_STOP(screen_load);
+    if (rb->x > x || rb->y > y ||
+        rb->x + rb->width < x + w || rb->y + rb->height < y + h)
+        return false;
+
+    /* prefetch is issued ahead of time, usually it's completed by now */
+    TEGRA_WAIT_AND_PUT_FENCE(rb->fence);
+
+    src = (char *)rb->map + (y - rb->y) * rb->pitch + (x - rb->x) * cpp;
+
+    tegra_exa_copy_screen(src, rb->pitch, h, true, false, true,
+                          usr, usr_pitch, w * cpp);
+
+    rb->hits++;
+    rb->armed = true;
+
+    exa->stats.num_readback_hits++;
+
+    ACCEL_MSG("download pixmap %p %d:%d, %dx%d %d:%d prefetched\n",
+              pix, pix->drawable.width, pix->drawable.height, x, y, w, h);
 
     return true;
 }
 
+static void tegra_exa_readback_prefetch(TegraPtr tegra, struct tegra_exa *exa)
+{
+    struct tegra_readback *rb = &exa->readback;
+    struct tegra_pixmap *priv = rb->pixmap;
+    struct tegra_2d_surface dst, src;
+    struct tegra_fence *explicit_fence;
+    struct tegra_fence *fence;
+    unsigned int pitch, size, bpp;
+    PixmapPtr pix;
+    int err;
+
+    if (DISABLE_READBACK_PREFETCH || !priv || !rb->armed)
+        return;
+
+    if (rb->hits < TEGRA_READBACK_MIN_HITS)
+        return;
+
+    /* readback is up to date */
+    if (rb->valid && rb->write_gen == priv->write_gen)
+        return;
+
+    if (priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK || !priv->accel ||
+        priv->frozen || priv->destroyed)
+        return;
+
+    pix   = priv->base;
+    bpp   = pix->drawable.bitsPerPixel;
+
+    if (tegra_exa_readback_stale(rb, pix) || !tegra_exa_readback_clip(rb, pix)) {
+        tegra_exa_readback_forget(exa, priv);
+        return;
+    }
+
+    pitch = tegra_hw_pitch(rb->width, rb->height, bpp);
+    size  = pitch * rb->height;
+
+    if (size > TEGRA_READBACK_MAX_SIZE)
+        return;
+
+    /* BO could be in use by the previous prefetch */
+    TEGRA_WAIT_AND_PUT_FENCE(rb->fence);
+    rb->valid = false;
+
+    if (rb->bo && rb->size < size) {
+        drm_tegra_bo_unmap(rb->bo);
+        drm_tegra_bo_unref(rb->bo);
+        rb->bo = NULL;
+    }
+
+    /*
+     * DRM uapi has no flag for cacheable BO, the readback is write-combined
+     * like the pixmap itself and is read by the uncached-source copy. The
+     * gain is in not waiting for the rendering at the time of download.
+     */
+    if (!rb->bo) {
+        err = drm_tegra_bo_new(&rb->bo, tegra->drm,
+                               exa->default_drm_bo_flags, size);
+        if (err < 0) {
+            ERROR_MSG("failed to allocate readback BO: %d\n", err);
+            rb->bo = NULL;
+            return;
+        }
+
+        err = drm_tegra_bo_map(rb->bo, &rb->map);
+        if (err < 0) {
+            ERROR_MSG("failed to map readback BO: %d\n", err);
+            drm_tegra_bo_unref(rb->bo);
+            rb->bo = NULL;
+            return;
+        }
+
+        rb->size = size;
+    }
+
+    rb->pitch = pitch;
+
+    tegra_exa_flush_deferred_operations(pix, true, false, true);
+
+    err = tegra_stream_begin(exa->cmds, exa->gr2d);
+    if (err < 0)
+        return;
+
+    dst.bo     = rb->bo;
+    dst.offset = 0;
+    dst.pitch  = pitch;
+    dst.tiled  = false;
+    dst.pool   = false;
+
+    tegra_exa_2d_surface_from_pixmap(pix, &src);
+
+    tegra_exa_copy_2d_emit_blit(exa->cmds, bpp, &dst, 0, 0, &src, rb->x, rb->y,
+                                rb->width, rb->height);
+
+    if (exa->cmds->status != TEGRADRM_STREAM_CONSTRUCT) {
+        tegra_stream_cleanup(exa->cmds);
+        return;
+    }
+
+    tegra_stream_end(exa->cmds);
+
+    tegra_exa_wait_pixmaps(TEGRA_3D, pix, 0);
+
+    explicit_fence = tegra_exa_get_explicit_fence(TEGRA_3D, pix, 0);
+    fence = tegra_exa_stream_submit(exa, TEGRA_2D, explicit_fence);
+    TEGRA_FENCE_PUT(explicit_fence);
+
+    /* pixmap is the source of the job, writers shall wait for it */
+    tegra_exa_pixmap_add_fence_bands(priv->fence_read[TEGRA_2D],
+                                     &priv->bands_read[TEGRA_2D],
+                                     tegra_exa_pixmap_bands(pix, rb->y,
+                                                            rb->height));
+
+    if (priv->fence_read[TEGRA_2D] != fence) {
+        TEGRA_FENCE_PUT(priv->fence_read[TEGRA_2D]);
+        priv->fence_read[TEGRA_2D] = TEGRA_FENCE_GET(fence, &exa->scratch);
+    }
+
+    rb->fence = TEGRA_FENCE_GET(fence, NULL);
+    rb->pix_bo = tegra_exa_pixmap_bo(pix);
+    rb->pix_offset = tegra_exa_pixmap_offset(pix);
+    rb->write_gen = priv->write_gen;
+    rb->valid = true;
+    rb->armed = false;
+
+    exa->stats.num_readback_prefetches++;
+    exa->stats.num_readback_prefetched_bytes += rb->width * (bpp >> 3) *
+                                                rb->height;
+
+    ACCEL_MSG("prefetch pixmap %p %d:%d, %dx%d %d:%d\n",
+              pix, pix->drawable.width, pix->drawable.height,
+              rb->x, rb->y, rb->width, rb->height);
+}
+
 static bool tegra_exa_load_screen(PixmapPtr pix, int x, int y, int w, int h,
                                   char *usr, int usr_pitch, bool download)
 {
@@ -126,8 +419,13 @@ static bool tegra_exa_load_screen(PixmapPtr pix, int x, int y, int w, int h,
         return false;
     }
 
+    if (download && tegra_exa_download_prefetched(pix, x, y, w, h,
+                                                  usr, usr_pitch))
+        return true;
+
     access_hint = download ? EXA_PREPARE_SRC : EXA_PREPARE_DEST;
-    ret = tegra_exa_prepare_cpu_access(pix, access_hint, (void**)&pmap, true);
+    ret = tegra_exa_prepare_cpu_access_rows(pix, access_hint, (void**)&pmap,
+                                            true, y, h, false);
     if (!ret)
         return false;
 
@@ -168,6 +466,9 @@ static bool tegra_exa_load_screen(PixmapPtr pix, int x, int y, int w, int h,
 
     tegra_exa_finish_cpu_access(pix, access_hint);
 
+    if (download)
+        tegra_exa_readback_track(pix, x, y, w, h);
+
     return ret;
 }
 
@@ -94,13 +94,12 @@ static bool tegra_exa_pixmap_allocate_from_sysmem(TegraPtr tegra,
                                                   unsigned int size)
 {
     struct tegra_exa *exa = tegra->exa;
-    int err;
 
     if (pixmap->dri)
         return false;
 
-    err = posix_memalign(&pixmap->fallback, 128, size);
-    if (err)
+    pixmap->fallback = tegra_exa_arena_alloc(exa, size);
+    if (!pixmap->fallback)
         return false;
 
     pixmap->type = TEGRA_EXA_PIXMAP_TYPE_FALLBACK;
@@ -116,14 +115,21 @@ static bool tegra_exa_pixmap_allocate_from_sysmem(TegraPtr tegra,
 static int tegra_exa_init_mm(TegraPtr tegra, struct tegra_exa *exa)
 {
     bool has_iommu = false;
+    unsigned int i;
     int drm_ver;
 
     drm_ver = drm_tegra_version(tegra->drm);
 
-    xorg_list_init(&exa->pixmaps_freelist);
+    for (i = 0; i < TEGRA_FREELIST_BINS; i++) {
+        xorg_list_init(&exa->pixmaps_freelist[0][i]);
+        xorg_list_init(&exa->pixmaps_freelist[1][i]);
+    }
+
     xorg_list_init(&exa->cool_pixmaps);
     xorg_list_init(&exa->mem_pools);
 
+    tegra_exa_arena_init(exa);
+
 #ifdef HAVE_JPEG
     if (tegra->exa_compress_jpeg) {
         exa->jpegCompressor = tjInitCompress();
@@ -222,6 +228,8 @@ static void tegra_exa_release_mm(TegraPtr tegra, struct tegra_exa *exa)
 
     if (!xorg_list_is_empty(&exa->cool_pixmaps))
         ERROR_MSG("FATAL: Memory leak! Cooled pixmaps\n");
+
+    tegra_exa_arena_fini(exa);
 }
 
 /* vim: set et sts=4 sw=4 ts=4: */
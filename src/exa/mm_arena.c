@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Arena for the sysmem (fallback) pixmaps data.
+ *
+ * Pixmaps data is allocated from slabs of a fixed size, each slab holds
+ * objects of a single size class. Slab's header resides at the beginning
+ * of the slab and slabs are aligned to the slab size, hence header is
+ * found by masking object's address. Allocations that are larger than
+ * the biggest class get a dedicated mapping with the same header.
+ *
+ * Free objects are tracked by a bitmap in the header, hence pages of the
+ * freed objects are given back to kernel right away and not only when
+ * the whole slab is released, glibc heap doesn't get fragmented by the
+ * pixmaps churn and doesn't need to be trimmed.
+ */
+
+#define TEGRA_ARENA_SLAB_SIZE       (256 * 1024)
+#define TEGRA_ARENA_HEADER_SIZE     512
+#define TEGRA_ARENA_PAGE_SIZE       4096
+#define TEGRA_ARENA_MAGIC           0x41524e41
+#define TEGRA_ARENA_LARGE           TEGRA_ARENA_CLASSES
+#define TEGRA_ARENA_MAX_OBJECTS     ((TEGRA_ARENA_SLAB_SIZE - \
+                                      TEGRA_ARENA_HEADER_SIZE) / 128)
+
+struct tegra_arena_slab {
+    uint32_t magic;
+    uint16_t class;
+    uint16_t num_objects;
+    uint16_t num_free;
+    uint32_t size;
+    struct xorg_list entry;
+    uint32_t bitmap[(TEGRA_ARENA_MAX_OBJECTS + 31) / 32];
+};
+
+static const unsigned int tegra_arena_class_size[TEGRA_ARENA_CLASSES] = {
+      128,   256,   384,   512,   768,  1024,  1536,  2048,
+     3072,  4096,  6144,  8192, 12288, 16384, 24576, 32768,
+};
+
+static inline char *tegra_exa_arena_slab_data(struct tegra_arena_slab *slab)
+{
+    return (char *)slab + TEGRA_ARENA_HEADER_SIZE;
+}
+
+static void *tegra_exa_arena_map(unsigned long size)
+{
+    unsigned long head, tail;
+    char *map;
+
+    /* over-allocate to get mapping aligned to the slab size */
+    map = mmap(NULL, size + TEGRA_ARENA_SLAB_SIZE, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    head = TEGRA_ALIGN((uintptr_t)map, TEGRA_ARENA_SLAB_SIZE) - (uintptr_t)map;
+    tail = TEGRA_ARENA_SLAB_SIZE - head;
+
+    if (head)
+        munmap(map, head);
+
+    if (tail)
+        munmap(map + head + size, tail);
+
+    return map + head;
+}
+
+/* gives pages of the range back to kernel, range becomes zero-filled */
+static void tegra_exa_arena_purge(struct tegra_exa *exa,
+                                  char *start, char *end)
+{
+    start = (char *)TEGRA_ALIGN((uintptr_t)start, TEGRA_ARENA_PAGE_SIZE);
+    end = (char *)TEGRA_ROUND_DOWN((uintptr_t)end, TEGRA_ARENA_PAGE_SIZE);
+
+    if (end <= start)
+        return;
+
+    if (madvise(start, end - start, MADV_DONTNEED) == 0)
+        exa->stats.num_arena_purged_bytes += end - start;
+}
+
+static struct tegra_arena_slab *
+tegra_exa_arena_new_slab(struct tegra_exa *exa, unsigned int class)
+{
+    struct tegra_arena_slab *slab;
+    unsigned int i;
+
+    slab = tegra_exa_arena_map(TEGRA_ARENA_SLAB_SIZE);
+    if (!slab)
+        return NULL;
+
+    slab->magic = TEGRA_ARENA_MAGIC;
+    slab->class = class;
+    slab->size = TEGRA_ARENA_SLAB_SIZE;
+    slab->num_objects = (TEGRA_ARENA_SLAB_SIZE - TEGRA_ARENA_HEADER_SIZE) /
+                            tegra_arena_class_size[class];
+    slab->num_free = slab->num_objects;
+
+    for (i = 0; i < slab->num_objects; i++)
+        slab->bitmap[i / 32] |= 1u << (i % 32);
+
+    exa->stats.num_arena_slabs_allocated++;
+
+    return slab;
+}
+
+static void tegra_exa_arena_release_slab(struct tegra_exa *exa,
+                                         struct tegra_arena_slab *slab)
+{
+    munmap(slab, slab->size);
+    exa->stats.num_arena_slabs_released++;
+}
+
+static void *tegra_exa_arena_alloc_large(struct tegra_exa *exa,
+                                         unsigned int size)
+{
+    struct tegra_arena_slab *slab;
+    unsigned long map_size;
+
+    map_size = TEGRA_ALIGN(TEGRA_ARENA_HEADER_SIZE + size,
+                           TEGRA_ARENA_PAGE_SIZE);
+
+    slab = tegra_exa_arena_map(map_size);
+    if (!slab)
+        return NULL;
+
+    slab->magic = TEGRA_ARENA_MAGIC;
+    slab->class = TEGRA_ARENA_LARGE;
+    slab->size = map_size;
+
+    exa->stats.num_arena_slabs_allocated++;
+
+    return tegra_exa_arena_slab_data(slab);
+}
+
+static void *tegra_exa_arena_alloc(struct tegra_exa *exa, unsigned int size)
+{
+    struct tegra_arena_class *arena_class;
+    struct tegra_arena_slab *slab;
+    unsigned int class, i, bit;
+
+    for (class = 0; class < TEGRA_ARENA_CLASSES; class++) {
+        if (size <= tegra_arena_class_size[class])
+            break;
+    }
+
+    if (class == TEGRA_ARENA_CLASSES)
+        return tegra_exa_arena_alloc_large(exa, size);
+
+    arena_class = &exa->arena[class];
+
+    if (!xorg_list_is_empty(&arena_class->partial)) {
+        slab = xorg_list_first_entry(&arena_class->partial,
+                                     struct tegra_arena_slab, entry);
+    } else {
+        slab = arena_class->empty;
+        arena_class->empty = NULL;
+
+        if (!slab)
+            slab = tegra_exa_arena_new_slab(exa, class);
+        if (!slab)
+            return NULL;
+
+        xorg_list_add(&slab->entry, &arena_class->partial);
+    }
+
+    for (i = 0; !slab->bitmap[i]; i++)
+        ;
+
+    bit = __builtin_ctz(slab->bitmap[i]);
+    slab->bitmap[i] &= ~(1u << bit);
+
+    if (--slab->num_free == 0)
+        xorg_list_del(&slab->entry);
+
+    return tegra_exa_arena_slab_data(slab) +
+                (i * 32 + bit) * tegra_arena_class_size[class];
+}
+
+static void tegra_exa_arena_free(struct tegra_exa *exa, void *ptr)
+{
+    struct tegra_arena_class *arena_class;
+    struct tegra_arena_slab *slab;
+    unsigned int class_size, idx;
+
+    if (!ptr)
+        return;
+
+    slab = (void *)TEGRA_ROUND_DOWN((uintptr_t)ptr, TEGRA_ARENA_SLAB_SIZE);
+    assert(slab->magic == TEGRA_ARENA_MAGIC);
+
+    if (slab->class == TEGRA_ARENA_LARGE) {
+        tegra_exa_arena_release_slab(exa, slab);
+        return;
+    }
+
+    arena_class = &exa->arena[slab->class];
+    class_size = tegra_arena_class_size[slab->class];
+    idx = ((char *)ptr - tegra_exa_arena_slab_data(slab)) / class_size;
+
+    assert(!(slab->bitmap[idx / 32] & (1u << (idx % 32))));
+    slab->bitmap[idx / 32] |= 1u << (idx % 32);
+
+    if (slab->num_free++ == 0)
+        xorg_list_add(&slab->entry, &arena_class->partial);
+
+    if (slab->num_free < slab->num_objects) {
+        tegra_exa_arena_purge(exa, ptr, (char *)ptr + class_size);
+        return;
+    }
+
+    /* keep one empty slab per class to not thrash mappings */
+    xorg_list_del(&slab->entry);
+
+    if (arena_class->empty) {
+        tegra_exa_arena_release_slab(exa, slab);
+        return;
+    }
+
+    tegra_exa_arena_purge(exa, tegra_exa_arena_slab_data(slab),
+                          (char *)slab + slab->size);
+    arena_class->empty = slab;
+}
+
+static void tegra_exa_arena_init(struct tegra_exa *exa)
+{
+    unsigned int i;
+
+    for (i = 0; i < TEGRA_ARENA_CLASSES; i++) {
+        xorg_list_init(&exa->arena[i].partial);
+        exa->arena[i].empty = NULL;
+    }
+}
+
+static void tegra_exa_arena_fini(struct tegra_exa *exa)
+{
+    unsigned int i;
+
+    for (i = 0; i < TEGRA_ARENA_CLASSES; i++) {
+        if (exa->arena[i].empty)
+            tegra_exa_arena_release_slab(exa, exa->arena[i].empty);
+
+        if (!xorg_list_is_empty(&exa->arena[i].partial))
+            ERROR_MSG("FATAL: Memory leak! Unreleased arena slabs\n");
+
+        exa->arena[i].empty = NULL;
+    }
+}
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -50,14 +50,45 @@ struct compression_arg {
     unsigned pitch;
     unsigned keep_fallback;
     unsigned quality;
+    bool expand_565;
 };
 
+/*
+ * JPEG and PNG can't take 16bpp data, r5g6b5 pixmaps are expanded to
+ * 32bpp while copied out for compression and packed back on decompression.
+ * Pixmaps that never were a Render picture are drawn by X core and use
+ * the default r5g6b5 visual if depth is 16.
+ */
+static bool tegra_exa_fridge_pixmap_is_565(struct tegra_pixmap *pixmap)
+{
+    if (pixmap->base->drawable.bitsPerPixel != 16)
+        return false;
+
+    switch (pixmap->picture_format) {
+    case PICT_r5g6b5:
+    case PICT_b5g6r5:
+        return true;
+
+    case 0:
+        return pixmap->base->drawable.depth == 16;
+
+    default:
+        break;
+    }
+
+    return false;
+}
+
 static int tegra_exa_to_png_format(TegraPtr tegra, struct tegra_pixmap *pixmap)
 {
     if (!tegra->exa_compress_png)
         return -1;
 
 #ifdef HAVE_PNG
+    if (tegra_exa_fridge_pixmap_is_565(pixmap))
+        return pixmap->picture_format == PICT_b5g6r5 ? PNG_FORMAT_RGBA :
+                                                       PNG_FORMAT_BGRA;
+
     switch (pixmap->picture_format) {
     case PICT_a8:
         return PNG_FORMAT_GRAY;
@@ -95,6 +126,9 @@ tegra_exa_to_jpeg_turbo_format(TegraPtr tegra, struct tegra_pixmap *pixmap)
         return -1;
 
 #ifdef HAVE_JPEG
+    if (tegra_exa_fridge_pixmap_is_565(pixmap))
+        return pixmap->picture_format == PICT_b5g6r5 ? TJPF_RGBX : TJPF_BGRX;
+
     switch (pixmap->picture_format) {
     case PICT_a8:
         return TJPF_GRAY;
@@ -157,8 +191,12 @@ static void * tegra_exa_mm_fridge_map_pixmap(struct tegra_pixmap *pixmap)
 
     if (pixmap->type == TEGRA_EXA_PIXMAP_TYPE_BO) {
         err = drm_tegra_bo_map(pixmap->bo, &data_ptr);
-        if (!err)
+        if (!err) {
+            if (pixmap->tiled)
+                tegra_exa_detile_pixmap_data(pixmap, data_ptr);
+
             return data_ptr;
+        }
 
         return NULL;
     }
@@ -189,10 +227,8 @@ tegra_exa_mm_fridge_release_uncompressed_data(struct tegra_exa *exa,
 {
     switch (pixmap->type) {
     case TEGRA_EXA_PIXMAP_TYPE_FALLBACK:
-        if (!keep_fallback) {
-            free(pixmap->fallback);
-            exa->release_count++;
-        }
+        if (!keep_fallback)
+            tegra_exa_arena_free(exa, pixmap->fallback);
         break;
 
     case TEGRA_EXA_PIXMAP_TYPE_POOL:
@@ -259,8 +295,7 @@ static void tegra_exa_mm_resurrect_accel_pixmap(TegraPtr tegra,
         tegra_memcpy_vfp_aligned_src_cached(pixmap_data, pixmap_data_orig,
                                             data_size);
         tegra_exa_mm_fridge_unmap_pixmap(pixmap);
-        free(pixmap_data_orig);
-        exa->release_count++;
+        tegra_exa_arena_free(exa, pixmap_data_orig);
         exa->stats.num_pixmaps_resurrected++;
         exa->stats.num_pixmaps_resurrected_bytes += data_size;
     } else {
@@ -270,18 +305,62 @@ static void tegra_exa_mm_resurrect_accel_pixmap(TegraPtr tegra,
     PROFILE_STOP(ressurection);
 }
 
+static uint32_t *tegra_exa_mm_expand_565(struct compression_arg *c)
+{
+    uint32_t *buf;
+    unsigned y;
+
+    buf = malloc(c->width * c->height * 4);
+    if (!buf) {
+        ERROR_MSG("failed to allocate buffer for expanding of size %u\n",
+                  c->width * c->height * 4);
+        return NULL;
+    }
+
+    for (y = 0; y < c->height; y++)
+        tegra_convert_565_to_8888(buf + y * c->width,
+                                  (uint16_t *)((char *)c->buf_in +
+                                               y * c->pitch),
+                                  c->width);
+
+    return buf;
+}
+
+static void tegra_exa_mm_pack_565(struct compression_arg *c, uint32_t *buf)
+{
+    unsigned y;
+
+    for (y = 0; y < c->height; y++)
+        tegra_convert_8888_to_565((uint16_t *)((char *)c->buf_out +
+                                               y * c->pitch),
+                                  buf + y * c->width,
+                                  c->width);
+}
+
 static int tegra_exa_mm_compress_pixmap(struct tegra_exa *exa,
                                         struct tegra_pixmap *pixmap,
                                         struct compression_arg *c)
 {
     unsigned long compressed_bound;
     unsigned long compressed_max;
+    uint32_t *expanded = NULL;
+    void *src = c->buf_in;
+    unsigned pitch = c->pitch;
     void *tmp;
     int err;
 
     if (c->compression_type == TEGRA_EXA_COMPRESSION_UNCOMPRESSED)
         goto uncompressed;
 
+    if (c->expand_565) {
+        expanded = tegra_exa_mm_expand_565(c);
+        if (!expanded)
+            goto uncompressed;
+
+        src = expanded;
+        pitch = c->width * 4;
+    }
+
     DEBUG_MSG("priv %p compressing\n", pixmap);
 
     if (c->in_size > TEGRA_EXA_COMPRESS_SMALL_SIZE)
@@ -320,8 +399,8 @@ static int tegra_exa_mm_compress_pixmap(struct tegra_exa *exa,
 
 #ifdef HAVE_JPEG
     if (c->compression_type == TEGRA_EXA_COMPRESSION_JPEG) {
-        err = tjCompress2(exa->jpegCompressor, c->buf_in,
-                          c->width, c->pitch, c->height, c->format,
+        err = tjCompress2(exa->jpegCompressor, src,
+                          c->width, pitch, c->height, c->format,
                           (uint8_t **) &c->buf_out, &c->out_size,
                           c->samping, c->quality, TJFLAG_FASTDCT);
         if (err) {
@@ -364,7 +443,7 @@ static int tegra_exa_mm_compress_pixmap(struct tegra_exa *exa,
         }
 
         err = png_image_write_to_memory(&png, c->buf_out, &png_size, 0,
-                                        c->buf_in, c->pitch, NULL);
+                                        src, pitch, NULL);
         if (err == 0) {
             ERROR_MSG("PNG compression failed %s\n", png.message);
             free(c->buf_out);
@@ -394,11 +473,16 @@ static int tegra_exa_mm_compress_pixmap(struct tegra_exa *exa,
 
     DEBUG_MSG("priv %p compressed\n", pixmap);
 
+    free(expanded);
+
     return 0;
 
 uncompressed:
     DEBUG_MSG("priv %p going uncompressed\n", pixmap);
 
+    free(expanded);
+    c->expand_565 = false;
+
     if (c->keep_fallback) {
         /* this is fallback allocation that failed to be compressed */
         c->compression_type = TEGRA_EXA_COMPRESSION_UNCOMPRESSED;
@@ -407,8 +491,8 @@ uncompressed:
         return 1;
     }
 
-    err = posix_memalign(&c->buf_out, 128, c->in_size);
-    if (!err) {
+    c->buf_out = tegra_exa_arena_alloc(exa, c->in_size);
+    if (c->buf_out) {
         c->compression_type = TEGRA_EXA_COMPRESSION_UNCOMPRESSED;
         tegra_memcpy_vfp_aligned_dst_cached(c->buf_out, c->buf_in, c->in_size);
 
@@ -430,12 +514,35 @@ tegra_exa_mm_decompress_pixmap(TegraPtr tegra,
                                struct compression_arg *c)
 {
     struct tegra_exa *exa = tegra->exa;
+    uint32_t *expanded = NULL;
+    void *dst = c->buf_out;
+    unsigned pitch = c->pitch;
 #ifdef HAVE_PNG
     png_image png = { 0 };
 #endif
 
     DEBUG_MSG("priv %p decompressing\n", pixmap);
 
+    if (c->expand_565) {
+        expanded = malloc(c->width * c->height * 4);
+        if (!expanded) {
+            ERROR_MSG("FATAL: failed to allocate buffer for decompression of size %u\n",
+                      c->width * c->height * 4);
+#ifdef HAVE_JPEG
+            if (c->compression_type == TEGRA_EXA_COMPRESSION_JPEG)
+                tjFree(c->buf_in);
+#endif
+#ifdef HAVE_PNG
+            if (c->compression_type == TEGRA_EXA_COMPRESSION_PNG)
+                free(c->buf_in);
+#endif
+            return;
+        }
+
+        dst = expanded;
+        pitch = c->width * 4;
+    }
+
     switch (c->compression_type) {
     case TEGRA_EXA_COMPRESSION_UNCOMPRESSED:
         tegra_memcpy_vfp_aligned_src_cached(c->buf_out, c->buf_in, c->out_size);
@@ -444,7 +551,7 @@ tegra_exa_mm_decompress_pixmap(TegraPtr tegra,
         /* clear released data for privacy protection */
         if (TEST_FREEZER || tegra->exa_erase_pixmaps)
             memset(c->buf_in, TEST_FREEZER ? 0xffffffff : 0, c->out_size);
-        free(c->buf_in);
+        tegra_exa_arena_free(exa, c->buf_in);
         break;
 
 #ifdef HAVE_LZ4
@@ -459,7 +566,7 @@ tegra_exa_mm_decompress_pixmap(TegraPtr tegra,
 #ifdef HAVE_JPEG
     case TEGRA_EXA_COMPRESSION_JPEG:
         tjDecompress2(exa->jpegDecompressor, c->buf_in, c->in_size,
-                  c->buf_out, c->width, c->pitch, c->height,
+                  dst, c->width, pitch, c->height,
                   c->format, TJFLAG_FASTDCT);
         DEBUG_MSG("priv %p decompressed: jpeg\n", pixmap);
 
@@ -475,13 +582,18 @@ tegra_exa_mm_decompress_pixmap(TegraPtr tegra,
         if (png.warning_or_error)
             ERROR_MSG("png error: %s\n", png.message);
         png.format = c->format;
-        png_image_finish_read(&png, NULL, c->buf_out, c->pitch, NULL);
+        png_image_finish_read(&png, NULL, dst, pitch, NULL);
         if (png.warning_or_error)
             ERROR_MSG("png error: %s\n", png.message);
         DEBUG_MSG("priv %p decompressed: png\n", pixmap);
         break;
 #endif
     }
+
+    if (expanded) {
+        tegra_exa_mm_pack_565(c, expanded);
+        free(expanded);
+    }
 }
 
 static struct compression_arg
@@ -522,6 +634,7 @@ tegra_exa_select_compression(TegraPtr tegra,
         if (carg.format > -1) {
             DEBUG_MSG("priv %p selected compression: jpeg\n", pixmap);
             carg.compression_type = TEGRA_EXA_COMPRESSION_JPEG;
+            carg.expand_565 = tegra_exa_fridge_pixmap_is_565(pixmap);
             return carg;
         }
     }
@@ -533,6 +646,7 @@ tegra_exa_select_compression(TegraPtr tegra,
         if (carg.format > -1) {
             DEBUG_MSG("priv %p selected compression: png\n", pixmap);
             carg.compression_type = TEGRA_EXA_COMPRESSION_PNG;
+            carg.expand_565 = tegra_exa_fridge_pixmap_is_565(pixmap);
             return carg;
         }
     }
@@ -564,6 +678,7 @@ tegra_exa_thaw_pixmap_data(TegraPtr tegra,
     carg.buf_in             = pixmap->compressed_data;
     carg.in_size            = pixmap->compressed_size;
     carg.format             = pixmap->compression_fmt;
+    carg.expand_565         = pixmap->compressed_565;
 
     data_size = tegra_exa_pixmap_size(pixmap);
     pixmap->fence_write[TEGRA_2D] = NULL;
@@ -700,13 +815,23 @@ static int tegra_exa_freeze_pixmap(TegraPtr tegra, struct tegra_pixmap *pixmap)
     tegra_exa_mm_fridge_release_uncompressed_data(exa, pixmap,
                                                   carg.keep_fallback);
 
+    /* lossy compression doesn't preserve solid areas */
+    if (carg.compression_type == TEGRA_EXA_COMPRESSION_JPEG) {
+        tegra_exa_solid_tiles_invalidate(pixmap);
+        pixmap->write_gen++;
+    }
+
     pixmap->compression_type    = carg.compression_type;
     pixmap->compressed_data     = carg.buf_out;
     pixmap->compressed_size     = carg.out_size;
     pixmap->compression_fmt     = carg.format;
+    pixmap->compressed_565      = carg.expand_565;
     pixmap->type                = TEGRA_EXA_PIXMAP_TYPE_NONE;
     pixmap->frozen              = true;
 
+    /* storage is gone, thawed pixmap gets a new one */
+    tegra_exa_readback_forget(exa, pixmap);
+
     exa->stats.num_pixmaps_compressed++;
     exa->stats.num_pixmaps_compression_in_bytes  += data_size;
     exa->stats.num_pixmaps_compression_out_bytes += carg.out_size;
@@ -849,6 +974,12 @@ static void tegra_exa_cool_pixmap(PixmapPtr pixmap, bool write)
 
         assert(!priv->destroyed);
 
+        /* cached copy of the glyph is outdated now */
+        if (write) {
+            tegra_exa_glyph_atlas_invalidate(priv);
+            priv->write_gen++;
+        }
+
         if (tegra->exa_refrigerator) {
             tegra_exa_cool_tegra_pixmap(tegra, priv);
 
@@ -928,32 +1059,24 @@ static bool tegra_exa_prefer_hw_fill(struct tegra_pixmap *pixmap, bool accel)
     ScrnInfoPtr scrn = xf86ScreenToScrn(pixmap->base->drawable.pScreen);
     TegraPtr tegra = TegraPTR(scrn);
     struct tegra_exa *exa = tegra->exa;
-    struct drm_tegra_bo *bo = NULL;
-    struct tegra_pixmap_pool *pool;
 
     if (pixmap->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK)
         return false;
 
-    if (pixmap->type == TEGRA_EXA_PIXMAP_TYPE_BO)
-        bo = pixmap->bo;
-
-    if (pixmap->type == TEGRA_EXA_PIXMAP_TYPE_POOL) {
-        pool = to_tegra_pool(pixmap->pool_entry.pool);
-        bo = pool->bo;
-    }
-
-    if (tegra_exa_pixmap_is_busy(exa, pixmap))
+    /* CPU access results in detiling of the data */
+    if (tegra_exa_pixmap_is_busy(exa, pixmap) || pixmap->tiled)
         return true;
 
     /*
      * HW job execution overhead is bigger for small pixmaps than clearing
-     * on CPU, so we prefer CPU for a such pixmaps.
+     * on CPU, so we prefer CPU for a such pixmaps. Mapping is accounted
+     * only if accelerated filling is allowed, otherwise pixmap's data is
+     * about to be accessed by CPU anyways.
      */
-    if (tegra_exa_pixmap_size(pixmap) < TEGRA_EXA_CPU_FILL_MIN_SIZE &&
-        (!accel || drm_tegra_bo_mapped(bo)))
-        return false;
-
-    return true;
+    return !tegra_exa_cost_prefer_cpu_fill(exa, pixmap,
+                                           tegra_exa_pixmap_size(pixmap),
+                                           !accel ||
+                                           tegra_exa_cost_pixmap_mapped(pixmap));
 }
 
 static void tegra_exa_clear_pixmap_data(struct tegra_pixmap *pixmap, bool accel)
@@ -977,6 +1100,7 @@ tegra_exa_allocate_pixmap_data_no_fail(TegraPtr tegra,
                                        bool accel)
 {
     unsigned int size = tegra_exa_pixmap_size(pixmap);
+    PixmapPtr pix = pixmap->base;
     unsigned int retries = 0;
 
     PROFILE_DEF(alloc);
@@ -987,7 +1111,13 @@ tegra_exa_allocate_pixmap_data_no_fail(TegraPtr tegra,
             if (tegra_exa_pixmap_allocate_from_sysmem(tegra, pixmap, size))
                 break;
         } else {
-            /* take opportunity to re-use allocation from a free-list */
+            if (tegra_exa_pixmap_allocate_tiled(tegra, pixmap, pix->devKind,
+                                                pix->drawable.height,
+                                                pix->drawable.bitsPerPixel) ||
+                tegra_exa_pixmap_allocate_from_freelist(tegra, pixmap, size))
+                break;
+
+            /* release idle freelist pixmaps exceeding the cache */
             tegra_exa_clean_up_pixmaps_freelist(tegra, false);
 
             if (tegra_exa_pixmap_allocate_from_pool(tegra, pixmap, size) ||
@@ -26,6 +26,8 @@
 #define TEGRA_EXA_PAGE_MASK             (TEGRA_EXA_PAGE_SIZE - 1)
 #define TEGRA_EXA_POOL_SIZE_MAX         (TEGRA_EXA_POOL_SIZE * 3 / 2)
 #define TEGRA_EXA_POOL_SIZE_MERGED_MAX  (1 * 1024 * 1024)
+#define TEGRA_EXA_POOL_WINDOW_MIN       (4 * 1024 * 1024)
+#define TEGRA_EXA_POOL_WINDOW_ALIGN     (1 * 1024 * 1024)
 
 static inline struct tegra_pixmap *
 to_tegra_pixmap(struct mem_pool_entry *pool_entry)
@@ -64,8 +66,29 @@ static void tegra_exa_fence_pool_entries(struct tegra_pixmap_pool *pool)
     }
 }
 
+static void tegra_exa_pixmap_pool_unmap_window(struct tegra_pixmap_pool *pool,
+                                               void **window,
+                                               unsigned long *size)
+{
+    int err;
+
+    if (!*window)
+        return;
+
+    err = drm_tegra_bo_unmap_head(pool->bo, *window, *size);
+    if (err < 0)
+        ERROR_MSG("failed to unmap pool window: %d\n", err);
+
+    *window = NULL;
+    *size = 0;
+}
+
 static void tegra_exa_pixmap_pool_destroy(struct tegra_pixmap_pool *pool)
 {
+    tegra_exa_pixmap_pool_unmap_window(pool, &pool->window_retired,
+                                       &pool->window_retired_size);
+    tegra_exa_pixmap_pool_unmap_window(pool, &pool->window,
+                                       &pool->window_size);
     mem_pool_destroy(&pool->pool);
     drm_tegra_bo_unref(pool->bo);
     xorg_list_del(&pool->entry);
@@ -152,12 +175,87 @@ static void tegra_exa_pixmap_pool_unmap(struct tegra_pixmap_pool *pool)
     mem_pool_close_access(&pool->pool);
 }
 
+/*
+ * Mapping of a large pool is costly since kernel populates page tables of
+ * the whole BO on mmap, while CPU accesses only a single entry at a time.
+ * Kernel allows to mmap GEM only from its start, hence CPU access to the
+ * large pool is done via a cached mapping of the pool's head that covers
+ * the accessed entry. Entries are allocated from the bottom of the pool,
+ * thus usually only a small part of the pool is mapped.
+ */
+static bool tegra_exa_pixmap_pool_windowed(struct tegra_pixmap_pool *pool)
+{
+    return pool->pool.pool_size >= TEGRA_EXA_POOL_WINDOW_MIN;
+}
+
+static void *
+tegra_exa_pixmap_pool_map_window(struct tegra_pixmap_pool *pool,
+                                 struct mem_pool_entry *pool_entry)
+{
+    unsigned long offset = mem_pool_entry_offset(pool_entry);
+    unsigned long end = offset + pool->pool.entries[pool_entry->id].size;
+    unsigned long size;
+    void *window;
+    int err;
+
+    if (!pool->window || end > pool->window_size) {
+        size = TEGRA_ALIGN(end, TEGRA_EXA_POOL_WINDOW_ALIGN);
+
+        /*
+         * Window can't be re-mapped while it's in use, map the whole pool
+         * in that case to guarantee that window won't need to grow again
+         * until all users are gone.
+         */
+        if (pool->window_users)
+            size = pool->pool.pool_size;
+
+        size = min(size, pool->pool.pool_size);
+
+        err = drm_tegra_bo_map_head(pool->bo, size, &window);
+        if (err < 0) {
+            ERROR_MSG("failed to map pool window: %d\n", err);
+            return NULL;
+        }
+
+        if (pool->window_users) {
+            assert(!pool->window_retired);
+            pool->window_retired = pool->window;
+            pool->window_retired_size = pool->window_size;
+        } else {
+            tegra_exa_pixmap_pool_unmap_window(pool, &pool->window,
+                                               &pool->window_size);
+        }
+
+        pool->window = window;
+        pool->window_size = size;
+    }
+
+    pool->window_users++;
+
+    return (char *)pool->window + offset;
+}
+
+static void
+tegra_exa_pixmap_pool_unmap_window_entry(struct tegra_pixmap_pool *pool)
+{
+    assert(pool->window_users > 0);
+
+    if (--pool->window_users)
+        return;
+
+    tegra_exa_pixmap_pool_unmap_window(pool, &pool->window_retired,
+                                       &pool->window_retired_size);
+}
+
 static void *
 tegra_exa_pixmap_pool_map_entry(struct mem_pool_entry *pool_entry)
 {
     struct tegra_pixmap_pool *pool = to_tegra_pool(pool_entry->pool);
     int err;
 
+    if (tegra_exa_pixmap_pool_windowed(pool))
+        return tegra_exa_pixmap_pool_map_window(pool, pool_entry);
+
     err = tegra_exa_pixmap_pool_map(pool);
     if (err)
         return NULL;
@@ -169,7 +267,11 @@ static void
 tegra_exa_pixmap_pool_unmap_entry(struct mem_pool_entry *pool_entry)
 {
     struct tegra_pixmap_pool *pool = to_tegra_pool(pool_entry->pool);
-    tegra_exa_pixmap_pool_unmap(pool);
+
+    if (tegra_exa_pixmap_pool_windowed(pool))
+        tegra_exa_pixmap_pool_unmap_window_entry(pool);
+    else
+        tegra_exa_pixmap_pool_unmap(pool);
 }
 
 static void *tegra_exa_pixmap_pool_alloc(struct tegra_exa *exa,
@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) Dmitry Osipenko
+ * Copyright (c) Erik Faye-Lund
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define DISABLE_TILED_PIXMAPS       false
+
+/*
+ * Small pixmaps are allocated from pools, tiling makes sense only for
+ * a larger render targets anyways.
+ */
+#define TEGRA_EXA_TILED_MIN_SIZE    (64 * 1024)
+
+/* GR2D and GR3D use 16 bytes x 16 lines tiles */
+#define TEGRA_EXA_TILE_WIDTH        16
+#define TEGRA_EXA_TILE_HEIGHT       16
+
+static unsigned int tegra_exa_pixmap_tiled_size(unsigned int pitch,
+                                                unsigned int height)
+{
+    unsigned int size;
+
+    size = pitch * TEGRA_ALIGN(height, TEGRA_EXA_TILE_HEIGHT);
+
+    return TEGRA_ALIGN(size, TEGRA_EXA_OFFSET_ALIGN);
+}
+
+static bool tegra_exa_pixmap_tiling_allowed(struct tegra_pixmap *pixmap,
+                                            unsigned int pitch,
+                                            unsigned int height,
+                                            unsigned int bpp)
+{
+    if (DISABLE_TILED_PIXMAPS)
+        return false;
+
+    /*
+     * Tiled layout is understood only by GR2D and GR3D render target,
+     * other users of the data should get it linear.
+     */
+    if (!pixmap->accel || pixmap->dri || pixmap->no_tiling)
+        return false;
+
+    if (!TEGRA_ALIGNED(pitch, TEGRA_EXA_TILE_WIDTH))
+        return false;
+
+    if (tegra_exa_pixmap_size_aligned(pitch, height, bpp) <
+            TEGRA_EXA_TILED_MIN_SIZE)
+        return false;
+
+    return true;
+}
+
+static bool tegra_exa_pixmap_allocate_tiled(TegraPtr tegra,
+                                            struct tegra_pixmap *pixmap,
+                                            unsigned int pitch,
+                                            unsigned int height,
+                                            unsigned int bpp)
+{
+    struct drm_tegra_bo_tiling tiling = {
+        .mode = DRM_TEGRA_GEM_TILING_MODE_TILED,
+    };
+    struct tegra_exa *exa = tegra->exa;
+    unsigned int size;
+
+    if (!tegra_exa_pixmap_tiling_allowed(pixmap, pitch, height, bpp))
+        return false;
+
+    size = tegra_exa_pixmap_tiled_size(pitch, height);
+
+    if (!tegra_exa_pixmap_allocate_from_bo(tegra, pixmap, size))
+        return false;
+
+    /*
+     * Tiling mode of BO matters only for display controller, set it
+     * anyways to keep BO's state consistent with the data layout.
+     */
+    drm_tegra_bo_set_tiling(pixmap->bo, &tiling);
+
+    pixmap->tiled = true;
+
+    exa->stats.num_pixmaps_allocations_tiled++;
+
+    return true;
+}
+
+/*
+ * Tiles of a tile-row occupy the same memory range as the lines of the
+ * row in a linear layout, hence conversion is done in-place row by row.
+ */
+static void tegra_exa_detile_pixmap_data(struct tegra_pixmap *pixmap,
+                                         void *data)
+{
+    struct drm_tegra_bo_tiling tiling = {
+        .mode = DRM_TEGRA_GEM_TILING_MODE_PITCH,
+    };
+    ScrnInfoPtr scrn = xf86ScreenToScrn(pixmap->base->drawable.pScreen);
+    struct tegra_exa *exa = TegraPTR(scrn)->exa;
+    unsigned int pitch = pixmap->base->devKind;
+    unsigned int height = pixmap->base->drawable.height;
+    unsigned int row_size = pitch * TEGRA_EXA_TILE_HEIGHT;
+    unsigned int tiles = pitch / TEGRA_EXA_TILE_WIDTH;
+    unsigned int y, t, l;
+    char *row, *tile;
+    void *tmp;
+    int err;
+
+    PROFILE_DEF(detiling);
+
+    err = posix_memalign(&tmp, 128, row_size);
+    if (err) {
+        ERROR_MSG("failed to allocate detiling buffer\n");
+        return;
+    }
+
+    PROFILE_START(detiling);
+
+    for (y = 0; y < height; y += TEGRA_EXA_TILE_HEIGHT) {
+        row = (char *) data + y * pitch;
+
+        tegra_memcpy_vfp_aligned_dst_cached(tmp, row, row_size);
+
+        for (t = 0, tile = tmp; t < tiles; t++) {
+            for (l = 0; l < TEGRA_EXA_TILE_HEIGHT; l++) {
+                memcpy(row + l * pitch + t * TEGRA_EXA_TILE_WIDTH, tile,
+                       TEGRA_EXA_TILE_WIDTH);
+
+                tile += TEGRA_EXA_TILE_WIDTH;
+            }
+        }
+    }
+
+    PROFILE_STOP(detiling);
+
+    free(tmp);
+
+    drm_tegra_bo_set_tiling(pixmap->bo, &tiling);
+
+    pixmap->tiled = false;
+    tegra_exa_detiled_copy_forget(exa, pixmap);
+
+    exa->stats.num_pixmaps_detiled++;
+    exa->stats.num_pixmaps_detiled_bytes += tegra_exa_pixmap_size(pixmap);
+}
+
+static void tegra_exa_detile_pixmap(PixmapPtr pixmap)
+{
+    void *ptr;
+
+    /* tegra_exa_prepare_cpu_access() takes care of detiling */
+    if (tegra_exa_pixmap_is_tiled(pixmap) &&
+        tegra_exa_prepare_cpu_access(pixmap, EXA_PREPARE_SRC, &ptr, false))
+        tegra_exa_finish_cpu_access(pixmap, EXA_PREPARE_SRC);
+}
+
+/*
+ * GR3D samples linear textures only. Detiling pixmap in-place by CPU has
+ * to wait for the rendering and leaves pixmap linear for good, instead
+ * GR2D copies the tiled pixmap into a linear scratch pixmap that is then
+ * sampled in place of the pixmap. The copy is kept until pixmap is written.
+ */
+static void tegra_exa_detiled_copy_forget(struct tegra_exa *exa,
+                                          struct tegra_pixmap *priv)
+{
+    unsigned int i;
+
+    for (i = 0; i < TEGRA_DETILED_COPIES_NUM; i++) {
+        if (exa->detiled[i].pixmap == priv)
+            exa->detiled[i].pixmap = NULL;
+    }
+}
+
+static bool tegra_exa_detiled_copy_blit(struct tegra_exa *exa,
+                                        PixmapPtr dst, PixmapPtr src)
+{
+    struct tegra_2d_surface dst_surf, src_surf;
+    struct tegra_fence *explicit_fence;
+    struct tegra_fence *fence;
+    int err;
+
+    /*
+     * Source's data must be up-to-date, the old copy may be still sampled
+     * by a deferred 3d job.
+     */
+    tegra_exa_flush_deferred_operations(src, true, false, true);
+    tegra_exa_flush_deferred_operations(dst, true, true, false);
+
+    err = tegra_stream_begin(exa->cmds, exa->gr2d);
+    if (err < 0)
+        return false;
+
+    tegra_exa_2d_surface_from_pixmap(dst, &dst_surf);
+    tegra_exa_2d_surface_from_pixmap(src, &src_surf);
+
+    tegra_exa_copy_2d_emit_blit(exa->cmds, src->drawable.bitsPerPixel,
+                                &dst_surf, 0, 0, &src_surf, 0, 0,
+                                src->drawable.width, src->drawable.height);
+
+    if (exa->cmds->status != TEGRADRM_STREAM_CONSTRUCT) {
+        tegra_stream_cleanup(exa->cmds);
+        return false;
+    }
+
+    tegra_stream_end(exa->cmds);
+
+    tegra_exa_wait_pixmaps(TEGRA_3D, dst, 1, src);
+
+    explicit_fence = tegra_exa_get_explicit_fence(TEGRA_3D, dst, 1, src);
+    fence = tegra_exa_stream_submit(exa, TEGRA_2D, explicit_fence);
+    TEGRA_FENCE_PUT(explicit_fence);
+
+    tegra_exa_replace_pixmaps_fence(TEGRA_2D, fence, &exa->scratch, 0, 0,
+                                    dst, 1, src);
+
+    return true;
+}
+
+static void tegra_exa_detiled_copy_destroy(ScreenPtr screen,
+                                           struct tegra_detiled_copy *entry)
+{
+    struct tegra_pixmap *priv;
+
+    if (!entry->copy)
+        return;
+
+    priv = exaGetPixmapDriverPrivate(entry->copy);
+    priv->freezer_lockcnt--;
+
+    screen->DestroyPixmap(entry->copy);
+    entry->copy = NULL;
+    entry->pixmap = NULL;
+}
+
+static PixmapPtr tegra_exa_detiled_copy(struct tegra_exa *exa,
+                                        PixmapPtr pixmap)
+{
+    struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(pixmap);
+    ScreenPtr screen = pixmap->drawable.pScreen;
+    struct tegra_detiled_copy *entry = NULL;
+    struct tegra_pixmap *copy_priv;
+    PixmapPtr copy;
+    unsigned int i;
+
+    for (i = 0; i < TEGRA_DETILED_COPIES_NUM; i++) {
+        if (exa->detiled[i].pixmap == priv) {
+            entry = &exa->detiled[i];
+            break;
+        }
+    }
+
+    if (entry && entry->write_gen == priv->write_gen) {
+        exa->stats.num_detiled_copies_hits++;
+        goto done;
+    }
+
+    /* least recently used entry is replaced, it's not the other texture */
+    if (!entry) {
+        entry = &exa->detiled[0];
+
+        for (i = 1; i < TEGRA_DETILED_COPIES_NUM; i++) {
+            if (exa->detiled[i].last_use < entry->last_use)
+                entry = &exa->detiled[i];
+        }
+    }
+
+    entry->pixmap = NULL;
+    copy = entry->copy;
+
+    if (copy && (copy->drawable.width != pixmap->drawable.width ||
+                 copy->drawable.height != pixmap->drawable.height ||
+                 copy->drawable.depth != pixmap->drawable.depth ||
+                 copy->drawable.bitsPerPixel != pixmap->drawable.bitsPerPixel))
+        tegra_exa_detiled_copy_destroy(screen, entry);
+
+    if (!entry->copy) {
+        copy = screen->CreatePixmap(screen, pixmap->drawable.width,
+                                    pixmap->drawable.height,
+                                    pixmap->drawable.depth, 0);
+        if (!copy)
+            return NULL;
+
+        copy_priv = exaGetPixmapDriverPrivate(copy);
+        copy_priv->no_tiling = true;
+
+        tegra_exa_thaw_pixmap2(copy, THAW_ACCEL, THAW_ALLOC);
+
+        if (copy_priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK) {
+            screen->DestroyPixmap(copy);
+            return NULL;
+        }
+
+        /* copy shall never be compressed by the fridge */
+        copy_priv->freezer_lockcnt++;
+
+        entry->copy = copy;
+    }
+
+    if (!tegra_exa_detiled_copy_blit(exa, entry->copy, pixmap))
+        return NULL;
+
+    /* copy is written directly, bypassing the state tracking */
+    copy_priv = exaGetPixmapDriverPrivate(entry->copy);
+    copy_priv->state.alpha_0 = 0;
+    tegra_exa_solid_tiles_invalidate(copy_priv);
+
+    entry->pixmap = priv;
+    entry->write_gen = priv->write_gen;
+
+    exa->stats.num_detiled_copies++;
+    exa->stats.num_detiled_copies_bytes += tegra_exa_pixmap_size(priv);
+
+    DEBUG_MSG("priv %p copied to linear pixmap %p\n", priv, entry->copy);
+
+done:
+    entry->last_use = ++exa->detiled_use;
+
+    return entry->copy;
+}
+
+static void tegra_exa_release_detiled_copies(ScreenPtr screen,
+                                             struct tegra_exa *exa)
+{
+    unsigned int i;
+
+    for (i = 0; i < TEGRA_DETILED_COPIES_NUM; i++)
+        tegra_exa_detiled_copy_destroy(screen, &exa->detiled[i]);
+}
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -34,7 +34,8 @@ tegra_exa_prepare_optimized_solid_fill(PixmapPtr pixmap, Pixel color)
     if (tegra->in_2d_flush || priv->scanout)
         optimize = false;
 
-    if (tegra_exa_pixmap_is_busy(tegra, priv))
+    /* CPU access results in detiling of the data */
+    if (tegra_exa_pixmap_is_busy(tegra, priv) || priv->tiled)
         cpu_access = false;
 
     /*
@@ -48,6 +49,18 @@ tegra_exa_prepare_optimized_solid_fill(PixmapPtr pixmap, Pixel color)
         optimize = false;
     }
 
+    /* only plain fills are deferred or performed by CPU */
+    if (tegra->scratch.rop != GXcopy || tegra->scratch.xor_pass) {
+        /* raster operation reads the deferred solid-fill */
+        if (priv->state.solid_fill)
+            tegra_exa_flush_deferred_2d_operations(pixmap, true, false, false);
+
+        cpu_access = false;
+        optimize = false;
+
+        tegra->stats.num_2d_rop_ops++;
+    }
+
     tegra->scratch.color = color;
     tegra->scratch.optimize = optimize;
     tegra->scratch.cpu_access = cpu_access;
@@ -65,10 +78,13 @@ static bool tegra_exa_optimize_solid_op(PixmapPtr pixmap,
     struct tegra_exa *tegra = TegraPTR(scrn)->exa;
     unsigned int cpp = pixmap->drawable.bitsPerPixel >> 3;
     unsigned int bytes = (px2 - px1) * (py2 - py1) * cpp;
+    bool plain = tegra->scratch.rop == GXcopy && !tegra->scratch.xor_pass;
     bool alpha_0 = 0;
+    Pixel color;
 
-    if ((cpp == 4 && !(tegra->scratch.color & 0xff000000)) ||
-        (cpp == 1 && !(tegra->scratch.color & 0x00)))
+    if (!tegra->scratch.read_dst &&
+        ((cpp == 4 && !(tegra->scratch.color & 0xff000000)) ||
+         (cpp == 1 && !(tegra->scratch.color & 0x00))))
     {
         if (priv->state.alpha_0 || (px1 == 0 && py1 == 0 &&
             pixmap->drawable.width == px2 &&
@@ -95,15 +111,19 @@ static bool tegra_exa_optimize_solid_op(PixmapPtr pixmap,
         priv->state.solid_fill = 1;
         priv->state.alpha_0 = alpha_0;
 
+        tegra_exa_solid_tiles_update(pixmap, px1, py1, px2, py2,
+                                     true, tegra->scratch.color);
+
         return true;
     }
 
+    /* area is known to be filled with the same color already */
     if (tegra->scratch.optimize &&
-        priv->state.solid_fill &&
-        priv->state.solid_color == tegra->scratch.color &&
-        bytes < TEGRA_EXA_CPU_FILL_MIN_SIZE)
+        tegra_exa_solid_tiles_lookup(pixmap, px1, py1, px2, py2, &color) &&
+        color == tegra->scratch.color)
     {
         DEBUG_MSG("pixmap %p partial solid-fill optimized out\n", pixmap);
+        tegra->stats.num_2d_solid_tiles_fills_skipped++;
         return true;
     }
 
@@ -114,12 +134,18 @@ static bool tegra_exa_optimize_solid_op(PixmapPtr pixmap,
             tegra->scratch.cpu_access = false;
     }
 
+    tegra_exa_solid_tiles_update(pixmap, px1, py1, px2, py2,
+                                 plain, tegra->scratch.color);
+
     /*
      * It's much more optimal to perform small write-only operations on CPU
      * if GPU isn't touching pixmap. The job submission overhead is too big
      * + this allows to perform operation in parallel with GPU.
      */
-    if (tegra->scratch.cpu_access && bytes < TEGRA_EXA_CPU_FILL_MIN_SIZE &&
+    if (tegra->scratch.cpu_access &&
+        tegra_exa_cost_prefer_cpu_fill(tegra, priv, bytes,
+                                       tegra->scratch.cpu_ptr ||
+                                       tegra_exa_cost_pixmap_mapped(priv)) &&
         (tegra->scratch.cpu_ptr || tegra_exa_prepare_cpu_access(pixmap, EXA_PREPARE_DEST,
                                                                 &tegra->scratch.cpu_ptr,
                                                                 false)))
@@ -149,7 +175,8 @@ static void tegra_exa_complete_solid_fill_optimization(PixmapPtr pixmap)
     ScrnInfoPtr scrn = xf86ScreenToScrn(pixmap->drawable.pScreen);
     struct tegra_exa *tegra = TegraPTR(scrn)->exa;
 
-    if (tegra->scratch.ops)
+    /* batched operation flushes 3d jobs by itself */
+    if (tegra->scratch.ops && !tegra->scratch.batched)
         tegra_exa_flush_deferred_operations(pixmap, true, true, true);
 
     if (tegra->scratch.cpu_ptr) {
@@ -180,6 +207,11 @@ static void tegra_exa_perform_deferred_solid_fill(PixmapPtr pixmap, bool accel)
         tegra_exa_wrap_state(tegra, &tegra->opt_state[TEGRA_OPT_SOLID]);
         tegra_exa_fill_pixmap_data(priv, accel, priv->state.solid_color);
         tegra_exa_unwrap_state(tegra, &tegra->opt_state[TEGRA_OPT_SOLID]);
+
+        tegra_exa_solid_tiles_update(pixmap, 0, 0,
+                                     pixmap->drawable.width,
+                                     pixmap->drawable.height,
+                                     true, priv->state.solid_color);
     }
 }
 
@@ -216,6 +248,30 @@ static void tegra_exa_prepare_optimized_copy(PixmapPtr src_pixmap,
     if (DISABLE_2D_OPTIMIZATIONS)
         optimize = false;
 
+    /*
+     * Raster operations other than GXcopy and planemasked copies may read
+     * the destination, the deferred solid-fills shall be performed
+     * beforehand.
+     */
+    if (op != GXcopy || !EXA_PM_IS_SOLID(&dst_pixmap->drawable, planemask)) {
+        if (src_priv->state.solid_fill)
+            tegra_exa_flush_deferred_2d_operations(src_pixmap, true,
+                                                   false, false);
+
+        if (dst_priv->state.solid_fill)
+            tegra_exa_flush_deferred_2d_operations(dst_pixmap, true,
+                                                   false, false);
+
+        if (dst_priv->state.alpha_0)
+            DEBUG_MSG("pixmap %p copy canceled alpha_0\n", dst_pixmap);
+
+        dst_priv->state.alpha_0 = 0;
+        optimize = false;
+
+        if (op != GXcopy)
+            tegra->stats.num_2d_rop_ops++;
+    }
+
     if (optimize && src_priv->state.solid_fill) {
         if (tegra_exa_optimize_same_color_copy(src_priv, dst_priv)) {
             DEBUG_MSG("pixmap %p -> %p copy optimized out to a same-color solid-fill\n",
@@ -233,6 +289,7 @@ static void tegra_exa_prepare_optimized_copy(PixmapPtr src_pixmap,
         tegra_exa_unwrap_state(tegra, &tegra->opt_state[TEGRA_OPT_COPY]);
     }
 
+    tegra->scratch.tiles_fill = false;
     tegra->scratch.optimize = optimize;
 
     src_priv->freezer_lockcnt++;
@@ -241,32 +298,104 @@ static void tegra_exa_prepare_optimized_copy(PixmapPtr src_pixmap,
     ACCEL_MSG("\n");
 }
 
+static bool tegra_exa_optimize_solid_tiles_copy(PixmapPtr dst_pixmap,
+                                                int src_x, int src_y,
+                                                int dst_x, int dst_y,
+                                                int width, int height)
+{
+    ScrnInfoPtr scrn = xf86ScreenToScrn(dst_pixmap->drawable.pScreen);
+    struct tegra_exa *tegra = TegraPTR(scrn)->exa;
+    PixmapPtr src_pixmap = tegra->scratch.src;
+    Pixel color, dst_color;
+    bool prepared;
+
+    if (tegra->scratch.rop != GXcopy || tegra->scratch.planemask_tmp ||
+        !tegra_exa_solid_tiles_lookup(src_pixmap, src_x, src_y,
+                                      src_x + width, src_y + height, &color)) {
+        tegra_exa_solid_tiles_update(dst_pixmap, dst_x, dst_y,
+                                     dst_x + width, dst_y + height,
+                                     false, 0);
+        return false;
+    }
+
+    if (tegra_exa_solid_tiles_lookup(dst_pixmap, dst_x, dst_y,
+                                     dst_x + width, dst_y + height,
+                                     &dst_color) && dst_color == color) {
+        DEBUG_MSG("pixmap %p -> %p copy of solid tiles optimized out\n",
+                  src_pixmap, dst_pixmap);
+        tegra->stats.num_2d_solid_tiles_copies_skipped++;
+        return true;
+    }
+
+    /*
+     * Copy is turned into a fill of a separate job, which is fine as long
+     * as copy doesn't read the data written by the fill and the fill job
+     * isn't deferred. Only one color is handled per operation.
+     */
+    if (src_pixmap != dst_pixmap && !tegra->scratch.batched &&
+        (!tegra->scratch.tiles_fill || tegra->scratch.tiles_fill_color == color)) {
+        prepared = tegra->scratch.tiles_fill;
+
+        tegra_exa_wrap_state(tegra, &tegra->opt_state[TEGRA_OPT_COPY]);
+
+        if (!prepared)
+            prepared = tegra_exa_prepare_solid_2d(dst_pixmap, GXcopy,
+                                                  FB_ALLONES, color);
+        if (prepared)
+            tegra_exa_solid_2d(dst_pixmap, dst_x, dst_y,
+                               dst_x + width, dst_y + height);
+
+        tegra_exa_unwrap_state(tegra, &tegra->opt_state[TEGRA_OPT_COPY]);
+
+        if (prepared) {
+            DEBUG_MSG("pixmap %p -> %p copy of solid tiles optimized to a solid-fill\n",
+                      src_pixmap, dst_pixmap);
+            tegra->stats.num_2d_solid_tiles_copies_filled++;
+            tegra->scratch.tiles_fill_color = color;
+            tegra->scratch.tiles_fill = true;
+            return true;
+        }
+    }
+
+    tegra_exa_solid_tiles_update(dst_pixmap, dst_x, dst_y,
+                                 dst_x + width, dst_y + height,
+                                 true, color);
+
+    return false;
+}
+
 static bool tegra_exa_optimize_copy_op(PixmapPtr dst_pixmap,
+                                       int src_x, int src_y,
                                        int dst_x, int dst_y,
                                        int width, int height)
 {
     ScrnInfoPtr scrn = xf86ScreenToScrn(dst_pixmap->drawable.pScreen);
     struct tegra_exa *tegra = TegraPTR(scrn)->exa;
     PixmapPtr src_pixmap = tegra->scratch.src;
+    struct tegra_pixmap *src_priv = exaGetPixmapDriverPrivate(src_pixmap);
+    struct tegra_pixmap *dst_priv = exaGetPixmapDriverPrivate(dst_pixmap);
 
     ACCEL_MSG("\n");
 
-    if (tegra->scratch.optimize) {
-        struct tegra_pixmap *src_priv = exaGetPixmapDriverPrivate(src_pixmap);
-        struct tegra_pixmap *dst_priv = exaGetPixmapDriverPrivate(dst_pixmap);
+    if (tegra->scratch.optimize && src_priv->state.solid_fill) {
+        if (tegra_exa_optimize_same_color_copy(src_priv, dst_priv))
+            return true;
 
-        if (src_priv->state.solid_fill) {
-            if (tegra_exa_optimize_same_color_copy(src_priv, dst_priv))
-                return true;
+        tegra_exa_wrap_state(tegra, &tegra->opt_state[TEGRA_OPT_COPY]);
+        tegra_exa_solid_2d(dst_pixmap, dst_x, dst_y, dst_x + width, dst_y + height);
+        tegra_exa_unwrap_state(tegra, &tegra->opt_state[TEGRA_OPT_COPY]);
 
-            tegra_exa_wrap_state(tegra, &tegra->opt_state[TEGRA_OPT_COPY]);
-            tegra_exa_solid_2d(dst_pixmap, dst_x, dst_y, dst_x + width, dst_y + height);
-            tegra_exa_unwrap_state(tegra, &tegra->opt_state[TEGRA_OPT_COPY]);
+        return true;
+    }
 
-            return true;
-        } else if (dst_x == 0 && dst_y == 0 &&
-                   dst_pixmap->drawable.width == width &&
-                   dst_pixmap->drawable.height == height) {
+    if (tegra_exa_optimize_solid_tiles_copy(dst_pixmap, src_x, src_y,
+                                            dst_x, dst_y, width, height))
+        return true;
+
+    if (tegra->scratch.optimize) {
+        if (dst_x == 0 && dst_y == 0 &&
+            dst_pixmap->drawable.width == width &&
+            dst_pixmap->drawable.height == height) {
             tegra_exa_cancel_deferred_operations(dst_pixmap);
 
             if (dst_priv->state.alpha_0 && !src_priv->state.alpha_0)
@@ -307,11 +436,17 @@ static void tegra_exa_complete_copy_optimization(PixmapPtr dst_pixmap)
 
     if (tegra->scratch.optimize && src_priv->state.solid_fill) {
         tegra_exa_complete_solid_fill_copy_optimization(dst_pixmap);
-    } else if (tegra->scratch.ops) {
-        tegra_exa_flush_deferred_operations(src_pixmap, true, false, true);
-        tegra_exa_flush_deferred_operations(dst_pixmap, true, true, true);
+    } else {
+        if (tegra->scratch.tiles_fill)
+            tegra_exa_complete_solid_fill_copy_optimization(dst_pixmap);
+
+        if (tegra->scratch.ops && !tegra->scratch.batched) {
+            tegra_exa_flush_deferred_operations(src_pixmap, true, false, true);
+            tegra_exa_flush_deferred_operations(dst_pixmap, true, true, true);
+        }
     }
 
+    tegra->scratch.tiles_fill = false;
     tegra->scratch.optimize = false;
 
     src_priv->freezer_lockcnt--;
@@ -328,10 +463,25 @@ static void tegra_exa_flush_deferred_2d_operations(PixmapPtr pixmap,
     struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(pixmap);
     ScrnInfoPtr scrn = xf86ScreenToScrn(pixmap->drawable.pScreen);
     struct tegra_exa *tegra = TegraPTR(scrn)->exa;
+    struct tegra_pixmap_2d_state *entry;
 
     if (tegra->in_2d_flush)
         return;
 
+    /*
+     * Batched operations precede the deferred solid-fill, hence they
+     * shall be submitted first.
+     */
+    entry = tegra_exa_2d_state_lookup_pixmap(&tegra->gr2d_state, pixmap);
+    if (entry && ((flush_reads && entry->read) ||
+                  (flush_writes && entry->write) ||
+                  priv->state.solid_fill)) {
+        DEBUG_MSG("pixmap %p flush_reads %d flush_writes %d\n",
+                  pixmap, flush_reads, flush_writes);
+
+        tegra_exa_flush_deferred_2d_state(&tegra->gr2d_state);
+    }
+
     if (DISABLE_2D_OPTIMIZATIONS) {
         assert(!priv->state.solid_fill);
         return;
@@ -345,4 +495,483 @@ static void tegra_exa_flush_deferred_2d_operations(PixmapPtr pixmap,
     tegra->in_2d_flush = false;
 }
 
+/*
+ * Tiny fills and copies are recorded into exa->gr2d_state instead of
+ * submitting a GR2D job per EXA Prepare/Done cycle. The recorded operations
+ * are emitted into a single job on submission, pixmap fences are replaced
+ * with the fence of that job.
+ */
+static bool tegra_exa_2d_state_begin_op(struct tegra_exa *tegra,
+                                        PixmapPtr dst, PixmapPtr src)
+{
+    struct tegra_pixmap *dst_priv = exaGetPixmapDriverPrivate(dst);
+    struct tegra_2d_state *state = &tegra->gr2d_state;
+    struct tegra_pixmap *src_priv;
+    struct tegra_2d_op *op;
+    unsigned int i;
+
+    if (DISABLE_2D_OPTIMIZATIONS || state->recording)
+        return false;
+
+    /* nested jobs of optimization passes are submitted immediately */
+    for (i = 0; i < TEGRA_OPT_NUM; i++) {
+        if (tegra->opt_state[i].wrapcnt)
+            return false;
+    }
+
+    /* exported BOs are accessed by other clients, don't hold them */
+    if (dst_priv->dri)
+        return false;
+
+    if (src) {
+        src_priv = exaGetPixmapDriverPrivate(src);
+        if (src_priv->dri)
+            return false;
+    }
+
+    state->exa = tegra;
+
+    if (state->num_ops == TEGRA_ARRAY_SIZE(state->ops) ||
+        state->num_rects == TEGRA_ARRAY_SIZE(state->rects) ||
+        state->num_pixmaps + 2 > TEGRA_ARRAY_SIZE(state->pixmaps))
+        tegra_exa_flush_deferred_2d_state(state);
+
+    op = &state->ops[state->num_ops];
+    op->dst = dst;
+    op->src = src;
+    op->color = tegra->scratch.color;
+    op->xor_color = tegra->scratch.xor_color;
+    op->xor_pass = tegra->scratch.xor_pass;
+    op->rop = tegra->scratch.rop;
+    op->first_rect = state->num_rects;
+    op->num_rects = 0;
+    op->wait_fence = NULL;
+
+    state->recording = true;
+
+    return true;
+}
+
+static void tegra_exa_2d_state_add_rect(struct tegra_exa *tegra,
+                                        int src_x, int src_y,
+                                        int dst_x, int dst_y,
+                                        int width, int height)
+{
+    struct tegra_2d_state *state = &tegra->gr2d_state;
+    struct tegra_2d_op *op = &state->ops[state->num_ops];
+    struct tegra_2d_op split;
+    struct tegra_2d_rect *rect;
+
+    assert(state->recording);
+
+    if (state->num_rects == TEGRA_ARRAY_SIZE(state->rects)) {
+        /* operation that doesn't fit into the queue is split */
+        if (op->num_rects == TEGRA_ARRAY_SIZE(state->rects)) {
+            split = *op;
+
+            tegra_exa_2d_state_finish_op(tegra);
+            tegra_exa_flush_deferred_2d_state(state);
+
+            split.first_rect = 0;
+            split.num_rects = 0;
+
+            state->ops[state->num_ops] = split;
+            state->recording = true;
+        } else {
+            tegra_exa_flush_deferred_2d_state(state);
+        }
+
+        op = &state->ops[state->num_ops];
+    }
+
+    rect = &state->rects[state->num_rects++];
+    rect->src_x = src_x;
+    rect->src_y = src_y;
+    rect->dst_x = dst_x;
+    rect->dst_y = dst_y;
+    rect->width = width;
+    rect->height = height;
+
+    op->num_rects++;
+}
+
+static struct tegra_pixmap_2d_state *
+tegra_exa_2d_state_lookup_pixmap(struct tegra_2d_state *state,
+                                 PixmapPtr pixmap)
+{
+    struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(pixmap);
+    unsigned int i;
+
+    for (i = 0; i < state->num_pixmaps; i++) {
+        if (state->pixmaps[i].pixmap == priv)
+            return &state->pixmaps[i];
+    }
+
+    return NULL;
+}
+
+static void tegra_exa_2d_state_ref_pixmap(struct tegra_2d_state *state,
+                                          PixmapPtr pixmap, bool write)
+{
+    struct tegra_pixmap_2d_state *entry;
+    struct tegra_pixmap *priv;
+
+    if (!pixmap)
+        return;
+
+    priv = exaGetPixmapDriverPrivate(pixmap);
+    priv = tegra_exa_ref_pixmap(priv);
+    priv->freezer_lockcnt++;
+
+    entry = tegra_exa_2d_state_lookup_pixmap(state, pixmap);
+    if (!entry) {
+        entry = &state->pixmaps[state->num_pixmaps++];
+        entry->pixmap  = priv;
+        entry->refcnt  = 0;
+        entry->written = false;
+        entry->write   = false;
+        entry->read    = false;
+    }
+
+    entry->read  |= !write;
+    entry->write |= write;
+    entry->refcnt++;
+}
+
+static void tegra_exa_2d_state_unref_all_pixmaps(struct tegra_2d_state *state)
+{
+    struct tegra_pixmap *pixmap;
+    unsigned i;
+
+    for (i = 0; i < state->num_pixmaps; i++) {
+        pixmap = state->pixmaps[i].pixmap;
+
+        assert(state->pixmaps[i].refcnt);
+
+        while (state->pixmaps[i].refcnt--) {
+            pixmap->freezer_lockcnt--;
+
+            if (!state->pixmaps[i].refcnt && !pixmap->destroyed)
+                tegra_exa_cool_pixmap(pixmap->base, false);
+
+            /* see tegra_exa_optimized_3d_state_unref_all_pixmaps() */
+            if (!state->pixmaps[i].refcnt)
+                state->pixmaps[i].pixmap = NULL;
+
+            tegra_exa_unref_pixmap(pixmap);
+        }
+
+        state->pixmaps[i].refcnt = 0;
+    }
+
+    state->num_pixmaps = 0;
+}
+
+/*
+ * Returns the latest 3d fence that operation depends on, the returned
+ * fence shall be put once done with it.
+ */
+static struct tegra_fence *tegra_exa_2d_op_wait_fence(struct tegra_2d_op *op)
+{
+    struct tegra_pixmap *dst = exaGetPixmapDriverPrivate(op->dst);
+    struct tegra_fence *fence = NULL;
+    uint64_t last_seqno = 0;
+    struct tegra_pixmap *src;
+
+    SWAP_EXPLICIT_FENCE(fence, dst->fence_write[TEGRA_3D], last_seqno);
+    SWAP_EXPLICIT_FENCE(fence, dst->fence_read[TEGRA_3D], last_seqno);
+
+    if (op->src) {
+        src = exaGetPixmapDriverPrivate(op->src);
+        SWAP_EXPLICIT_FENCE(fence, src->fence_write[TEGRA_3D], last_seqno);
+    }
+
+    return fence;
+}
+
+static void tegra_exa_2d_state_finish_op(struct tegra_exa *tegra)
+{
+    struct tegra_2d_state *state = &tegra->gr2d_state;
+    struct tegra_2d_op *op = &state->ops[state->num_ops];
+    struct tegra_fence *explicit_fence;
+
+    assert(state->recording);
+    state->recording = false;
+
+    if (!op->num_rects) {
+        state->num_rects = op->first_rect;
+        return;
+    }
+
+    /* 3d jobs shall be submitted before the fences are taken */
+    tegra_exa_flush_deferred_3d_operations(op->dst, true, true, true);
+    if (op->src)
+        tegra_exa_flush_deferred_3d_operations(op->src, true, false, true);
+
+    /*
+     * If hardware is capable to await fences in the middle of the job,
+     * then each operation waits only for the 3d jobs it depends on.
+     */
+    if (tegra_stream_can_wait_fence(tegra->cmds))
+        op->wait_fence = tegra_exa_2d_op_wait_fence(op);
+    else
+        tegra_exa_wait_pixmaps(TEGRA_3D, op->dst, 1, op->src);
+
+    explicit_fence = tegra_exa_get_explicit_fence(TEGRA_3D, op->dst,
+                                                  1, op->src);
+
+    /* tegra_exa_get_explicit_fence() always bumps refcount */
+    if (explicit_fence == state->explicit_fence)
+        TEGRA_FENCE_PUT(explicit_fence);
+
+    state->explicit_fence = tegra_exa_select_latest_fence(2,
+                                                          state->explicit_fence,
+                                                          explicit_fence);
+
+    tegra_exa_2d_state_ref_pixmap(state, op->dst, true);
+    tegra_exa_2d_state_ref_pixmap(state, op->src, false);
+
+    /* pool pixmaps can't be moved until recorded operations are emitted */
+    if (!state->num_ops++)
+        tegra->pool_compaction_blockcnt++;
+
+    tegra->stats.num_2d_batched_ops++;
+}
+
+static void tegra_exa_2d_state_emit_ops(struct tegra_2d_state *state)
+{
+    struct tegra_pixmap_2d_state *src, *dst;
+    struct tegra_exa *exa = state->exa;
+    struct tegra_2d_rect *rect;
+    struct tegra_2d_op *op;
+    unsigned int i, k;
+
+    for (i = 0; i < state->num_ops; i++) {
+        op = &state->ops[i];
+        dst = tegra_exa_2d_state_lookup_pixmap(state, op->dst);
+        src = op->src ? tegra_exa_2d_state_lookup_pixmap(state, op->src) : NULL;
+
+        exa->scratch.rop = op->rop;
+        exa->scratch.color = op->color;
+        exa->scratch.xor_color = op->xor_color;
+        exa->scratch.xor_pass = op->xor_pass;
+        exa->scratch.read_dst = op->xor_pass ||
+                                tegra_exa_rop_reads_dst(op->rop);
+        exa->scratch.src = op->src;
+        exa->scratch.written_x0 = 0;
+        exa->scratch.written_y0 = 0;
+        exa->scratch.written_x1 = 0;
+        exa->scratch.written_y1 = 0;
+
+        if (op->wait_fence) {
+            if (tegra_stream_wait_fence(exa->cmds, op->wait_fence, false)) {
+                TEGRA_WAIT_FENCE(op->wait_fence);
+                exa->stats.num_cpu_fence_waits++;
+            } else {
+                exa->stats.num_hw_fence_waits++;
+            }
+        }
+
+        /* read-after-write of the previous operations */
+        if ((src && src->written) ||
+            (exa->scratch.read_dst && dst->written)) {
+            tegra_stream_sync(exa->cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE, true);
+
+            for (k = 0; k < state->num_pixmaps; k++)
+                state->pixmaps[k].written = false;
+        }
+
+        if (op->src) {
+            tegra_exa_copy_2d_emit_setup(exa->cmds, op->src, op->dst,
+                                         op->rop, TEGRA2D_IDENTITY);
+
+            for (k = 0; k < op->num_rects; k++) {
+                rect = &state->rects[op->first_rect + k];
+
+                tegra_exa_copy_2d_emit_rect(exa, op->dst,
+                                            rect->src_x, rect->src_y,
+                                            rect->dst_x, rect->dst_y,
+                                            rect->width, rect->height);
+            }
+        } else {
+            tegra_exa_solid_2d_emit_setup(exa->cmds, op->dst,
+                                          op->rop, op->color);
+
+            for (k = 0; k < op->num_rects; k++) {
+                rect = &state->rects[op->first_rect + k];
+
+                tegra_exa_solid_2d_emit_rect(exa,
+                                             rect->dst_x,
+                                             rect->dst_y,
+                                             rect->dst_x + rect->width,
+                                             rect->dst_y + rect->height);
+            }
+        }
+
+        dst->written = true;
+    }
+}
+
+static void tegra_exa_2d_state_reset(struct tegra_2d_state *state)
+{
+    struct tegra_2d_op op;
+    unsigned int i;
+
+    if (state->num_ops)
+        state->exa->pool_compaction_blockcnt--;
+
+    for (i = 0; i < state->num_ops; i++) {
+        TEGRA_FENCE_PUT(state->ops[i].wait_fence);
+        state->ops[i].wait_fence = NULL;
+    }
+
+    TEGRA_FENCE_PUT(state->explicit_fence);
+    state->explicit_fence = NULL;
+
+    tegra_exa_2d_state_unref_all_pixmaps(state);
+
+    /* operation that is being recorded goes to the head of the queue */
+    if (state->recording) {
+        op = state->ops[state->num_ops];
+
+        memmove(state->rects, state->rects + op.first_rect,
+                op.num_rects * sizeof(state->rects[0]));
+
+        op.first_rect = 0;
+        state->ops[0] = op;
+    }
+
+    state->num_rects = state->recording ? state->ops[0].num_rects : 0;
+    state->num_ops = 0;
+}
+
+/* bands of the pixmap accessed by the recorded operations */
+static uint32_t tegra_exa_2d_state_pixmap_bands(struct tegra_2d_state *state,
+                                                struct tegra_pixmap *priv)
+{
+    struct tegra_2d_rect *rect;
+    struct tegra_2d_op *op;
+    uint32_t bands = 0;
+    unsigned int i, k;
+    bool src, dst;
+
+    for (i = 0; i < state->num_ops; i++) {
+        op = &state->ops[i];
+        dst = exaGetPixmapDriverPrivate(op->dst) == priv;
+        src = op->src && exaGetPixmapDriverPrivate(op->src) == priv;
+
+        for (k = 0; k < op->num_rects && (src || dst); k++) {
+            rect = &state->rects[op->first_rect + k];
+
+            if (dst)
+                bands |= tegra_exa_pixmap_bands(op->dst, rect->dst_y,
+                                                rect->height);
+            if (src)
+                bands |= tegra_exa_pixmap_bands(op->src, rect->src_y,
+                                                rect->height);
+        }
+    }
+
+    return bands;
+}
+
+static void tegra_exa_submit_deferred_2d_jobs(struct tegra_2d_state *state)
+{
+    struct tegra_exa *exa = state->exa;
+    struct tegra_pixmap *priv;
+    struct tegra_fence *fence;
+    uint32_t bands;
+    unsigned int i;
+    int err;
+
+    PROFILE_DEF(deferred_gr2d);
+
+    DEBUG_MSG("num_ops %u num_rects %u num_pixmaps %u\n",
+              state->num_ops, state->num_rects, state->num_pixmaps);
+
+    err = tegra_stream_begin(exa->cmds, exa->gr2d);
+    if (err < 0)
+        goto reset;
+
+    tegra_exa_2d_state_emit_ops(state);
+
+    if (exa->cmds->status != TEGRADRM_STREAM_CONSTRUCT) {
+        tegra_stream_cleanup(exa->cmds);
+        goto reset;
+    }
+
+    exa->stats.num_2d_batched_jobs_bytes += tegra_stream_pushbuf_size(exa->cmds);
+
+    tegra_stream_end(exa->cmds);
+
+    PROFILE_START(deferred_gr2d);
+    fence = tegra_exa_stream_submit(exa, TEGRA_2D, state->explicit_fence);
+    PROFILE_STOP(deferred_gr2d);
+
+    for (i = 0; i < state->num_pixmaps; i++) {
+        priv = state->pixmaps[i].pixmap;
+        bands = tegra_exa_2d_state_pixmap_bands(state, priv);
+
+        if (state->pixmaps[i].write)
+            tegra_exa_pixmap_add_fence_bands(priv->fence_write[TEGRA_2D],
+                                             &priv->bands_write[TEGRA_2D],
+                                             bands);
+
+        if (state->pixmaps[i].read)
+            tegra_exa_pixmap_add_fence_bands(priv->fence_read[TEGRA_2D],
+                                             &priv->bands_read[TEGRA_2D],
+                                             bands);
+
+        if (state->pixmaps[i].write &&
+            priv->fence_write[TEGRA_2D] != fence) {
+            TEGRA_FENCE_PUT(priv->fence_write[TEGRA_2D]);
+            priv->fence_write[TEGRA_2D] = TEGRA_FENCE_GET(fence, state);
+        }
+
+        if (state->pixmaps[i].read &&
+            priv->fence_read[TEGRA_2D] != fence) {
+            TEGRA_FENCE_PUT(priv->fence_read[TEGRA_2D]);
+            priv->fence_read[TEGRA_2D] = TEGRA_FENCE_GET(fence, state);
+        }
+    }
+
+    exa->stats.num_2d_batched_jobs++;
+reset:
+    tegra_exa_2d_state_reset(state);
+}
+
+static void tegra_exa_flush_deferred_2d_state(struct tegra_2d_state *state)
+{
+    struct tegra_exa *exa = state->exa;
+
+    if (!state->num_ops)
+        return;
+
+    /* the batch is submitted in own context, it never nests */
+    assert(!exa->opt_state[TEGRA_OPT_2D].wrapcnt);
+
+    if (exa->opt_state[TEGRA_OPT_2D].wrapcnt)
+        return;
+
+    DEBUG_MSG("flushing 2d state\n");
+
+    tegra_exa_wrap_state(exa, &exa->opt_state[TEGRA_OPT_2D]);
+    tegra_exa_submit_deferred_2d_jobs(state);
+    tegra_exa_unwrap_state(exa, &exa->opt_state[TEGRA_OPT_2D]);
+}
+
+static bool
+tegra_exa_pixmap_is_in_deferred_2d_state(struct tegra_2d_state *state,
+                                         struct tegra_pixmap *pixmap)
+{
+    unsigned int i;
+
+    for (i = 0; i < state->num_pixmaps; i++) {
+        if (state->pixmaps[i].pixmap == pixmap)
+            return true;
+    }
+
+    return false;
+}
+
 /* vim: set et sts=4 sw=4 ts=4: */
@@ -402,6 +402,8 @@ tegra_exa_submit_deferred_3d_jobs(struct tegra_3d_state *state)
     if (!state->num_jobs)
         return NULL;
 
+    tegra_exa_3d_state_emit_ops(state);
+
     exa->stats.num_3d_jobs_bytes += tegra_stream_pushbuf_size(state->cmds);
 
     tegra_stream_end(state->cmds);
@@ -475,7 +477,6 @@ static void tegra_exa_3d_state_ref_pixmap(struct tegra_3d_state *state,
         if (state->pixmaps[i].pixmap == priv) {
             state->pixmaps[i].read        |= !write;
             state->pixmaps[i].write       |= write;
-            state->pixmaps[i].cache_dirty |= write;
             state->pixmaps[i].refcnt++;
             return;
         }
@@ -637,6 +638,116 @@ tegra_exa_pixmap_3d_state_tex_cache_flushed(struct tegra_3d_state *state)
         state->pixmaps[i].cache_dirty = false;
 }
 
+static void
+tegra_exa_3d_state_tex_cache_written(struct tegra_3d_state *state,
+                                     PixmapPtr pixmap)
+{
+    unsigned int i;
+
+    if (DISABLE_3D_OPTIMIZATIONS)
+        return;
+
+    for (i = 0; i < state->num_pixmaps; i++) {
+        if (state->pixmaps[i].pixmap->base == pixmap) {
+            state->pixmaps[i].cache_dirty = true;
+            return;
+        }
+    }
+}
+
+static bool tegra_exa_3d_ops_depend(struct tegra_3d_op *first,
+                                    struct tegra_3d_op *second)
+{
+    PixmapPtr dst = first->state.dst.pix;
+
+    /* write-after-write and read-after-write */
+    if (dst == second->state.dst.pix ||
+        dst == second->state.src.pix ||
+        dst == second->state.mask.pix)
+        return true;
+
+    /* write-after-read */
+    dst = second->state.dst.pix;
+
+    if (dst == first->state.src.pix ||
+        dst == first->state.mask.pix)
+        return true;
+
+    return false;
+}
+
+static unsigned int tegra_exa_3d_op_affinity(struct tegra_3d_state *state,
+                                             struct tegra_3d_op *op)
+{
+    struct tegra_3d_draw_state *cur = &state->cur;
+    struct tegra_3d_draw_state *new = &op->state;
+    unsigned int affinity = 0;
+
+    /* render target change is the most expensive */
+    if (new->dst.pix == cur->dst.pix)
+        affinity += 4;
+
+    /* texture change invalidates texture cache */
+    if (new->src.pix && new->src.pix == cur->src.pix &&
+        !tegra_exa_3d_state_tex_cache_needs_flush(state, new->src.pix))
+        affinity += 2;
+
+    if (new->mask.pix && new->mask.pix == cur->mask.pix &&
+        !tegra_exa_3d_state_tex_cache_needs_flush(state, new->mask.pix))
+        affinity += 2;
+
+    if (new->prog == cur->prog)
+        affinity += 1;
+
+    return affinity;
+}
+
+/*
+ * Select the queued operation that shares most of the state with the
+ * previously emitted operation, operations may be reordered only if
+ * they don't depend on each other.
+ */
+static unsigned int
+tegra_exa_3d_state_next_op(struct tegra_3d_state *state)
+{
+    unsigned int affinity, best_affinity = 0;
+    unsigned int i, k, first, best;
+    bool ready;
+
+    for (first = 0; first < state->num_ops; first++) {
+        if (!state->ops[first].emitted)
+            break;
+    }
+
+    best = first;
+
+    if (DISABLE_3D_OPTIMIZATIONS)
+        return best;
+
+    for (i = first; i < state->num_ops; i++) {
+        if (state->ops[i].emitted)
+            continue;
+
+        for (k = first, ready = true; k < i && ready; k++) {
+            if (!state->ops[k].emitted &&
+                tegra_exa_3d_ops_depend(&state->ops[k], &state->ops[i]))
+                ready = false;
+        }
+
+        if (!ready)
+            continue;
+
+        affinity = tegra_exa_3d_op_affinity(state, &state->ops[i]);
+
+        if (i == first || affinity > best_affinity) {
+            best_affinity = affinity;
+            best = i;
+        }
+    }
+
+    return best;
+}
+
 static bool
 tegra_exa_pixmap_is_in_deferred_3d_state(struct tegra_3d_state *state,
                                          struct tegra_pixmap *pixmap)
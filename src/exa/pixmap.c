@@ -22,6 +22,10 @@
 
 #define TEGRA_MALLOC_TRIM_THRESHOLD     256
 
+#define DISABLE_FREELIST_REUSE          false
+#define TEGRA_FREELIST_CACHE_SIZE       (4 * 1024 * 1024)
+#define TEGRA_FREELIST_MAX_AGE          2
+
 static bool tegra_exa_pixmap_release_data(TegraPtr tegra,
                                           struct tegra_pixmap *priv);
 
@@ -32,6 +36,13 @@ static bool tegra_exa_pixmap_is_from_pool(PixmapPtr pix)
     return priv->type == TEGRA_EXA_PIXMAP_TYPE_POOL;
 }
 
+static bool tegra_exa_pixmap_is_tiled(PixmapPtr pix)
+{
+    struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(pix);
+
+    return priv->tiled;
+}
+
 static unsigned long tegra_exa_pixmap_offset(PixmapPtr pix)
 {
     struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(pix);
@@ -66,6 +77,9 @@ static void tegra_exa_trim_heap(struct tegra_exa *exa)
      * Default trimming threshold isn't good for us, that results in
      * a big amounts of wasted memory due to high fragmentation. Hence
      * manually enforce trimming of the heap when it makes sense.
+     *
+     * Only compressed pixmaps data is allocated from the heap, sysmem
+     * pixmaps data is kept in the arena, see mm_arena.c.
      */
 #ifdef __GLIBC__
     if (exa->release_count > TEGRA_MALLOC_TRIM_THRESHOLD) {
@@ -75,33 +89,159 @@ static void tegra_exa_trim_heap(struct tegra_exa *exa)
 #endif
 }
 
+static struct xorg_list *tegra_exa_pixmaps_freelist_bin(struct tegra_exa *exa,
+                                                        unsigned int type,
+                                                        unsigned int size)
+{
+    unsigned int bin = size ? 32 - __builtin_clz(size) : 0;
+
+    assert(type == TEGRA_EXA_PIXMAP_TYPE_BO ||
+           type == TEGRA_EXA_PIXMAP_TYPE_POOL);
+
+    return &exa->pixmaps_freelist[type - TEGRA_EXA_PIXMAP_TYPE_BO]
+                                 [min(bin, TEGRA_FREELIST_BINS - 1)];
+}
+
+static void tegra_exa_pixmaps_freelist_add(struct tegra_exa *exa,
+                                           struct tegra_pixmap *priv,
+                                           unsigned int size)
+{
+    struct xorg_list *bin = tegra_exa_pixmaps_freelist_bin(exa, priv->type,
+                                                           size);
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    xorg_list_append(&priv->freelist_entry, bin);
+    exa->pixmaps_freelist_size += size;
+    priv->freelist_size = size;
+    priv->last_use = time.tv_sec;
+}
+
 static void
 tegra_exa_destroy_freelist_pixmap(TegraPtr tegra, struct tegra_pixmap *priv)
 {
+    struct tegra_exa *exa = tegra->exa;
     bool released_data;
 
     TEGRA_PIXMAP_WAIT_ALL_FENCES(priv);
 
+    xorg_list_del(&priv->freelist_entry);
+    exa->pixmaps_freelist_size -= priv->freelist_size;
+
     released_data = tegra_exa_pixmap_release_data(tegra, priv);
     assert(released_data);
 
     DEBUG_MSG("priv %p type %u released %d refcnt %u\n",
               priv, priv->type, released_data, priv->refcnt);
 
-    xorg_list_del(&priv->freelist_entry);
     free(priv);
 }
 
+static bool tegra_exa_pixmaps_freelist_cached(TegraPtr tegra)
+{
+    return !DISABLE_FREELIST_REUSE && !tegra->exa_erase_pixmaps;
+}
+
+/*
+ * Idle pixmaps are kept on the freelist for a short while, allowing
+ * new pixmaps of the same size to adopt their storage. Bins are ordered
+ * by the insertion time, hence walk of a bin stops at the first idle
+ * pixmap that is young enough to be kept. Fences of different engines
+ * can't be ordered, busy pixmaps are skipped.
+ */
 static void tegra_exa_clean_up_pixmaps_freelist(TegraPtr tegra, bool force)
 {
+    struct tegra_exa *exa = tegra->exa;
     struct tegra_pixmap *pix, *tmp;
+    struct timespec time;
+    unsigned int i, k;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    for (i = 0; i < 2; i++) {
+        for (k = 0; k < TEGRA_FREELIST_BINS; k++) {
+            xorg_list_for_each_entry_safe(pix, tmp,
+                                          &exa->pixmaps_freelist[i][k],
+                                          freelist_entry) {
+                if (!force) {
+                    if (tegra_exa_pixmap_is_busy(exa, pix))
+                        continue;
+
+                    if (tegra_exa_pixmaps_freelist_cached(tegra) &&
+                        exa->pixmaps_freelist_size <= TEGRA_FREELIST_CACHE_SIZE &&
+                        time.tv_sec - pix->last_use < TEGRA_FREELIST_MAX_AGE)
+                        break;
+                }
+
+                tegra_exa_destroy_freelist_pixmap(tegra, pix);
+            }
+        }
+    }
+}
+
+/*
+ * Takes over the storage of an idle freelist pixmap, skipping pool
+ * allocation and BO creation.
+ */
+static bool tegra_exa_pixmap_allocate_from_freelist(TegraPtr tegra,
+                                                    struct tegra_pixmap *pixmap,
+                                                    unsigned int size)
+{
+    static const unsigned int types[] = {
+        TEGRA_EXA_PIXMAP_TYPE_POOL,
+        TEGRA_EXA_PIXMAP_TYPE_BO,
+    };
     struct tegra_exa *exa = tegra->exa;
+    struct tegra_pixmap *priv;
+    struct xorg_list *bin;
+    unsigned int i;
 
-    xorg_list_for_each_entry_safe(pix, tmp, &exa->pixmaps_freelist,
-                                  freelist_entry) {
-        if (force || !tegra_exa_pixmap_is_busy(exa, pix))
-            tegra_exa_destroy_freelist_pixmap(tegra, pix);
+    if (!tegra_exa_pixmaps_freelist_cached(tegra) ||
+        !pixmap->accel || pixmap->dri)
+        return false;
+
+    for (i = 0; i < TEGRA_ARRAY_SIZE(types); i++) {
+        bin = tegra_exa_pixmaps_freelist_bin(exa, types[i], size);
+
+        xorg_list_for_each_entry(priv, bin, freelist_entry) {
+            if (priv->freelist_size == size && !priv->tiled &&
+                !priv->scanout && !priv->dri &&
+                !tegra_exa_pixmap_is_busy(exa, priv))
+                goto adopt;
+        }
     }
+
+    return false;
+
+adopt:
+    /* fences are completed, drop them */
+    TEGRA_PIXMAP_WAIT_ALL_FENCES(priv);
+
+    xorg_list_del(&priv->freelist_entry);
+    exa->pixmaps_freelist_size -= priv->freelist_size;
+
+    if (priv->type == TEGRA_EXA_PIXMAP_TYPE_POOL)
+        mem_pool_entry_move(&pixmap->pool_entry, &priv->pool_entry);
+    else
+        pixmap->bo = priv->bo;
+
+    pixmap->type = priv->type;
+    pixmap->sparse = priv->sparse;
+
+    DEBUG_MSG("priv %p adopted storage of priv %p type %u size %u\n",
+              pixmap, priv, priv->type, size);
+
+    tegra_exa_readback_forget(exa, priv);
+    tegra_exa_readback_forget(exa, pixmap);
+    free(priv);
+
+    exa->stats.num_pixmaps_destroyed++;
+    exa->stats.num_pixmaps_allocations++;
+    exa->stats.num_pixmaps_allocations_freelist++;
+    exa->stats.num_pixmaps_allocations_freelist_bytes += size;
+
+    return true;
 }
 
 static bool
@@ -112,22 +252,32 @@ tegra_exa_pixmap_release_data(TegraPtr tegra, struct tegra_pixmap *priv)
     DEBUG_MSG("priv %p type %u refcnt %u destroyed %d cold %d\n",
               priv, priv->type, priv->refcnt, priv->destroyed, priv->cold);
 
+    assert(!tegra_exa_pixmap_is_in_deferred_2d_state(&exa->gr2d_state, priv));
     assert(!tegra_exa_pixmap_is_in_deferred_3d_state(&exa->gr3d_state, priv));
     assert(!priv->freezer_lockcnt);
     assert(!priv->refcnt);
     assert(priv->destroyed);
 
+    tegra_exa_release_solid_tiles(priv);
+    tegra_exa_readback_forget(exa, priv);
+    tegra_exa_detiled_copy_forget(exa, priv);
+
     if (priv->type == TEGRA_EXA_PIXMAP_TYPE_NONE) {
         if (priv->frozen) {
+            if (priv->compression_type == TEGRA_EXA_COMPRESSION_UNCOMPRESSED) {
+                tegra_exa_arena_free(exa, priv->compressed_data);
+            } else {
 #ifdef HAVE_JPEG
-            if (priv->compression_type == TEGRA_EXA_COMPRESSION_JPEG)
-                tjFree(priv->compressed_data);
-            else
+                if (priv->compression_type == TEGRA_EXA_COMPRESSION_JPEG)
+                    tjFree(priv->compressed_data);
+                else
 #endif
-                free(priv->compressed_data);
+                    free(priv->compressed_data);
+
+                exa->release_count++;
+            }
 
             priv->frozen = false;
-            exa->release_count++;
         }
 
         goto out_final;
@@ -140,8 +290,7 @@ tegra_exa_pixmap_release_data(TegraPtr tegra, struct tegra_pixmap *priv)
     }
 
     if (priv->type == TEGRA_EXA_PIXMAP_TYPE_FALLBACK) {
-        free(priv->fallback);
-        exa->release_count++;
+        tegra_exa_arena_free(exa, priv->fallback);
         goto out_final;
     }
 
@@ -167,7 +316,7 @@ tegra_exa_pixmap_release_data(TegraPtr tegra, struct tegra_pixmap *priv)
      * working with the pixmap, then pixmap will be released.
      */
     if (tegra_exa_pixmap_is_busy(exa, priv)) {
-        xorg_list_append(&priv->freelist_entry, &exa->pixmaps_freelist);
+        tegra_exa_pixmaps_freelist_add(exa, priv, tegra_exa_pixmap_size(priv));
 
         /* note that tegra_pixmap isn't released, but the base is gone now */
         priv->base = NULL;
@@ -267,7 +416,9 @@ static bool tegra_exa_pixmap_allocate_data(TegraPtr tegra,
     if (!usage_hint && tegra->exa_refrigerator)
         return true;
 
-    return (tegra_exa_pixmap_allocate_from_pool(tegra, pixmap, size) ||
+    return (tegra_exa_pixmap_allocate_tiled(tegra, pixmap, pitch, height, bpp) ||
+            tegra_exa_pixmap_allocate_from_freelist(tegra, pixmap, size) ||
+            tegra_exa_pixmap_allocate_from_pool(tegra, pixmap, size) ||
             tegra_exa_pixmap_allocate_from_bo(tegra, pixmap, size) ||
             tegra_exa_pixmap_allocate_from_sysmem(tegra, pixmap, size));
 }
@@ -286,6 +437,9 @@ static bool tegra_exa_pixmap_is_busy(struct tegra_exa *exa,
             return true;
     }
 
+    if (tegra_exa_pixmap_is_in_deferred_2d_state(&exa->gr2d_state, pixmap))
+        return true;
+
     if (tegra_exa_pixmap_is_in_deferred_3d_state(&exa->gr3d_state, pixmap))
         return true;
 
@@ -381,6 +535,12 @@ static bool tegra_exa_modify_pixmap_header(PixmapPtr pixmap, int width,
 
     priv->base = pixmap;
 
+    /* geometry of the solid tiles may change */
+    tegra_exa_release_solid_tiles(priv);
+    tegra_exa_readback_forget(tegra->exa, priv);
+    tegra_exa_detiled_copy_forget(tegra->exa, priv);
+    priv->write_gen++;
+
     if (pix_data) {
         if (pix_data == drmmode_map_front_bo(&tegra->drmmode)) {
             scanout = drmmode_get_front_bo(&tegra->drmmode);
@@ -465,6 +625,8 @@ static Bool tegra_exa_destroy_pixmap_wrapper(PixmapPtr pixmap)
         assert(!priv->destroyed);
         priv->destroyed = 1;
 
+        tegra_exa_readback_forget(exa, priv);
+
         /* block pixmap's freeing if we're using this pixmap */
         if (priv->refcnt > 1)
             return TRUE;
@@ -21,13 +21,170 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+static Pixel tegra_exa_solid_2d_apply_rop(int op, Pixel src, Pixel dst)
+{
+    switch (op) {
+    case GXclear:           return 0;
+    case GXand:             return src & dst;
+    case GXandReverse:      return src & ~dst;
+    case GXcopy:            return src;
+    case GXandInverted:     return ~src & dst;
+    case GXnoop:            return dst;
+    case GXxor:             return src ^ dst;
+    case GXor:              return src | dst;
+    case GXnor:             return ~(src | dst);
+    case GXequiv:           return ~(src ^ dst);
+    case GXinvert:          return ~dst;
+    case GXorReverse:       return src | ~dst;
+    case GXcopyInverted:    return ~src;
+    case GXorInverted:      return ~src | dst;
+    case GXnand:            return ~(src & dst);
+    case GXset:
+    default:                return ~0;
+    }
+}
+
+/*
+ * Fill color is the ROP's source, hence every raster operation is a function
+ * of the destination alone. The planemask is applied by reducing operation
+ * to (D & and_color) ^ xor_color, which is done by a GXand pass followed by
+ * a GXxor pass in a general case.
+ */
+static void tegra_exa_solid_2d_setup_rop(struct tegra_exa_scratch *scratch,
+                                         PixmapPtr pixmap, int op,
+                                         Pixel planemask, Pixel color)
+{
+    unsigned int bpp = pixmap->drawable.bitsPerPixel;
+    Pixel mask = bpp < 32 ? (1u << bpp) - 1 : FB_ALLONES;
+    Pixel and_color, xor_color;
+
+    color &= mask;
+
+    scratch->xor_pass = false;
+
+    if (EXA_PM_IS_SOLID(&pixmap->drawable, planemask)) {
+        switch (op) {
+        case GXclear:
+            op = GXcopy;
+            color = 0;
+            break;
+        case GXset:
+            op = GXcopy;
+            color = mask;
+            break;
+        case GXcopyInverted:
+            op = GXcopy;
+            color = ~color & mask;
+            break;
+        }
+    } else {
+        planemask &= mask;
+
+        xor_color = tegra_exa_solid_2d_apply_rop(op, color, 0) & planemask;
+        and_color = tegra_exa_solid_2d_apply_rop(op, color, mask) & planemask;
+        and_color = ((and_color ^ xor_color) | ~planemask) & mask;
+
+        if (!xor_color) {
+            op = GXand;
+            color = and_color;
+        } else if (and_color == mask) {
+            op = GXxor;
+            color = xor_color;
+        } else {
+            op = GXand;
+            color = and_color;
+            scratch->xor_color = xor_color;
+            scratch->xor_pass = true;
+        }
+    }
+
+    scratch->rop = op;
+    scratch->color = color;
+    scratch->read_dst = scratch->xor_pass || tegra_exa_rop_reads_dst(op);
+}
+
+static void tegra_exa_solid_2d_emit_setup(struct tegra_stream *cmds,
+                                          PixmapPtr pixmap, int op,
+                                          Pixel color)
+{
+    unsigned int bpp = pixmap->drawable.bitsPerPixel;
+    uint32_t controlmain;
+
+    /*
+     * [17:16] destination color depth (0: 8 bpp, 1: 16 bpp, 2: 32 bpp)
+     * [6:6] fill mode
+     * [2:2] turbo-fill, destination isn't read
+     */
+    controlmain = ((bpp >> 4) << 16) | (1 << 6);
+
+    if (!tegra_exa_rop_reads_dst(op))
+        controlmain |= 1 << 2;
+
+    tegra_stream_prep(cmds, 15);
+    tegra_stream_push_setclass(cmds, HOST1X_CLASS_GR2D);
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x9, 0x9));
+    tegra_stream_push(cmds, 0x0000003a); /* trigger */
+    tegra_stream_push(cmds, 0x00000000); /* cmdsel */
+    tegra_stream_push(cmds, HOST1X_OPCODE_NONINCR(0x35, 1));
+    tegra_stream_push(cmds, color);
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x1e, 0x7));
+    tegra_stream_push(cmds, 0x00000000); /* controlsecond */
+    tegra_stream_push(cmds, controlmain);
+    tegra_stream_push(cmds, rop3[op]); /* ropfade */
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x2b, 0x9));
+    tegra_stream_push_reloc(cmds, tegra_exa_pixmap_bo(pixmap),
+                            tegra_exa_pixmap_offset(pixmap), true,
+                            tegra_exa_pixmap_is_from_pool(pixmap));
+    tegra_stream_push(cmds, exaGetPixmapPitch(pixmap));
+    tegra_stream_push(cmds, HOST1X_OPCODE_NONINCR(0x46, 1));
+    tegra_stream_push(cmds, /* tilemode */
+                      tegra_exa_2d_tilemode(NULL, pixmap));
+}
+
+static void tegra_exa_solid_2d_emit_rect(struct tegra_exa *tegra,
+                                         int px1, int py1, int px2, int py2)
+{
+    struct tegra_exa_scratch *scratch = &tegra->scratch;
+    struct tegra_stream *cmds = tegra->cmds;
+
+    if (scratch->read_dst)
+        tegra_exa_copy_2d_sync_read(tegra, px1, py1, px2 - px1, py2 - py1);
+
+    tegra_stream_prep(cmds, 3);
+    tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x38, 0x5));
+    tegra_stream_push(cmds, (py2 - py1) << 16 | (px2 - px1));
+    tegra_stream_push(cmds, py1 << 16 | px1);
+
+    /* second pass reads the result of the first one */
+    if (scratch->xor_pass) {
+        tegra_stream_sync(cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE, true);
+
+        tegra_stream_prep(cmds, 11);
+        tegra_stream_push(cmds, HOST1X_OPCODE_NONINCR(0x35, 1));
+        tegra_stream_push(cmds, scratch->xor_color);
+        tegra_stream_push(cmds, HOST1X_OPCODE_NONINCR(0x20, 1));
+        tegra_stream_push(cmds, rop3[GXxor]); /* ropfade */
+        tegra_stream_push(cmds, HOST1X_OPCODE_MASK(0x38, 0x5));
+        tegra_stream_push(cmds, (py2 - py1) << 16 | (px2 - px1));
+        tegra_stream_push(cmds, py1 << 16 | px1);
+        tegra_stream_push(cmds, HOST1X_OPCODE_NONINCR(0x35, 1));
+        tegra_stream_push(cmds, scratch->color);
+        tegra_stream_push(cmds, HOST1X_OPCODE_NONINCR(0x20, 1));
+        tegra_stream_push(cmds, rop3[scratch->rop]); /* ropfade */
+
+        tegra->stats.num_2d_two_pass_fills++;
+    }
+
+    if (scratch->read_dst)
+        tegra_exa_copy_2d_written(tegra, px1, py1, px2 - px1, py2 - py1);
+}
+
 static bool
 tegra_exa_prepare_solid_2d(PixmapPtr pixmap, int op, Pixel planemask,
                            Pixel color)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pixmap->drawable.pScreen);
     struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(pixmap);
-    unsigned int bpp = pixmap->drawable.bitsPerPixel;
     struct tegra_exa *tegra = TegraPTR(pScrn)->exa;
     int err;
 
@@ -37,33 +194,28 @@ tegra_exa_prepare_solid_2d(PixmapPtr pixmap, int op, Pixel planemask,
               pixmap->drawable.height,
               color, priv->scanout);
 
-    /*
-     * It should be possible to support this, but let's bail for now
-     */
-    if (planemask != FB_ALLONES) {
-        FALLBACK_MSG("unsupported planemask 0x%08lx\n", planemask);
-        return false;
-    }
-
-    /*
-     * It should be possible to support all GX* raster operations given the
-     * mapping in the rop3 table, but none other than GXcopy have been
-     * validated.
-     */
-    if (op != GXcopy) {
-        FALLBACK_MSG("unsupported operation %d\n", op);
-        return false;
-    }
-
     tegra_exa_thaw_pixmap2(pixmap, THAW_ACCEL, THAW_ALLOC);
 
+    tegra_exa_solid_2d_setup_rop(&tegra->scratch, pixmap, op, planemask,
+                                 color);
+
+    tegra->scratch.batched = false;
     tegra->scratch.ops = 0;
+    tegra->scratch.dst_bands = 0;
+    tegra->scratch.src_bands = 0;
+    tegra->scratch.written_x0 = 0;
+    tegra->scratch.written_y0 = 0;
+    tegra->scratch.written_x1 = 0;
+    tegra->scratch.written_y1 = 0;
 
     if (priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK) {
         if (pixmap->drawable.width == 1 &&
-            pixmap->drawable.height == 1) {
+            pixmap->drawable.height == 1 &&
+            tegra->scratch.rop == GXcopy && !tegra->scratch.xor_pass) {
                 void *ptr = priv->fallback;
 
+                color = tegra->scratch.color;
+
                 switch (pixmap->drawable.bitsPerPixel) {
                 case 8:
                     *((CARD8*) ptr) = color;
@@ -85,38 +237,26 @@ tegra_exa_prepare_solid_2d(PixmapPtr pixmap, int op, Pixel planemask,
         return false;
     }
 
-    err = tegra_stream_begin(tegra->cmds, tegra->gr2d);
-    if (err < 0)
-        return false;
-
-    tegra_stream_prep(tegra->cmds, 15);
-    tegra_stream_push_setclass(tegra->cmds, HOST1X_CLASS_GR2D);
-    tegra_stream_push(tegra->cmds, HOST1X_OPCODE_MASK(0x9, 0x9));
-    tegra_stream_push(tegra->cmds, 0x0000003a); /* trigger */
-    tegra_stream_push(tegra->cmds, 0x00000000); /* cmdsel */
-    tegra_stream_push(tegra->cmds, HOST1X_OPCODE_NONINCR(0x35, 1));
-    tegra_stream_push(tegra->cmds, color);
-    tegra_stream_push(tegra->cmds, HOST1X_OPCODE_MASK(0x1e, 0x7));
-    tegra_stream_push(tegra->cmds, 0x00000000); /* controlsecond */
-    tegra_stream_push(tegra->cmds, /* controlmain */
-                      ((bpp >> 4) << 16) |  /* bytes per pixel */
-                      (1 << 6) |            /* fill mode */
-                      (1 << 2)              /* turbo-fill */);
-    tegra_stream_push(tegra->cmds, rop3[op]); /* ropfade */
-    tegra_stream_push(tegra->cmds, HOST1X_OPCODE_MASK(0x2b, 0x9));
-    tegra_stream_push_reloc(tegra->cmds, tegra_exa_pixmap_bo(pixmap),
-                            tegra_exa_pixmap_offset(pixmap), true,
-                            tegra_exa_pixmap_is_from_pool(pixmap));
-    tegra_stream_push(tegra->cmds, exaGetPixmapPitch(pixmap));
-    tegra_stream_push(tegra->cmds, HOST1X_OPCODE_NONINCR(0x46, 1));
-    tegra_stream_push(tegra->cmds, 0); /* non-tiled */
-
-    if (tegra->cmds->status != TEGRADRM_STREAM_CONSTRUCT) {
-        tegra_stream_cleanup(tegra->cmds);
-        return false;
+    /* 1x1 pixmap skips Solid() and DoneSolid(), see below */
+    if (pixmap->drawable.width != 1 || pixmap->drawable.height != 1)
+        tegra->scratch.batched = tegra_exa_2d_state_begin_op(tegra, pixmap,
+                                                             NULL);
+    if (!tegra->scratch.batched) {
+        err = tegra_stream_begin(tegra->cmds, tegra->gr2d);
+        if (err < 0)
+            return false;
+
+        tegra_exa_solid_2d_emit_setup(tegra->cmds, pixmap,
+                                      tegra->scratch.rop,
+                                      tegra->scratch.color);
+
+        if (tegra->cmds->status != TEGRADRM_STREAM_CONSTRUCT) {
+            tegra_stream_cleanup(tegra->cmds);
+            return false;
+        }
     }
 
-    tegra_exa_prepare_optimized_solid_fill(pixmap, color);
+    tegra_exa_prepare_optimized_solid_fill(pixmap, tegra->scratch.color);
 
     return true;
 }
@@ -132,14 +272,16 @@ tegra_exa_solid_2d(PixmapPtr pixmap, int px1, int py1, int px2, int py2)
 
     ACCEL_MSG("%dx%d w:h %d:%d\n", px1, py1, px2 - px1, py2 - py1);
 
+    tegra->scratch.dst_bands |= tegra_exa_pixmap_bands(pixmap, py1, py2 - py1);
+
     if (tegra_exa_optimize_solid_op(pixmap, px1, py1, px2, py2))
         return;
 
-    tegra_stream_prep(tegra->cmds, 3);
-    tegra_stream_push(tegra->cmds, HOST1X_OPCODE_MASK(0x38, 0x5));
-    tegra_stream_push(tegra->cmds, (py2 - py1) << 16 | (px2 - px1));
-    tegra_stream_push(tegra->cmds, py1 << 16 | px1);
-    tegra_stream_sync(tegra->cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE, true);
+    if (tegra->scratch.batched)
+        tegra_exa_2d_state_add_rect(tegra, 0, 0, px1, py1,
+                                    px2 - px1, py2 - py1);
+    else
+        tegra_exa_solid_2d_emit_rect(tegra, px1, py1, px2, py2);
 
     tegra->scratch.ops++;
 }
@@ -158,7 +300,9 @@ static void tegra_exa_done_solid_2d(PixmapPtr pixmap)
 
     tegra_exa_complete_solid_fill_optimization(pixmap);
 
-    if (tegra->scratch.ops && tegra->cmds->status == TEGRADRM_STREAM_CONSTRUCT) {
+    if (tegra->scratch.batched) {
+        tegra_exa_2d_state_finish_op(tegra);
+    } else if (tegra->scratch.ops && tegra->cmds->status == TEGRADRM_STREAM_CONSTRUCT) {
         tegra->stats.num_2d_solid_jobs_bytes += tegra_stream_pushbuf_size(tegra->cmds);
         tegra_stream_end(tegra->cmds);
 
@@ -173,6 +317,7 @@ static void tegra_exa_done_solid_2d(PixmapPtr pixmap)
         TEGRA_FENCE_PUT(explicit_fence);
 
         tegra_exa_replace_pixmaps_fence(TEGRA_2D, fence, &tegra->scratch,
+                                        tegra->scratch.dst_bands, 0,
                                         pixmap, 0);
 
         tegra->stats.num_2d_solid_jobs++;
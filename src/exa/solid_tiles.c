@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define DISABLE_SOLID_TILES         false
+
+/*
+ * Pixmap is split into a coarse grid of tiles, each tile knows whether it's
+ * completely filled with a solid color. The grid describes the content of
+ * pixmap as seen by the next recorded operation, i.e. it's updated when
+ * operation is recorded and not when it's executed by hardware.
+ *
+ * The map is allocated lazily by the first solid fill, desktop pixmaps are
+ * usually flat backgrounds with a small content areas.
+ */
+#define TEGRA_SOLID_TILES_MIN_SIZE  64
+
+static bool tegra_exa_solid_tiles_eligible(PixmapPtr pixmap,
+                                           struct tegra_pixmap *priv)
+{
+    if (DISABLE_SOLID_TILES || DISABLE_2D_OPTIMIZATIONS)
+        return false;
+
+    /* exported pixmaps are written behind our back */
+    if (priv->scanout || priv->dri || !priv->accel)
+        return false;
+
+    if (pixmap->drawable.width < TEGRA_SOLID_TILES_MIN_SIZE ||
+        pixmap->drawable.height < TEGRA_SOLID_TILES_MIN_SIZE)
+        return false;
+
+    return true;
+}
+
+static inline int tegra_exa_solid_tile_size(int size)
+{
+    return (size + TEGRA_SOLID_TILES_DIM - 1) / TEGRA_SOLID_TILES_DIM;
+}
+
+static bool tegra_exa_solid_tiles_clip(PixmapPtr pixmap,
+                                       int *x1, int *y1, int *x2, int *y2)
+{
+    *x1 = max(*x1, 0);
+    *y1 = max(*y1, 0);
+    *x2 = min(*x2, pixmap->drawable.width);
+    *y2 = min(*y2, pixmap->drawable.height);
+
+    return *x1 < *x2 && *y1 < *y2;
+}
+
+static void tegra_exa_solid_tiles_update(PixmapPtr pixmap,
+                                         int x1, int y1, int x2, int y2,
+                                         bool solid, Pixel color)
+{
+    struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(pixmap);
+    struct tegra_solid_tiles *tiles = priv->state.tiles;
+    int width = pixmap->drawable.width;
+    int height = pixmap->drawable.height;
+    int tw, th, tx, ty;
+    unsigned int idx;
+    bool covered;
+
+    if (!tiles) {
+        if (!solid || !tegra_exa_solid_tiles_eligible(pixmap, priv))
+            return;
+
+        tiles = calloc(1, sizeof(*tiles));
+        if (!tiles)
+            return;
+
+        priv->state.tiles = tiles;
+    }
+
+    if (!tegra_exa_solid_tiles_clip(pixmap, &x1, &y1, &x2, &y2))
+        return;
+
+    tw = tegra_exa_solid_tile_size(width);
+    th = tegra_exa_solid_tile_size(height);
+
+    for (ty = y1 / th; ty <= (y2 - 1) / th; ty++) {
+        for (tx = x1 / tw; tx <= (x2 - 1) / tw; tx++) {
+            idx = ty * TEGRA_SOLID_TILES_DIM + tx;
+
+            covered = tx * tw >= x1 && ty * th >= y1 &&
+                      min((tx + 1) * tw, width) <= x2 &&
+                      min((ty + 1) * th, height) <= y2;
+
+            if (solid && covered) {
+                tiles->solid |= 1ULL << idx;
+                tiles->color[idx] = color;
+                continue;
+            }
+
+            /* partially covered tile keeps the same color */
+            if (solid && (tiles->solid & (1ULL << idx)) &&
+                tiles->color[idx] == color)
+                continue;
+
+            tiles->solid &= ~(1ULL << idx);
+        }
+    }
+}
+
+static bool tegra_exa_solid_tiles_lookup(PixmapPtr pixmap,
+                                         int x1, int y1, int x2, int y2,
+                                         Pixel *color)
+{
+    struct tegra_pixmap *priv = exaGetPixmapDriverPrivate(pixmap);
+    struct tegra_solid_tiles *tiles = priv->state.tiles;
+    int tw, th, tx, ty;
+    unsigned int idx;
+    bool first = true;
+    Pixel solid = 0;
+
+    if (priv->state.solid_fill) {
+        *color = priv->state.solid_color;
+        return true;
+    }
+
+    if (!tiles || !tiles->solid)
+        return false;
+
+    if (!tegra_exa_solid_tiles_clip(pixmap, &x1, &y1, &x2, &y2))
+        return false;
+
+    tw = tegra_exa_solid_tile_size(pixmap->drawable.width);
+    th = tegra_exa_solid_tile_size(pixmap->drawable.height);
+
+    for (ty = y1 / th; ty <= (y2 - 1) / th; ty++) {
+        for (tx = x1 / tw; tx <= (x2 - 1) / tw; tx++) {
+            idx = ty * TEGRA_SOLID_TILES_DIM + tx;
+
+            if (!(tiles->solid & (1ULL << idx)))
+                return false;
+
+            if (first)
+                solid = tiles->color[idx];
+            else if (tiles->color[idx] != solid)
+                return false;
+
+            first = false;
+        }
+    }
+
+    *color = solid;
+
+    return true;
+}
+
+static bool tegra_exa_pixmap_solid_color(PixmapPtr pixmap, Pixel *color)
+{
+    return tegra_exa_solid_tiles_lookup(pixmap, 0, 0,
+                                        pixmap->drawable.width,
+                                        pixmap->drawable.height,
+                                        color);
+}
+
+static void tegra_exa_solid_tiles_invalidate(struct tegra_pixmap *pixmap)
+{
+    if (pixmap->state.tiles)
+        pixmap->state.tiles->solid = 0;
+}
+
+static void tegra_exa_release_solid_tiles(struct tegra_pixmap *pixmap)
+{
+    free(pixmap->state.tiles);
+    pixmap->state.tiles = NULL;
+}
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -28,15 +28,20 @@
 #include "copy_2d.c"
 #include "solid_2d.c"
 #include "mm_pool.c"
+#include "cost_model.c"
 #include "composite_2d.c"
 #include "composite_3d.c"
 #include "composite.c"
+#include "glyph_atlas.c"
 #include "cpu_access.c"
 #include "load_screen.c"
+#include "mm_arena.c"
 #include "mm.c"
+#include "mm_tiling.c"
 #include "mm_fridge.c"
 #include "optimizations.c"
 #include "optimizations_2d.c"
+#include "solid_tiles.c"
 #include "optimizations_3d.c"
 #include "pixmap.c"
 
@@ -78,6 +83,9 @@ static void tegra_exa_block_handler(BLOCKHANDLER_ARGS_DECL)
     pScreen->BlockHandler(BLOCKHANDLER_ARGS);
     pScreen->BlockHandler = tegra_exa_block_handler;
 
+    tegra_exa_flush_deferred_2d_state(&exa->gr2d_state);
+    tegra_exa_readback_prefetch(tegra, exa);
+
     clock_gettime(CLOCK_MONOTONIC, &time);
     tegra_exa_freeze_pixmaps(tegra, time.tv_sec);
 
@@ -221,8 +229,12 @@ static void tegra_exa_pre_deinit(ScreenPtr screen)
     TegraPtr tegra = TegraPTR(scrn);
     struct tegra_exa *exa = tegra->exa;
 
+    tegra_exa_flush_deferred_2d_state(&exa->gr2d_state);
     tegra_exa_flush_deferred_3d_state(&exa->gr3d_state);
     tegra_exa_3d_state_reset(&exa->gr3d_state);
+    tegra_exa_release_glyph_atlas(screen, exa);
+    tegra_exa_release_detiled_copies(screen, exa);
+    tegra_exa_release_planemask_tmp(screen, exa);
     tegra_exa_unwrap_proc(screen);
 }
 
@@ -271,6 +283,10 @@ static int tegra_exa_init(ScreenPtr screen)
     }
 
     tegra_exa_init_features(scrn, exa, drm_ver);
+    tegra_exa_calibrate_cost_model(exa);
+    tegra_memcpy_vfp_init(tegra->exa_copy_threads);
+
+    INFO_MSG(scrn, "Using %s memcpy backend\n", tegra_memcpy_backend_name());
 
     return 0;
 
@@ -314,10 +330,21 @@ static void tegra_exa_stats(ScreenPtr screen)
     PRINT_STATS_2(num_pixmaps_allocations_bo_bytes);
     PRINT_STATS_1(num_pixmaps_allocations_bo_reused);
     PRINT_STATS_2(num_pixmaps_allocations_bo_reused_bytes);
+    PRINT_STATS_1(num_pixmaps_allocations_freelist);
+    PRINT_STATS_2(num_pixmaps_allocations_freelist_bytes);
     PRINT_STATS_1(num_pixmaps_allocations_pool);
     PRINT_STATS_2(num_pixmaps_allocations_pool_bytes);
     PRINT_STATS_1(num_pixmaps_allocations_fallback);
     PRINT_STATS_2(num_pixmaps_allocations_fallback_bytes);
+    PRINT_STATS_1(num_arena_slabs_allocated);
+    PRINT_STATS_1(num_arena_slabs_released);
+    PRINT_STATS_2(num_arena_purged_bytes);
+    PRINT_STATS_1(num_pixmaps_allocations_tiled);
+    PRINT_STATS_1(num_pixmaps_detiled);
+    PRINT_STATS_2(num_pixmaps_detiled_bytes);
+    PRINT_STATS_1(num_detiled_copies);
+    PRINT_STATS_2(num_detiled_copies_bytes);
+    PRINT_STATS_1(num_detiled_copies_hits);
     PRINT_STATS_1(num_pixmaps_resurrected);
     PRINT_STATS_2(num_pixmaps_resurrected_bytes);
     PRINT_STATS_1(num_pixmaps_compressed);
@@ -333,15 +360,62 @@ static void tegra_exa_stats(ScreenPtr screen)
     PRINT_STATS_2(num_screen_uploaded_bytes);
     PRINT_STATS_1(num_screen_downloads);
     PRINT_STATS_2(num_screen_downloaded_bytes);
+    PRINT_STATS_1(num_readback_prefetches);
+    PRINT_STATS_2(num_readback_prefetched_bytes);
+    PRINT_STATS_1(num_readback_hits);
     PRINT_STATS_1(num_2d_copy_jobs);
     PRINT_STATS_2(num_2d_copy_jobs_bytes);
     PRINT_STATS_2(num_2d_copy_jobs_to_scanout);
+    PRINT_STATS_1(num_2d_rotate_boxes);
+    PRINT_STATS_1(num_2d_rotate_boxes_merged);
+    PRINT_STATS_1(num_2d_rotate_boxes_skipped);
+    PRINT_STATS_1(num_2d_rotate_blits);
     PRINT_STATS_1(num_2d_solid_jobs);
     PRINT_STATS_2(num_2d_solid_jobs_bytes);
+    PRINT_STATS_1(num_2d_rop_ops);
+    PRINT_STATS_1(num_2d_two_pass_fills);
+    PRINT_STATS_1(num_2d_planemask_copies);
+    PRINT_STATS_1(num_2d_solid_tiles_fills_skipped);
+    PRINT_STATS_1(num_2d_solid_tiles_copies_skipped);
+    PRINT_STATS_1(num_2d_solid_tiles_copies_filled);
+    PRINT_STATS_1(num_2d_batched_ops);
+    PRINT_STATS_1(num_hw_fence_waits);
+    PRINT_STATS_1(num_cpu_fence_waits);
+    PRINT_STATS_1(num_cpu_fence_waits_skipped);
+    PRINT_STATS_1(num_2d_batched_jobs);
+    PRINT_STATS_2(num_2d_batched_jobs_bytes);
     PRINT_STATS_1(num_3d_jobs);
     PRINT_STATS_2(num_3d_jobs_bytes);
+    PRINT_STATS_1(num_3d_merged_rects);
+    PRINT_STATS_1(num_3d_scissored_rects);
+    PRINT_STATS_1(num_3d_fast_transformed_rects);
+    PRINT_STATS_1(num_3d_general_transformed_rects);
+    PRINT_STATS_1(num_3d_reordered_ops);
+    PRINT_STATS_1(num_3d_split_ops);
     PRINT_STATS_1(num_cpu_read_accesses);
     PRINT_STATS_1(num_cpu_write_accesses);
+    PRINT_STATS_1(num_cpu_copy_on_writes);
+    PRINT_STATS_2(num_cpu_copy_on_writes_bytes);
+    PRINT_STATS_1(num_cpu_shadow_accesses);
+    PRINT_STATS_2(num_cpu_shadow_writeback_bytes);
+    PRINT_STATS_1(num_glyph_atlas_hits);
+    PRINT_STATS_1(num_glyph_atlas_uploads);
+    PRINT_STATS_2(num_glyph_atlas_upload_bytes);
+    PRINT_STATS_1(num_glyph_atlas_resets);
+    PRINT_STATS_1(num_cost_cpu_choices);
+    PRINT_STATS_1(num_cost_2d_choices);
+    PRINT_STATS_1(num_cost_3d_choices);
+
+    INFO_MSG(scrn, "EXA cost model (%s):\n",
+             exa->cost.calibrated ? "calibrated" : "defaults");
+    PRINT_STATS_3(exa->cost.cpu_ns_per_kb);
+    PRINT_STATS_3(exa->cost.cpu_wc_ns_per_kb);
+    PRINT_STATS_3(exa->cost.cpu_map_ns);
+    PRINT_STATS_3(exa->cost.job_ns[TEGRA_2D]);
+    PRINT_STATS_3(exa->cost.job_ns[TEGRA_3D]);
+    PRINT_STATS_3(exa->cost.ns_per_kb[TEGRA_2D]);
+    PRINT_STATS_3(exa->cost.ns_per_kb[TEGRA_3D]);
+    PRINT_STATS_3(exa->cost.sync_ns);
 
 #ifdef FENCE_DEBUG
     PRINT_STATS_3(tegra_fences_created);
@@ -357,8 +431,11 @@ static void tegra_exa_deinit(ScreenPtr screen)
     struct tegra_exa *exa = tegra->exa;
 
     tegra_exa_deinit_optimizations(exa);
+    tegra_exa_release_cost_model(exa);
+    tegra_exa_release_readback(exa);
     tegra_exa_release_mm(tegra, exa);
     tegra_exa_deinit_gpu(exa);
+    tegra_memcpy_vfp_fini();
     tegra_exa_stats(screen);
     free(exa);
 
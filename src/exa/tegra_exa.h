@@ -27,15 +27,21 @@
 
 #include "exa.h"
 #include "gpu/gr3d.h"
+#include "memcpy-vfp/box_transform.h"
 #include "memcpy-vfp/memcpy_vfp.h"
+#include "memcpy-vfp/pixel_convert.h"
 
 static unsigned tegra_exa_pixmap_size(struct tegra_pixmap *pixmap);
 static unsigned long tegra_exa_pixmap_offset(PixmapPtr pix);
 static struct drm_tegra_bo *tegra_exa_pixmap_bo(PixmapPtr pix);
 static bool tegra_exa_pixmap_is_from_pool(PixmapPtr pix);
+static bool tegra_exa_pixmap_is_tiled(PixmapPtr pix);
 static bool tegra_exa_pixmap_is_busy(struct tegra_exa *exa,
                                      struct tegra_pixmap *pixmap);
 static void tegra_exa_clean_up_pixmaps_freelist(TegraPtr tegra, bool force);
+static void tegra_exa_pixmaps_freelist_add(struct tegra_exa *exa,
+                                           struct tegra_pixmap *priv,
+                                           unsigned int size);
 static struct tegra_pixmap *tegra_exa_ref_pixmap(struct tegra_pixmap *pixmap);
 static void tegra_exa_unref_pixmap(struct tegra_pixmap *pixmap);
 
@@ -43,6 +49,9 @@ static bool tegra_exa_prepare_cpu_access(PixmapPtr pix, int idx, void **ptr,
                                          bool cancel_optimizations);
 static void tegra_exa_finish_cpu_access(PixmapPtr pix, int idx);
 
+static void tegra_exa_readback_forget(struct tegra_exa *exa,
+                                      struct tegra_pixmap *priv);
+
 static bool
 tegra_exa_pixmap_allocate_from_pool(TegraPtr tegra,
                                     struct tegra_pixmap *pixmap,
@@ -56,6 +65,23 @@ static bool tegra_exa_pixmap_allocate_from_sysmem(TegraPtr tegra,
                                                   struct tegra_pixmap *pixmap,
                                                   unsigned int size);
 
+static bool tegra_exa_pixmap_allocate_from_freelist(TegraPtr tegra,
+                                                    struct tegra_pixmap *pixmap,
+                                                    unsigned int size);
+
+static bool tegra_exa_pixmap_allocate_tiled(TegraPtr tegra,
+                                            struct tegra_pixmap *pixmap,
+                                            unsigned int pitch,
+                                            unsigned int height,
+                                            unsigned int bpp);
+static void tegra_exa_detile_pixmap_data(struct tegra_pixmap *pixmap,
+                                         void *data);
+static void tegra_exa_detile_pixmap(PixmapPtr pixmap);
+static PixmapPtr tegra_exa_detiled_copy(struct tegra_exa *exa,
+                                        PixmapPtr pixmap);
+static void tegra_exa_detiled_copy_forget(struct tegra_exa *exa,
+                                          struct tegra_pixmap *priv);
+
 static int tegra_exa_init_mm(TegraPtr tegra, struct tegra_exa *exa);
 static void tegra_exa_release_mm(TegraPtr tegra, struct tegra_exa *exa);
 
@@ -68,6 +94,11 @@ static void tegra_exa_freeze_pixmaps(TegraPtr tegra, time_t time_sec);
 static void tegra_exa_fill_pixmap_data(struct tegra_pixmap *pixmap,
                                        bool accel, Pixel color);
 
+static void tegra_exa_wrap_state(struct tegra_exa *tegra,
+                                 struct tegra_optimization_state *state);
+static void tegra_exa_unwrap_state(struct tegra_exa *tegra,
+                                   struct tegra_optimization_state *state);
+
 static void tegra_exa_flush_deferred_operations(PixmapPtr pixmap,
                                                 bool accel,
                                                 bool flush_reads,
@@ -94,10 +125,36 @@ static void tegra_exa_prepare_optimized_copy(PixmapPtr pSrcPixmap,
                                              PixmapPtr pDstPixmap,
                                              int op, Pixel planemask);
 static bool tegra_exa_optimize_copy_op(PixmapPtr pDstPixmap,
+                                       int src_x, int src_y,
                                        int dst_x, int dst_y,
                                        int width, int height);
 static void tegra_exa_complete_copy_optimization(PixmapPtr pDstPixmap);
 
+static bool tegra_exa_2d_state_begin_op(struct tegra_exa *tegra,
+                                        PixmapPtr dst, PixmapPtr src);
+static void tegra_exa_2d_state_add_rect(struct tegra_exa *tegra,
+                                        int src_x, int src_y,
+                                        int dst_x, int dst_y,
+                                        int width, int height);
+static void tegra_exa_2d_state_finish_op(struct tegra_exa *tegra);
+static void tegra_exa_flush_deferred_2d_state(struct tegra_2d_state *state);
+static struct tegra_pixmap_2d_state *
+tegra_exa_2d_state_lookup_pixmap(struct tegra_2d_state *state,
+                                 PixmapPtr pixmap);
+static bool
+tegra_exa_pixmap_is_in_deferred_2d_state(struct tegra_2d_state *state,
+                                         struct tegra_pixmap *pixmap);
+
+static void tegra_exa_solid_tiles_update(PixmapPtr pixmap,
+                                         int x1, int y1, int x2, int y2,
+                                         bool solid, Pixel color);
+static bool tegra_exa_solid_tiles_lookup(PixmapPtr pixmap,
+                                         int x1, int y1, int x2, int y2,
+                                         Pixel *color);
+static bool tegra_exa_pixmap_solid_color(PixmapPtr pixmap, Pixel *color);
+static void tegra_exa_solid_tiles_invalidate(struct tegra_pixmap *pixmap);
+static void tegra_exa_release_solid_tiles(struct tegra_pixmap *pixmap);
+
 static void
 tegra_exa_optimize_texture_sampler(struct tegra_texture_state *tex);
 static const struct shader_program *
@@ -109,6 +166,8 @@ static void tegra_exa_release_optimized_3d_state(struct tegra_3d_state *state);
 static void tegra_exa_flush_deferred_3d_state(struct tegra_3d_state *state);
 static struct tegra_fence *
 tegra_exa_optimize_3d_submission(struct tegra_3d_state *state);
+static struct tegra_fence *
+tegra_exa_submit_deferred_3d_jobs(struct tegra_3d_state *state);
 static void
 tegra_exa_enter_optimization_3d_state(struct tegra_exa *exa);
 static void
@@ -120,8 +179,28 @@ tegra_exa_3d_state_tex_cache_needs_flush(struct tegra_3d_state *state,
                                          PixmapPtr pixmap);
 static void
 tegra_exa_pixmap_3d_state_tex_cache_flushed(struct tegra_3d_state *state);
+static void
+tegra_exa_3d_state_tex_cache_written(struct tegra_3d_state *state,
+                                     PixmapPtr pixmap);
+static unsigned int
+tegra_exa_3d_state_next_op(struct tegra_3d_state *state);
 static bool
 tegra_exa_pixmap_is_in_deferred_3d_state(struct tegra_3d_state *state,
                                          struct tegra_pixmap *pixmap);
 
+static PixmapPtr tegra_exa_glyph_atlas_lookup(struct tegra_exa *tegra,
+                                              int op,
+                                              PicturePtr mask_picture,
+                                              PixmapPtr pmask,
+                                              unsigned int *x,
+                                              unsigned int *y);
+static void tegra_exa_glyph_atlas_invalidate(struct tegra_pixmap *pixmap);
+
+static bool tegra_exa_cost_pixmap_mapped(struct tegra_pixmap *pixmap);
+static bool tegra_exa_cost_prefer_cpu_fill(struct tegra_exa *exa,
+                                           struct tegra_pixmap *pixmap,
+                                           unsigned int bytes, bool mapped);
+static enum host1x_engine
+tegra_exa_cost_select_composite_engine(struct tegra_exa *exa, PixmapPtr dst);
+
 #endif
@@ -362,6 +362,7 @@ void tgr3d_set_render_target(struct tegra_stream *cmds,
                              unsigned offset,
                              unsigned pixel_format,
                              unsigned pitch,
+                             bool tiled,
                              bool explicit_fencing)
 {
     uint32_t value = 0;
@@ -370,7 +371,7 @@ void tgr3d_set_render_target(struct tegra_stream *cmds,
 
     value |= TGR3D_VAL(RT_PARAMS, FORMAT, pixel_format);
     value |= TGR3D_VAL(RT_PARAMS, PITCH, pitch);
-    value |= TGR3D_BOOL(RT_PARAMS, TILED, 0);
+    value |= TGR3D_BOOL(RT_PARAMS, TILED, tiled);
 
     tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_RT_PARAMS(index), 1));
     tegra_stream_push(cmds, value);
@@ -463,6 +464,7 @@ void tgr3d_draw_primitives(struct tegra_stream *cmds,
      * Tegra30 has glitches without this, probably some cache / internal
      * state maintenance.
      */
+    tegra_stream_prep(cmds, 5);
     tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0xb00, 0x00000001));
     tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0xe41, 0x00000001));
     tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0xb00, 0x00000002));
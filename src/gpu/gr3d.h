@@ -105,6 +105,7 @@ void tgr3d_set_render_target(struct tegra_stream *cmds,
                              unsigned offset,
                              unsigned pixel_format,
                              unsigned pitch,
+                             bool tiled,
                              bool explicit_fencing);
 
 void tgr3d_enable_render_targets(struct tegra_stream *cmds, uint32_t mask);
@@ -92,6 +92,9 @@ struct tegra_stream {
                 enum drm_tegra_syncpt_cond cond,
                 bool keep_class);
     struct tegra_fence * (*current_fence)(struct tegra_stream *stream);
+    int (*wait_fence)(struct tegra_stream *stream,
+                      struct tegra_fence *fence,
+                      bool job_start);
 };
 
 /* Stream operations */
@@ -309,6 +312,41 @@ static inline int tegra_stream_sync(struct tegra_stream *stream,
     return stream->sync(stream, cond, keep_class);
 }
 
+static inline bool tegra_stream_can_wait_fence(struct tegra_stream *stream)
+{
+    return stream && stream->wait_fence;
+}
+
+/*
+ * Makes the job wait for the fence of other engine on hardware, instead of
+ * waiting for it on CPU. The wait is placed either at the current position
+ * of the cmdstream or before the whole job, the latter could be done after
+ * the job's construction is ended.
+ */
+static inline int tegra_stream_wait_fence(struct tegra_stream *stream,
+                                          struct tegra_fence *fence,
+                                          bool job_start)
+{
+    if (!stream || !stream->wait_fence)
+        return -1;
+
+    if (!fence)
+        return 0;
+
+    if (job_start) {
+        if (stream->status != TEGRADRM_STREAM_CONSTRUCT &&
+            stream->status != TEGRADRM_STREAM_READY)
+            return -1;
+    } else {
+        if (stream->status != TEGRADRM_STREAM_CONSTRUCT)
+            return -1;
+    }
+
+    TEGRA_FENCE_DEBUG_MSG(fence, "wait_in_stream");
+
+    return stream->wait_fence(stream, fence, job_start);
+}
+
 static inline int
 tegra_stream_push(struct tegra_stream *stream, uint32_t word)
 {
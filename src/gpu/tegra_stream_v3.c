@@ -510,6 +510,38 @@ tegra_stream_get_current_fence_v3(struct tegra_stream *base_stream)
     return f;
 }
 
+static int tegra_stream_wait_fence_v3(struct tegra_stream *base_stream,
+                                      struct tegra_fence *base_fence,
+                                      bool job_start)
+{
+    struct tegra_stream_v3 *stream = to_stream_v3(base_stream);
+    struct tegra_fence_v3 *f = to_fence_v3(base_fence);
+    uint32_t sp_id, threshold;
+    int ret;
+
+    /* fence of unsubmitted job can't be awaited */
+    if (!base_fence->active)
+        return -1;
+
+    /* fence is released once job is completed */
+    if (!f->fence)
+        return 0;
+
+    ret = drm_tegra_fence_get_syncpt_v3(f->fence, &sp_id, &threshold);
+    if (ret)
+        return -1;
+
+    ret = drm_tegra_job_push_wait_syncpt_v3(stream->job, sp_id, threshold,
+                                            job_start);
+    if (ret) {
+        stream->base.status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
+        ErrorMsg("drm_tegra_job_push_wait_syncpt_v3() failed %d\n", ret);
+        return -1;
+    }
+
+    return 0;
+}
+
 int tegra_stream_create_v3(struct tegra_stream **pstream,
                            struct drm_tegra *drm)
 {
@@ -552,6 +584,7 @@ int tegra_stream_create_v3(struct tegra_stream **pstream,
     stream->prep = tegra_stream_prep_v3;
     stream->sync = tegra_stream_sync_v3;
     stream->current_fence = tegra_stream_get_current_fence_v3;
+    stream->wait_fence = tegra_stream_wait_fence_v3;
 
     InfoMsg("success\n");
 
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <sys/auxv.h>
+
+#ifdef __arm__
+#include <asm/hwcap.h>
+#endif
+
+#include "box_transform.h"
+
+#ifdef __arm__
+static bool use_neon;
+#endif
+
+static inline int32_t scale_coord(int32_t scale, int32_t offset, int32_t coord)
+{
+    return (int32_t)((int64_t) scale * coord + offset) >> 16;
+}
+
+static void scale_boxes_c(int32_t *dst, const int32_t *src, int num,
+                          int32_t scale_x, int32_t scale_y,
+                          int32_t offset_x, int32_t offset_y)
+{
+    while (num-- > 0) {
+        dst[0] = scale_coord(scale_x, offset_x, src[0]);
+        dst[1] = scale_coord(scale_y, offset_y, src[1]);
+        dst[2] = scale_coord(scale_x, offset_x, src[2]);
+        dst[3] = scale_coord(scale_y, offset_y, src[3]);
+
+        dst += 4;
+        src += 4;
+    }
+}
+
+#ifdef __arm__
+/*
+ * d2 holds the x and y scales, q10 the offsets widened to 64 bits. Box is
+ * loaded into d0 (x0, y0) and d1 (x1, y1), the products are accumulated
+ * in 64 bits and narrowed back, like the C variant does.
+ */
+static void scale_boxes_neon(int32_t *dst, const int32_t *src, int num,
+                             int32_t scale_x, int32_t scale_y,
+                             int32_t offset_x, int32_t offset_y)
+{
+    asm volatile(
+        "   .fpu neon                   \n\t"
+        "   .arch armv7a                \n\t"
+        "   vmov  d2, %3, %4            \n\t"
+        "   vmov  d3, %5, %6            \n\t"
+        "   vmovl.s32 q10, d3           \n\t"
+        "0:                             \n\t"
+        "   vld1.32 {d0-d1}, [%1]!      \n\t"
+        "   vmull.s32 q8, d0, d2        \n\t"
+        "   vmull.s32 q9, d1, d2        \n\t"
+        "   vadd.i64 q8, q8, q10        \n\t"
+        "   vadd.i64 q9, q9, q10        \n\t"
+        "   vmovn.i64 d0, q8            \n\t"
+        "   vmovn.i64 d1, q9            \n\t"
+        "   vshr.s32 q0, q0, #16        \n\t"
+        "   vst1.32 {d0-d1}, [%0]!      \n\t"
+        "   subs  %2, %2, #1            \n\t"
+        "   bgt   0b                    \n\t"
+        : "+r" (dst), "+r" (src), "+r" (num)
+        : "r" (scale_x), "r" (scale_y), "r" (offset_x), "r" (offset_y)
+        : "cc", "memory", "d0", "d1", "d2", "d3",
+          "d16", "d17", "d18", "d19", "d20", "d21");
+}
+#endif
+
+void tegra_transform_scale_boxes(int32_t *dst, const int32_t *src, int num,
+                                 int32_t scale_x, int32_t scale_y,
+                                 int32_t offset_x, int32_t offset_y)
+{
+    if (num <= 0)
+        return;
+
+#ifdef __arm__
+    if (use_neon) {
+        scale_boxes_neon(dst, src, num, scale_x, scale_y, offset_x, offset_y);
+        return;
+    }
+#endif
+    scale_boxes_c(dst, src, num, scale_x, scale_y, offset_x, offset_y);
+}
+
+void tegra_transform_init(void)
+{
+#ifdef __arm__
+    use_neon = !!(getauxval(AT_HWCAP) & HWCAP_NEON);
+#endif
+}
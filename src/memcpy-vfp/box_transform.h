@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __TEGRA_BOX_TRANSFORM_H
+#define __TEGRA_BOX_TRANSFORM_H
+
+#include <stdint.h>
+
+/*
+ * Scale-and-translate transformation of box corners, every box is four
+ * integers x0, y0, x1, y1. Scale and offset are 16.16 fixed point, the
+ * result of (scale * coord + offset) is truncated to 32 bits and to an
+ * integer, giving the same result as pixman's point transformation for a
+ * matrix without rotation and projection. NEON variant transforms all four
+ * corner coordinates of a box at once. src and dst may be equal.
+ */
+void tegra_transform_scale_boxes(int32_t *dst, const int32_t *src, int num,
+                                 int32_t scale_x, int32_t scale_y,
+                                 int32_t offset_x, int32_t offset_y);
+
+/* selects NEON or C variant, invoked by tegra_memcpy_vfp_init() */
+void tegra_transform_init(void);
+
+#endif
@@ -0,0 +1,755 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Standalone throughput benchmark of the memcpy-vfp copying paths, it
+ * doesn't depend on Xorg and is built for the host architecture.
+ *
+ * Threaded screen copy: copying of a screen-sized area with differing
+ * pitches using the persistent worker pool versus spawning of threads
+ * for every line, like it was done before the pool existed.
+ *
+ * Backends: every copying backend supported by the CPU is measured across
+ * copy sizes and alignments for each of the memcpy-vfp access patterns.
+ * Uncacheable memory can't be obtained without the GPU driver, hence it's
+ * simulated by evicting the source from CPU caches before every copy,
+ * this way the loads go to DRAM like they do for the write-combined BOs.
+ * Destination always stays cacheable, hence the stores to "uncached"
+ * memory are only comparable between the backends.
+ *
+ * Conversions: pixel format converting kernels are validated against the
+ * reference formulas for all line lengths up to the unrolling tails and
+ * measured on a 1920 pixels line.
+ *
+ * Transforms: per-rect setup cost of the composite box transformation,
+ * the scale-and-translate kernel used for scaled composites is validated
+ * against the generic 3x3 fixed point point transformation, which is what
+ * the driver does for the general transforms, and both are measured.
+ *
+ * Usage: memcpy_bench [threads] [backend]
+ *
+ * Every copy is validated against the source, benchmark exits with a
+ * failure if data mismatches.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/sysinfo.h>
+
+#include "box_transform.h"
+#include "memcpy_vfp.h"
+#include "pixel_convert.h"
+
+#define BENCH_WIDTH         1920
+#define BENCH_HEIGHT        1080
+#define BENCH_CPP           4
+#define BENCH_SRC_PITCH     (BENCH_WIDTH * BENCH_CPP)
+#define BENCH_DST_PITCH     (BENCH_SRC_PITCH + 256)
+#define BENCH_MIN_TIME_NS   200000000ull
+#define BENCH_CELL_TIME_NS  20000000ull
+#define BENCH_MAX_SIZE      (4 * 1024 * 1024)
+#define BENCH_EVICT_SIZE    (32 * 1024 * 1024)
+#define BENCH_COLD_ITERS    16
+#define BENCH_BOXES         1024
+
+#define ARRAY_SIZE(x)       (sizeof(x) / sizeof((x)[0]))
+
+static const char * const bench_backend_names[] = {
+    "vfp", "neon", "avx2", "sse2", "generic",
+};
+
+static const int bench_sizes[] = {
+    1024, 16 * 1024, 256 * 1024, BENCH_MAX_SIZE,
+};
+
+struct bench_pattern {
+    const char *name;
+    void (*copy)(char *dst, const char *src, int size);
+    int src_offset;
+    int dst_offset;
+    bool cold_src;
+};
+
+/* every pattern matches how the copy is used by the driver */
+static const struct bench_pattern bench_patterns[] = {
+    {
+        .name       = "uncached -> cached",
+        .copy       = tegra_memcpy_vfp_aligned_dst_cached,
+        .cold_src   = true,
+    },
+    {
+        .name       = "cached -> uncached",
+        .copy       = tegra_memcpy_vfp_aligned_src_cached,
+    },
+    {
+        .name       = "uncached -> uncached",
+        .copy       = tegra_memcpy_vfp_aligned,
+        .cold_src   = true,
+    },
+    {
+        .name       = "unaligned, src +1",
+        .copy       = tegra_memcpy_vfp_unaligned,
+        .src_offset = 1,
+        .cold_src   = true,
+    },
+    {
+        .name       = "unaligned, dst +68",
+        .copy       = tegra_memcpy_vfp_unaligned,
+        .dst_offset = 68,
+        .cold_src   = true,
+    },
+};
+
+static char *bench_evict_buf;
+
+static unsigned int bench_threads;
+
+static uint64_t bench_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static char *bench_alloc(size_t size)
+{
+    void *ptr;
+
+    if (posix_memalign(&ptr, 4096, size)) {
+        fprintf(stderr, "failed to allocate %zu bytes\n", size);
+        exit(EXIT_FAILURE);
+    }
+
+    memset(ptr, 0, size);
+
+    return ptr;
+}
+
+static void bench_fill(char *buf, size_t size, unsigned int seed)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        buf[i] = (char)(i * 31 + seed);
+}
+
+static void bench_check(const char *what,
+                        const char *dst, int dst_pitch,
+                        const char *src, int src_pitch,
+                        int line_len, int height)
+{
+    while (height--) {
+        if (memcmp(dst, src, line_len)) {
+            fprintf(stderr, "%s: data mismatch\n", what);
+            exit(EXIT_FAILURE);
+        }
+
+        src += src_pitch;
+        dst += dst_pitch;
+    }
+}
+
+static void bench_pool_restart(void)
+{
+    tegra_memcpy_vfp_fini();
+    tegra_memcpy_vfp_init(bench_threads);
+}
+
+/* threaded copying as it was done before the workers pool */
+struct bench_legacy_cfg {
+    char *dst;
+    const char *src;
+    int size;
+};
+
+static void *bench_legacy_thread(void *arg)
+{
+    struct bench_legacy_cfg *cfg = arg;
+
+    tegra_copy_block_vfp(cfg->dst, cfg->src, cfg->size);
+
+    return NULL;
+}
+
+static void bench_legacy_threaded(char *dst, const char *src, int size)
+{
+    unsigned int threads_num = (size + 512) / 512;
+    struct bench_legacy_cfg cfgs[2];
+    pthread_t thread;
+    int part_size;
+
+    if (threads_num > 2)
+        threads_num = 2;
+
+    if (threads_num < 2 || get_nprocs() < 2) {
+        tegra_copy_block_vfp(dst, src, size);
+        return;
+    }
+
+    part_size = (size / 2) & ~127;
+
+    cfgs[0].dst  = dst;
+    cfgs[0].src  = src;
+    cfgs[0].size = part_size;
+    cfgs[1].dst  = dst + part_size;
+    cfgs[1].src  = src + part_size;
+    cfgs[1].size = part_size;
+
+    pthread_create(&thread, NULL, bench_legacy_thread, &cfgs[1]);
+    tegra_copy_block_vfp(cfgs[0].dst, cfgs[0].src, cfgs[0].size);
+
+    if (size > part_size * 2)
+        memcpy(dst + part_size * 2, src + part_size * 2, size - part_size * 2);
+
+    pthread_join(thread, NULL);
+}
+
+static void bench_screen_legacy(char *dst, const char *src)
+{
+    int y;
+
+    for (y = 0; y < BENCH_HEIGHT; y++)
+        bench_legacy_threaded(dst + y * BENCH_DST_PITCH,
+                              src + y * BENCH_SRC_PITCH,
+                              BENCH_WIDTH * BENCH_CPP);
+}
+
+static void bench_screen_pool(char *dst, const char *src)
+{
+    tegra_memcpy_vfp_threaded_2d(dst, BENCH_DST_PITCH,
+                                 src, BENCH_SRC_PITCH,
+                                 BENCH_WIDTH * BENCH_CPP, BENCH_HEIGHT,
+                                 tegra_copy_block_vfp_2d);
+}
+
+static double bench_screen(const char *name,
+                           void (*copy)(char *dst, const char *src),
+                           char *dst, const char *src)
+{
+    uint64_t bytes = 0, start, elapsed;
+    double mbps;
+
+    memset(dst, 0, BENCH_DST_PITCH * BENCH_HEIGHT);
+
+    start = bench_time_ns();
+
+    do {
+        copy(dst, src);
+        bytes += BENCH_WIDTH * BENCH_CPP * BENCH_HEIGHT;
+        elapsed = bench_time_ns() - start;
+    } while (elapsed < BENCH_MIN_TIME_NS);
+
+    bench_check(name, dst, BENCH_DST_PITCH, src, BENCH_SRC_PITCH,
+                BENCH_WIDTH * BENCH_CPP, BENCH_HEIGHT);
+
+    mbps = bytes * 1000.0 / elapsed;
+
+    printf("%-24s %10.1f MB/s\n", name, mbps);
+
+    return mbps;
+}
+
+static void bench_threaded_screen_copy(void)
+{
+    char *src = bench_alloc(BENCH_SRC_PITCH * BENCH_HEIGHT);
+    char *dst = bench_alloc(BENCH_DST_PITCH * BENCH_HEIGHT);
+    double legacy, pooled;
+
+    bench_fill(src, BENCH_SRC_PITCH * BENCH_HEIGHT, 1);
+
+    printf("threaded %dx%d screen copy, %s backend, %u threads:\n",
+           BENCH_WIDTH, BENCH_HEIGHT, tegra_memcpy_backend_name(),
+           bench_threads);
+
+    legacy = bench_screen("thread per line", bench_screen_legacy, dst, src);
+
+    /*
+     * Workers must not pick up the job of the previous pool after restart,
+     * like it happens on server regeneration.
+     */
+    bench_screen_pool(dst, src);
+    bench_pool_restart();
+
+    pooled = bench_screen("workers pool", bench_screen_pool, dst, src);
+
+    printf("%-24s %10.2fx\n\n", "speedup", pooled / legacy);
+
+    free(dst);
+    free(src);
+}
+
+static void bench_evict_caches(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < BENCH_EVICT_SIZE; i += 64)
+        bench_evict_buf[i]++;
+}
+
+static double bench_copy(const struct bench_pattern *pattern, int size,
+                         char *dst_buf, char *src_buf)
+{
+    const char *src = src_buf + pattern->src_offset;
+    char *dst = dst_buf + pattern->dst_offset;
+    uint64_t bytes = 0, elapsed = 0, start;
+    unsigned int iters = 0;
+
+    memset(dst_buf, 0, BENCH_MAX_SIZE + 256);
+
+    do {
+        if (pattern->cold_src)
+            bench_evict_caches();
+
+        start = bench_time_ns();
+        pattern->copy(dst, src, size);
+        elapsed += bench_time_ns() - start;
+        bytes += size;
+        iters++;
+    } while (pattern->cold_src ? iters < BENCH_COLD_ITERS :
+                                 elapsed < BENCH_CELL_TIME_NS);
+
+    bench_check(pattern->name, dst, 0, src, 0, size, 1);
+
+    return bytes * 1000.0 / (elapsed ?: 1);
+}
+
+static void bench_backend_copies(void)
+{
+    char *src = bench_alloc(BENCH_MAX_SIZE + 256);
+    char *dst = bench_alloc(BENCH_MAX_SIZE + 256);
+    unsigned int i, k;
+
+    bench_fill(src, BENCH_MAX_SIZE + 256, 2);
+
+    printf("%s backend, MB/s:\n", tegra_memcpy_backend_name());
+    printf("%-24s", "");
+
+    for (k = 0; k < ARRAY_SIZE(bench_sizes); k++)
+        printf(" %7dK", bench_sizes[k] / 1024);
+
+    printf("\n");
+
+    for (i = 0; i < ARRAY_SIZE(bench_patterns); i++) {
+        printf("%-24s", bench_patterns[i].name);
+
+        for (k = 0; k < ARRAY_SIZE(bench_sizes); k++)
+            printf(" %8.0f", bench_copy(&bench_patterns[i], bench_sizes[k],
+                                        dst, src));
+
+        printf("\n");
+    }
+
+    printf("\n");
+
+    free(dst);
+    free(src);
+}
+
+static void bench_backends(const char *only)
+{
+    unsigned int i;
+
+    bench_evict_buf = bench_alloc(BENCH_EVICT_SIZE);
+
+    for (i = 0; i < ARRAY_SIZE(bench_backend_names); i++) {
+        if (only && strcmp(only, bench_backend_names[i]))
+            continue;
+
+        setenv("TEGRA_MEMCPY_BACKEND", bench_backend_names[i], 1);
+        bench_pool_restart();
+
+        /* backend isn't supported by this CPU */
+        if (strcmp(tegra_memcpy_backend_name(), bench_backend_names[i]))
+            continue;
+
+        bench_backend_copies();
+        bench_threaded_screen_copy();
+    }
+
+    free(bench_evict_buf);
+}
+
+static void conv_swizzle(uint8_t *dst, const uint8_t *src, int num)
+{
+    tegra_convert_swizzle_8888((uint32_t *)dst, (const uint32_t *)src, num);
+}
+
+static void ref_swizzle(uint8_t *dst, const uint8_t *src, int num)
+{
+    for (; num--; dst += 4, src += 4) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        dst[3] = src[3];
+    }
+}
+
+static void conv_565_to_8888(uint8_t *dst, const uint8_t *src, int num)
+{
+    tegra_convert_565_to_8888((uint32_t *)dst, (const uint16_t *)src, num);
+}
+
+static void ref_565_to_8888(uint8_t *dst, const uint8_t *src, int num)
+{
+    unsigned int p;
+
+    for (; num--; dst += 4, src += 2) {
+        p = src[0] | src[1] << 8;
+
+        /* high bits are replicated into low bits, like pixman does */
+        dst[0] = (p & 0x1f) << 3 | (p & 0x1f) >> 2;
+        dst[1] = ((p >> 5) & 0x3f) << 2 | ((p >> 5) & 0x3f) >> 4;
+        dst[2] = (p >> 11) << 3 | (p >> 11) >> 2;
+        dst[3] = 0xff;
+    }
+}
+
+static void conv_8888_to_565(uint8_t *dst, const uint8_t *src, int num)
+{
+    tegra_convert_8888_to_565((uint16_t *)dst, (const uint32_t *)src, num);
+}
+
+static void ref_8888_to_565(uint8_t *dst, const uint8_t *src, int num)
+{
+    unsigned int p;
+
+    for (; num--; dst += 2, src += 4) {
+        p = (src[2] >> 3) << 11 | (src[1] >> 2) << 5 | src[0] >> 3;
+
+        dst[0] = p;
+        dst[1] = p >> 8;
+    }
+}
+
+static void conv_premultiply(uint8_t *dst, const uint8_t *src, int num)
+{
+    tegra_convert_premultiply_8888((uint32_t *)dst, (const uint32_t *)src,
+                                   num);
+}
+
+static void ref_premultiply(uint8_t *dst, const uint8_t *src, int num)
+{
+    unsigned int i;
+
+    for (; num--; dst += 4, src += 4) {
+        for (i = 0; i < 3; i++)
+            dst[i] = (src[i] * src[3] * 2 + 255) / 510;
+
+        dst[3] = src[3];
+    }
+}
+
+static void conv_semiplanar(uint8_t *dst, const uint8_t *src, int num)
+{
+    tegra_convert_yuv_to_semiplanar(dst, src, src + num, num);
+}
+
+static void ref_semiplanar(uint8_t *dst, const uint8_t *src, int num)
+{
+    int i;
+
+    for (i = 0; i < num; i++) {
+        dst[i * 2 + 0] = src[i];
+        dst[i * 2 + 1] = src[num + i];
+    }
+}
+
+static void conv_yuyv(uint8_t *dst, const uint8_t *src, int num)
+{
+    tegra_convert_yuv_to_packed(dst, src, src + num, src + num * 3 / 2,
+                                num, false);
+}
+
+static void ref_yuyv(uint8_t *dst, const uint8_t *src, int num)
+{
+    int i;
+
+    for (i = 0; i < num; i++) {
+        dst[i * 2 + 0] = src[i];
+        dst[i * 2 + 1] = src[num + (i & 1) * num / 2 + i / 2];
+    }
+}
+
+static void conv_uyvy(uint8_t *dst, const uint8_t *src, int num)
+{
+    tegra_convert_yuv_to_packed(dst, src, src + num, src + num * 3 / 2,
+                                num, true);
+}
+
+static void ref_uyvy(uint8_t *dst, const uint8_t *src, int num)
+{
+    int i;
+
+    for (i = 0; i < num; i++) {
+        dst[i * 2 + 0] = src[num + (i & 1) * num / 2 + i / 2];
+        dst[i * 2 + 1] = src[i];
+    }
+}
+
+struct bench_conversion {
+    const char *name;
+    void (*conv)(uint8_t *dst, const uint8_t *src, int num);
+    void (*ref)(uint8_t *dst, const uint8_t *src, int num);
+    unsigned int dst_cpp;
+    bool even;
+};
+
+static const struct bench_conversion bench_conversions[] = {
+    { "swizzle 8888",       conv_swizzle,     ref_swizzle,     4, false },
+    { "565 -> 8888",        conv_565_to_8888, ref_565_to_8888, 4, false },
+    { "8888 -> 565",        conv_8888_to_565, ref_8888_to_565, 2, false },
+    { "premultiply 8888",   conv_premultiply, ref_premultiply, 4, false },
+    { "planar -> NV12 UV",  conv_semiplanar,  ref_semiplanar,  2, false },
+    { "planar -> YUYV",     conv_yuyv,        ref_yuyv,        2, true  },
+    { "planar -> UYVY",     conv_uyvy,        ref_uyvy,        2, true  },
+};
+
+static void bench_pixel_conversions(void)
+{
+    const struct bench_conversion *c;
+    uint64_t pixels, start, elapsed;
+    char *src, *dst, *ref;
+    unsigned int i;
+    int num;
+
+    src = bench_alloc(1920 * 4);
+    dst = bench_alloc(1920 * 4);
+    ref = bench_alloc(1920 * 4);
+
+    bench_fill(src, 1920 * 4, 3);
+
+    printf("pixel conversions, Mpix/s:\n");
+
+    for (i = 0; i < ARRAY_SIZE(bench_conversions); i++) {
+        c = &bench_conversions[i];
+
+        for (num = 1; num <= 67; num++) {
+            if (c->even && (num & 1))
+                continue;
+
+            memset(dst, 0x5a, 1920 * 4);
+            memset(ref, 0x5a, 1920 * 4);
+
+            c->conv((uint8_t *)dst, (uint8_t *)src, num);
+            c->ref((uint8_t *)ref, (uint8_t *)src, num);
+
+            /* also checks that nothing is written past the line */
+            if (memcmp(dst, ref, num * c->dst_cpp + 64)) {
+                fprintf(stderr, "%s: data mismatch, %d pixels\n",
+                        c->name, num);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        pixels = 0;
+        start = bench_time_ns();
+
+        do {
+            c->conv((uint8_t *)dst, (uint8_t *)src, 1920);
+            pixels += 1920;
+            elapsed = bench_time_ns() - start;
+        } while (elapsed < BENCH_CELL_TIME_NS);
+
+        printf("%-24s %10.1f\n", c->name, pixels * 1000.0 / elapsed);
+    }
+
+    printf("\n");
+
+    free(ref);
+    free(dst);
+    free(src);
+}
+
+/* scale_x, scale_y, offset_x, offset_y, 16.16 fixed point */
+static const int32_t bench_scales[][4] = {
+    {  0x10000,    0x10000,    0,          0         },
+    {  0x8000,     0x8000,     0x4000,    -0x24000   },
+    {  0x2aaab,    0x18000,   -0x123456,   0x7fff    },
+    { -0x10000,    0x10000,    0x2000000,  0         },
+    {  INT32_MAX,  INT32_MIN,  INT32_MAX,  INT32_MIN },
+};
+
+/* like pixman_transform_point_3d(), partial products are 64 bits */
+static void ref_transform_point(int32_t m[3][3], int32_t v[3])
+{
+    int32_t result[3];
+    int64_t partial;
+    int i, j;
+
+    for (j = 0; j < 3; j++) {
+        partial = 0;
+
+        for (i = 0; i < 3; i++)
+            partial += (int64_t) m[j][i] * v[i];
+
+        result[j] = (int32_t)((partial + 0x8000) >> 16);
+    }
+
+    memcpy(v, result, sizeof(result));
+}
+
+static void ref_transform_boxes(int32_t *dst, const int32_t *src, int num,
+                                int32_t m[3][3])
+{
+    int32_t v[3];
+
+    for (; num > 0; num--, src += 4, dst += 4) {
+        v[0] = src[0] * 65536;
+        v[1] = src[1] * 65536;
+        v[2] = 65536;
+
+        ref_transform_point(m, v);
+
+        dst[0] = v[0] >> 16;
+        dst[1] = v[1] >> 16;
+
+        v[0] = src[2] * 65536;
+        v[1] = src[3] * 65536;
+        v[2] = 65536;
+
+        ref_transform_point(m, v);
+
+        dst[2] = v[0] >> 16;
+        dst[3] = v[1] >> 16;
+    }
+}
+
+static void bench_scale_matrix(const int32_t *scale, int32_t m[3][3])
+{
+    memset(m, 0, sizeof(int32_t) * 9);
+
+    m[0][0] = scale[0];
+    m[0][2] = scale[2];
+    m[1][1] = scale[1];
+    m[1][2] = scale[3];
+    m[2][2] = 65536;
+}
+
+static double bench_transform(const int32_t *scale, int32_t *dst,
+                              const int32_t *src, int batch, bool general)
+{
+    uint64_t rects = 0, start, elapsed;
+    int32_t m[3][3];
+    int i;
+
+    bench_scale_matrix(scale, m);
+
+    start = bench_time_ns();
+
+    do {
+        for (i = 0; i < BENCH_BOXES; i += batch) {
+            if (general)
+                ref_transform_boxes(dst + i * 4, src + i * 4, batch, m);
+            else
+                tegra_transform_scale_boxes(dst + i * 4, src + i * 4, batch,
+                                            scale[0], scale[1],
+                                            scale[2], scale[3]);
+        }
+
+        rects += BENCH_BOXES;
+        elapsed = bench_time_ns() - start;
+    } while (elapsed < BENCH_CELL_TIME_NS);
+
+    return (double) elapsed / rects;
+}
+
+static void bench_transforms(void)
+{
+    int32_t *src, *dst, *ref;
+    int32_t m[3][3];
+    const int32_t *scale;
+    unsigned int i;
+    int num;
+
+    src = (int32_t *) bench_alloc(BENCH_BOXES * 16);
+    dst = (int32_t *) bench_alloc(BENCH_BOXES * 16);
+    ref = (int32_t *) bench_alloc(BENCH_BOXES * 16);
+
+    /* coordinates must fit 16.16 fixed point */
+    for (i = 0; i < BENCH_BOXES * 4; i++)
+        src[i] = (int32_t)((i * 2654435761u) >> 16) % 16384 - 8192;
+
+    printf("per-rect transform setup, ns/rect:\n");
+    printf("%-24s %12s %12s %12s\n", "scale", "general 3x3",
+           "scale", "scale x1024");
+
+    for (i = 0; i < ARRAY_SIZE(bench_scales); i++) {
+        scale = bench_scales[i];
+
+        bench_scale_matrix(scale, m);
+        ref_transform_boxes(ref, src, BENCH_BOXES, m);
+
+        /* batched, per rect and in-place results must be the same */
+        tegra_transform_scale_boxes(dst, src, BENCH_BOXES,
+                                    scale[0], scale[1], scale[2], scale[3]);
+
+        if (memcmp(dst, ref, BENCH_BOXES * 16)) {
+            fprintf(stderr, "scale boxes: data mismatch, scale %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+
+        memcpy(dst, src, BENCH_BOXES * 16);
+
+        for (num = 0; num < BENCH_BOXES; num++)
+            tegra_transform_scale_boxes(dst + num * 4, dst + num * 4, 1,
+                                        scale[0], scale[1],
+                                        scale[2], scale[3]);
+
+        if (memcmp(dst, ref, BENCH_BOXES * 16)) {
+            fprintf(stderr, "scale box: data mismatch, scale %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+
+        printf("%08x:%08x%8s %12.2f %12.2f %12.2f\n",
+               (uint32_t) scale[0], (uint32_t) scale[1], "",
+               bench_transform(scale, dst, src, 1, true),
+               bench_transform(scale, dst, src, 1, false),
+               bench_transform(scale, dst, src, BENCH_BOXES, false));
+    }
+
+    printf("\n");
+
+    free(ref);
+    free(dst);
+    free(src);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+        bench_threads = atoi(argv[1]);
+
+    tegra_memcpy_vfp_init(bench_threads);
+
+    bench_pixel_conversions();
+    bench_transforms();
+    bench_backends(argc > 2 ? argv[2] : NULL);
+
+    tegra_memcpy_vfp_fini();
+
+    return EXIT_SUCCESS;
+}
@@ -21,24 +21,79 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <limits.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/auxv.h>
+#include <sys/syscall.h>
 #include <sys/sysinfo.h>
 
+#ifdef __arm__
+#include <asm/hwcap.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "box_transform.h"
 #include "memcpy_vfp.h"
+#include "pixel_convert.h"
 
 #define BLOCK_SIZE  1024
 
-struct vfpcpy_cfg {
-    tegra_vfp_func cpy;
-    const char *src;
-    char *dst;
-    int size;
-};
+#define ARRAY_SIZE(x)   (sizeof(x) / sizeof((x)[0]))
 
 static __thread char bounce_buf[BLOCK_SIZE] __attribute__((aligned (128)));
 
-static inline void vfpcpy(void *dst, const void *src, int size)
+/*
+ * Copying backends. The VFP backend is the primary one, others exist for
+ * the CPUs without VFPv3 and for non-ARM builds, they are also useful for
+ * comparing the throughput. Backend could be overridden with the
+ * TEGRA_MEMCPY_BACKEND environment variable.
+ *
+ * The copy function copies size bytes (multiple of 64) from uncacheable
+ * src, copy_to_uncached copies size bytes (multiple of 128) from cacheable
+ * src to uncacheable dst. Both are invoked with 128 bytes aligned src and
+ * dst, all other copying paths are built on top of these two.
+ *
+ * Every backend implements both functions:
+ *
+ *  - vfp:     VFP block loads, stores to uncached memory go via ARM regs;
+ *  - neon:    NEON block loads and stores, Tegra20 doesn't have NEON;
+ *  - avx2:    non-temporal loads, non-temporal stores to uncached memory;
+ *  - sse2:    16 bytes loads, non-temporal stores to uncached memory;
+ *  - generic: libc memcpy, the portable fallback.
+ */
+struct tegra_memcpy_backend {
+    const char *name;
+    bool (*supported)(void);
+    void (*copy)(void *dst, const void *src, int size);
+    void (*copy_to_uncached)(void *dst, const void *src, int size);
+};
+
+static void copy_generic(void *dst, const void *src, int size)
+{
+    memcpy(dst, src, size);
+}
+
+static bool generic_supported(void)
+{
+    return true;
+}
+
+static const struct tegra_memcpy_backend backend_generic = {
+    .name               = "generic",
+    .supported          = generic_supported,
+    .copy               = copy_generic,
+    .copy_to_uncached   = copy_generic,
+};
+
+#ifdef __arm__
+static void vfpcpy_vfp(void *dst, const void *src, int size)
 {
     asm volatile(
         "   .fpu vfpv3-d16          \n\t"
@@ -55,55 +110,7 @@ static inline void vfpcpy(void *dst, const void *src, int size)
         : "cc");
 }
 
-void tegra_copy_block_vfp(char *dst, const char *src, int size)
-{
-    vfpcpy(dst, src, size);
-}
-
-void tegra_copy_block_vfp_2_pass(char *dst, const char *src, int size)
-{
-    int i, dir, block_size = BLOCK_SIZE;
-    const char *psrc = src;
-    char *pdst = dst;
-    bool move = true;
-
-    if ((uintptr_t)dst + size <= (uintptr_t)src ||
-        (uintptr_t)src + size <= (uintptr_t)dst)
-            move = false;
-
-    do {
-        if (size <= block_size) {
-            block_size = size;
-            move = false;
-        }
-
-        dir = (pdst > psrc && move) ? -1 : 1;
-
-        if (dir < 0) {
-            psrc += size - block_size;
-            pdst += size - block_size;
-        }
-
-        for (i = 0; i < size / block_size; i++) {
-            vfpcpy(bounce_buf, psrc, block_size);
-            memcpy(pdst, bounce_buf, block_size);
-
-            psrc += block_size * dir;
-            pdst += block_size * dir;
-        }
-
-        size -= block_size * i;
-
-        if (dst > pdst)
-            pdst = dst;
-
-        if (src > psrc)
-            psrc = src;
-
-    } while (size);
-}
-
-void tegra_copy_block_vfp_arm(char *dst, const char *src, int size)
+static void vfpcpy_to_uncached(void *dst, const void *src, int size)
 {
     asm volatile(
         "   .fpu vfpv3-d16          \n\t"
@@ -157,6 +164,293 @@ void tegra_copy_block_vfp_arm(char *dst, const char *src, int size)
         : "cc", "d8", "d9", "d10", "d11", "d12", "d13", "d14", "d15");
 }
 
+static bool vfp_supported(void)
+{
+    unsigned long hwcap = getauxval(AT_HWCAP);
+
+    return (hwcap & HWCAP_VFP) && (hwcap & HWCAP_VFPv3);
+}
+
+static const struct tegra_memcpy_backend backend_vfp = {
+    .name               = "vfp",
+    .supported          = vfp_supported,
+    .copy               = vfpcpy_vfp,
+    .copy_to_uncached   = vfpcpy_to_uncached,
+};
+
+static void neoncpy_to_uncached(void *dst, const void *src, int size)
+{
+    asm volatile(
+        "   .fpu neon               \n\t"
+        "   .arch armv7a            \n\t"
+        "0:                         \n\t"
+        "   vld1.8 {d0-d3}, [%1]!   \n\t"
+        "   vld1.8 {d4-d7}, [%1]!   \n\t"
+        "   vld1.8 {d16-d19}, [%1]! \n\t"
+        "   vld1.8 {d20-d23}, [%1]! \n\t"
+        "   subs  %2, %2, #128      \n\t"
+        "   beq   1f                \n\t"
+        "   pld   [%1, #0]          \n\t"
+        "   pld   [%1, #32]         \n\t"
+        "   pld   [%1, #64]         \n\t"
+        "   pld   [%1, #96]         \n\t"
+        "1:                         \n\t"
+        "   vst1.8 {d0-d3}, [%0]!   \n\t"
+        "   vst1.8 {d4-d7}, [%0]!   \n\t"
+        "   vst1.8 {d16-d19}, [%0]! \n\t"
+        "   vst1.8 {d20-d23}, [%0]! \n\t"
+        "   bgt   0b                \n\t"
+        : "+r" (dst), "+r" (src), "+r" (size)
+        :
+        : "cc", "memory", "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7",
+          "d16", "d17", "d18", "d19", "d20", "d21", "d22", "d23");
+}
+
+static void neoncpy(void *dst, const void *src, int size)
+{
+    asm volatile(
+        "   .fpu neon               \n\t"
+        "   .arch armv7a            \n\t"
+        "0:                         \n\t"
+        "   subs  %2, %2, #64       \n\t"
+        "   vld1.8 {d0-d3}, [%1]!   \n\t"
+        "   vld1.8 {d4-d7}, [%1]!   \n\t"
+        "   pld   [%1, #0]          \n\t"
+        "   pld   [%1, #32]         \n\t"
+        "   vst1.8 {d0-d3}, [%0]!   \n\t"
+        "   vst1.8 {d4-d7}, [%0]!   \n\t"
+        "   bgt   0b                \n\t"
+        : "+r" (dst), "+r" (src), "+r" (size)
+        :
+        : "cc", "memory", "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7");
+}
+
+static bool neon_supported(void)
+{
+    return !!(getauxval(AT_HWCAP) & HWCAP_NEON);
+}
+
+static const struct tegra_memcpy_backend backend_neon = {
+    .name               = "neon",
+    .supported          = neon_supported,
+    .copy               = neoncpy,
+    .copy_to_uncached   = neoncpy_to_uncached,
+};
+
+static const struct tegra_memcpy_backend *backend = &backend_vfp;
+#elif defined(__x86_64__) || defined(__i386__)
+static void __attribute__((target("sse2")))
+sse2cpy(void *dst, const void *src, int size)
+{
+    const __m128i *s = src;
+    __m128i *d = dst;
+    __m128i x0, x1, x2, x3;
+
+    for (; size > 0; size -= 64, s += 4, d += 4) {
+        x0 = _mm_load_si128(s + 0);
+        x1 = _mm_load_si128(s + 1);
+        x2 = _mm_load_si128(s + 2);
+        x3 = _mm_load_si128(s + 3);
+        _mm_store_si128(d + 0, x0);
+        _mm_store_si128(d + 1, x1);
+        _mm_store_si128(d + 2, x2);
+        _mm_store_si128(d + 3, x3);
+    }
+}
+
+/* streaming stores bypass the cache and fill write-combining buffers */
+static void __attribute__((target("sse2")))
+sse2cpy_to_uncached(void *dst, const void *src, int size)
+{
+    const __m128i *s = src;
+    __m128i *d = dst;
+    __m128i x0, x1, x2, x3;
+
+    for (; size > 0; size -= 64, s += 4, d += 4) {
+        x0 = _mm_load_si128(s + 0);
+        x1 = _mm_load_si128(s + 1);
+        x2 = _mm_load_si128(s + 2);
+        x3 = _mm_load_si128(s + 3);
+        _mm_stream_si128(d + 0, x0);
+        _mm_stream_si128(d + 1, x1);
+        _mm_stream_si128(d + 2, x2);
+        _mm_stream_si128(d + 3, x3);
+    }
+
+    _mm_sfence();
+}
+
+static bool sse2_supported(void)
+{
+    __builtin_cpu_init();
+
+    return __builtin_cpu_supports("sse2");
+}
+
+static const struct tegra_memcpy_backend backend_sse2 = {
+    .name               = "sse2",
+    .supported          = sse2_supported,
+    .copy               = sse2cpy,
+    .copy_to_uncached   = sse2cpy_to_uncached,
+};
+
+/* streaming loads are the fast way of reading write-combined memory */
+static void __attribute__((target("avx2")))
+avx2cpy(void *dst, const void *src, int size)
+{
+    __m256i *s = (__m256i *)src;
+    __m256i *d = dst;
+    __m256i y0, y1;
+
+    for (; size > 0; size -= 64, s += 2, d += 2) {
+        y0 = _mm256_stream_load_si256(s + 0);
+        y1 = _mm256_stream_load_si256(s + 1);
+        _mm256_store_si256(d + 0, y0);
+        _mm256_store_si256(d + 1, y1);
+    }
+
+    _mm256_zeroupper();
+}
+
+static void __attribute__((target("avx2")))
+avx2cpy_to_uncached(void *dst, const void *src, int size)
+{
+    const __m256i *s = src;
+    __m256i *d = dst;
+    __m256i y0, y1, y2, y3;
+
+    for (; size > 0; size -= 128, s += 4, d += 4) {
+        y0 = _mm256_load_si256(s + 0);
+        y1 = _mm256_load_si256(s + 1);
+        y2 = _mm256_load_si256(s + 2);
+        y3 = _mm256_load_si256(s + 3);
+        _mm256_stream_si256(d + 0, y0);
+        _mm256_stream_si256(d + 1, y1);
+        _mm256_stream_si256(d + 2, y2);
+        _mm256_stream_si256(d + 3, y3);
+    }
+
+    _mm_sfence();
+    _mm256_zeroupper();
+}
+
+static bool avx2_supported(void)
+{
+    __builtin_cpu_init();
+
+    return __builtin_cpu_supports("avx2");
+}
+
+static const struct tegra_memcpy_backend backend_avx2 = {
+    .name               = "avx2",
+    .supported          = avx2_supported,
+    .copy               = avx2cpy,
+    .copy_to_uncached   = avx2cpy_to_uncached,
+};
+
+static const struct tegra_memcpy_backend *backend = &backend_generic;
+#else
+static const struct tegra_memcpy_backend *backend = &backend_generic;
+#endif
+
+static const struct tegra_memcpy_backend * const backends[] = {
+#ifdef __arm__
+    &backend_vfp,
+    &backend_neon,
+#elif defined(__x86_64__) || defined(__i386__)
+    &backend_avx2,
+    &backend_sse2,
+#endif
+    &backend_generic,
+};
+
+static void tegra_memcpy_select_backend(void)
+{
+    const char *name = getenv("TEGRA_MEMCPY_BACKEND");
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(backends); i++) {
+        if (name && strcmp(name, backends[i]->name))
+            continue;
+
+        if (backends[i]->supported()) {
+            backend = backends[i];
+            return;
+        }
+    }
+
+    /* first backend is the preferred one */
+    for (i = 0; i < ARRAY_SIZE(backends); i++) {
+        if (backends[i]->supported()) {
+            backend = backends[i];
+            return;
+        }
+    }
+}
+
+const char *tegra_memcpy_backend_name(void)
+{
+    return backend->name;
+}
+
+static inline void vfpcpy(void *dst, const void *src, int size)
+{
+    backend->copy(dst, src, size);
+}
+
+void tegra_copy_block_vfp(char *dst, const char *src, int size)
+{
+    vfpcpy(dst, src, size);
+}
+
+void tegra_copy_block_vfp_2_pass(char *dst, const char *src, int size)
+{
+    int i, dir, block_size = BLOCK_SIZE;
+    const char *psrc = src;
+    char *pdst = dst;
+    bool move = true;
+
+    if ((uintptr_t)dst + size <= (uintptr_t)src ||
+        (uintptr_t)src + size <= (uintptr_t)dst)
+            move = false;
+
+    do {
+        if (size <= block_size) {
+            block_size = size;
+            move = false;
+        }
+
+        dir = (pdst > psrc && move) ? -1 : 1;
+
+        if (dir < 0) {
+            psrc += size - block_size;
+            pdst += size - block_size;
+        }
+
+        for (i = 0; i < size / block_size; i++) {
+            vfpcpy(bounce_buf, psrc, block_size);
+            memcpy(pdst, bounce_buf, block_size);
+
+            psrc += block_size * dir;
+            pdst += block_size * dir;
+        }
+
+        size -= block_size * i;
+
+        if (dst > pdst)
+            pdst = dst;
+
+        if (src > psrc)
+            psrc = src;
+
+    } while (size);
+}
+
+void tegra_copy_block_vfp_arm(char *dst, const char *src, int size)
+{
+    backend->copy_to_uncached(dst, src, size);
+}
+
 void tegra_memcpy_vfp_unaligned_2_pass(char *dst, const char *src, int size)
 {
     int bytes_align = (uintptr_t)src & 127;
@@ -198,73 +492,416 @@ void tegra_memcpy_vfp_unaligned_2_pass(char *dst, const char *src, int size)
         memcpy(dst, src, size);
 }
 
-static void *tegra_memcpy_vfp_thread(void *arg)
+/*
+ * Pitched variants of the above. Source start of the next line is
+ * prefetched before copying the current one, since the prefetching of
+ * the copying loops doesn't cross the end of line.
+ */
+static inline void prefetch_line(const char *src, int line_len)
 {
-    struct vfpcpy_cfg *cfg = arg;
+    __builtin_prefetch(src);
 
-    cfg->cpy(cfg->dst, cfg->src, cfg->size);
+    if (line_len > 32)
+        __builtin_prefetch(src + 32);
+}
 
-    return NULL;
+void tegra_memcpy_2d(char *dst, int dst_pitch,
+                     const char *src, int src_pitch,
+                     int line_len, int height)
+{
+    while (height--) {
+        if (height)
+            prefetch_line(src + src_pitch, line_len);
+
+        memcpy(dst, src, line_len);
+
+        src += src_pitch;
+        dst += dst_pitch;
+    }
+}
+
+void tegra_copy_block_vfp_2d(char *dst, int dst_pitch,
+                             const char *src, int src_pitch,
+                             int line_len, int height)
+{
+    while (height--) {
+        if (height)
+            prefetch_line(src + src_pitch, line_len);
+
+        vfpcpy(dst, src, line_len);
+
+        src += src_pitch;
+        dst += dst_pitch;
+    }
+}
+
+void tegra_copy_block_vfp_2_pass_2d(char *dst, int dst_pitch,
+                                    const char *src, int src_pitch,
+                                    int line_len, int height)
+{
+    /* short lines are bounced without the overlap checking */
+    if (line_len > BLOCK_SIZE ||
+        (dst < src + src_pitch * (height - 1) + line_len &&
+         src < dst + dst_pitch * (height - 1) + line_len)) {
+        while (height--) {
+            tegra_copy_block_vfp_2_pass(dst, src, line_len);
+
+            src += src_pitch;
+            dst += dst_pitch;
+        }
+
+        return;
+    }
+
+    while (height--) {
+        if (height)
+            prefetch_line(src + src_pitch, line_len);
+
+        vfpcpy(bounce_buf, src, line_len);
+        memcpy(dst, bounce_buf, line_len);
+
+        src += src_pitch;
+        dst += dst_pitch;
+    }
+}
+
+void tegra_copy_block_vfp_arm_2d(char *dst, int dst_pitch,
+                                 const char *src, int src_pitch,
+                                 int line_len, int height)
+{
+    while (height--) {
+        if (height)
+            prefetch_line(src + src_pitch, line_len);
+
+        tegra_copy_block_vfp_arm(dst, src, line_len);
+
+        src += src_pitch;
+        dst += dst_pitch;
+    }
+}
+
+void tegra_memcpy_vfp_unaligned_2d(char *dst, int dst_pitch,
+                                   const char *src, int src_pitch,
+                                   int line_len, int height)
+{
+    int head, body, tail;
+    int block_size;
+    bool bounce;
+
+    /* alignment differs from line to line, nothing to hoist */
+    if ((src_pitch & 127) || (dst_pitch & 127) || line_len < 192) {
+        while (height--) {
+            tegra_memcpy_vfp_unaligned(dst, src, line_len);
+
+            src += src_pitch;
+            dst += dst_pitch;
+        }
+
+        return;
+    }
+
+    /* split is the same for all lines, see tegra_memcpy_vfp_unaligned_2_pass */
+    head = (128 - ((uintptr_t)src & 127)) & 127;
+    body = (line_len - head) & ~127;
+    tail = line_len - head - body;
+    bounce = ((uintptr_t)dst + head) & 127;
+
+    while (height--) {
+        const char *psrc = src + head;
+        char *pdst = dst + head;
+        int size = body;
+
+        if (head)
+            memcpy(dst, src, head);
+
+        if (bounce) {
+            while (size) {
+                block_size = size < BLOCK_SIZE ? size : BLOCK_SIZE;
+
+                vfpcpy(bounce_buf, psrc, block_size);
+                memcpy(pdst, bounce_buf, block_size);
+
+                psrc += block_size;
+                pdst += block_size;
+                size -= block_size;
+            }
+        } else if (size) {
+            vfpcpy(pdst, psrc, size);
+
+            psrc += size;
+            pdst += size;
+        }
+
+        if (tail)
+            memcpy(pdst, psrc, tail);
+
+        src += src_pitch;
+        dst += dst_pitch;
+    }
 }
 
 #define MIN_SIZE_PER_THREAD     512
 #define MIN_THREADS_NUM         2
-#define MAX_THREADS_NUM         2
+#define DEFAULT_THREADS_NUM     2
+#define MAX_THREADS_NUM         8
+
+/*
+ * Copying is split between the caller and a pool of long-lived workers.
+ * Workers are parked on a futex and woken up by bumping of the job
+ * generation, each of them copies own part of the job. The caller waits
+ * for all workers on a single completion barrier, so the job descriptor
+ * is never modified while a worker may read it.
+ */
+struct vfpcpy_job {
+    tegra_vfp_func cpy;
+    tegra_vfp_2d_func cpy_2d;
+    const char *src;
+    char *dst;
+    int src_pitch;
+    int dst_pitch;
+    int line_len;
+    int height;
+    int part_size;
+    unsigned int num_parts;
+};
+
+struct vfpcpy_pool {
+    pthread_t threads[MAX_THREADS_NUM - 1];
+    unsigned int num_threads;
+    unsigned int refcnt;
+    struct vfpcpy_job job;
+    uint32_t generation;
+    uint32_t init_generation;   /* generation at the time of pool start */
+    uint32_t pending;
+    bool busy;
+    bool quit;
+};
+
+static struct vfpcpy_pool pool;
+
+static inline void futex_wait(uint32_t *addr, uint32_t val)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static inline void futex_wake(uint32_t *addr, int num)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, num, NULL, NULL, 0);
+}
+
+static void tegra_memcpy_vfp_copy_part(struct vfpcpy_job *job, unsigned int id)
+{
+    const char *src = job->src;
+    char *dst = job->dst;
+    int first, last;
+
+    if (job->height == 1) {
+        src += job->part_size * id;
+        dst += job->part_size * id;
+
+        if (job->cpy)
+            job->cpy(dst, src, job->part_size);
+        else
+            job->cpy_2d(dst, 0, src, 0, job->part_size, 1);
+        return;
+    }
+
+    first = job->height * id / job->num_parts;
+    last  = job->height * (id + 1) / job->num_parts;
+
+    src += job->src_pitch * first;
+    dst += job->dst_pitch * first;
+
+    job->cpy_2d(dst, job->dst_pitch, src, job->src_pitch,
+                job->line_len, last - first);
+}
+
+static void *tegra_memcpy_vfp_worker(void *arg)
+{
+    unsigned int id = (uintptr_t)arg;
+    uint32_t generation = pool.init_generation;
+    uint32_t current;
+
+    for (;;) {
+        current = __atomic_load_n(&pool.generation, __ATOMIC_ACQUIRE);
+        if (current == generation) {
+            futex_wait(&pool.generation, generation);
+            continue;
+        }
+
+        generation = current;
+
+        if (pool.quit)
+            break;
+
+        if (id < pool.job.num_parts)
+            tegra_memcpy_vfp_copy_part(&pool.job, id);
+
+        if (!__atomic_sub_fetch(&pool.pending, 1, __ATOMIC_ACQ_REL))
+            futex_wake(&pool.pending, 1);
+    }
+
+    return NULL;
+}
+
+static void tegra_memcpy_vfp_kick_workers(void)
+{
+    __atomic_store_n(&pool.pending, pool.num_threads, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pool.generation, 1, __ATOMIC_RELEASE);
+    futex_wake(&pool.generation, INT_MAX);
+}
+
+static void tegra_memcpy_vfp_wait_workers(void)
+{
+    uint32_t pending;
+
+    while ((pending = __atomic_load_n(&pool.pending, __ATOMIC_ACQUIRE)))
+        futex_wait(&pool.pending, pending);
+}
+
+int tegra_memcpy_vfp_init(unsigned int num_threads)
+{
+    unsigned int i;
+
+    if (pool.refcnt++)
+        return 0;
+
+    tegra_memcpy_select_backend();
+    tegra_convert_init();
+    tegra_transform_init();
+
+    if (!num_threads)
+        num_threads = DEFAULT_THREADS_NUM;
+
+    if (num_threads > (unsigned int)get_nprocs())
+        num_threads = get_nprocs();
+
+    if (num_threads > MAX_THREADS_NUM)
+        num_threads = MAX_THREADS_NUM;
+
+    /*
+     * Generation isn't reset across pool restarts, workers shall not
+     * mistake the last job of the previous pool for a new one.
+     */
+    pool.init_generation = pool.generation;
+
+    /* the caller is one of the copying threads */
+    for (i = 0; i + 1 < num_threads; i++) {
+        if (pthread_create(&pool.threads[i], NULL, tegra_memcpy_vfp_worker,
+                           (void *)(uintptr_t)(i + 1)))
+            break;
+    }
+
+    pool.num_threads = i;
+
+    return 0;
+}
+
+void tegra_memcpy_vfp_fini(void)
+{
+    unsigned int i;
+
+    if (!pool.refcnt || --pool.refcnt)
+        return;
+
+    if (pool.num_threads) {
+        pool.quit = true;
+        tegra_memcpy_vfp_kick_workers();
+
+        for (i = 0; i < pool.num_threads; i++)
+            pthread_join(pool.threads[i], NULL);
+    }
+
+    pool.num_threads = 0;
+    pool.pending = 0;
+    pool.quit = false;
+
+    memset(&pool.job, 0, sizeof(pool.job));
+}
 
 static unsigned int tegra_num_copy_threads(int size)
 {
-    int size_threads = (size + MIN_SIZE_PER_THREAD) / MIN_SIZE_PER_THREAD;
-    int cpu_threads = size_threads > 1 ? get_nprocs() : 1;
-    int threads_num = size_threads < cpu_threads ? size_threads : cpu_threads;
+    unsigned int size_threads = (size + MIN_SIZE_PER_THREAD) / MIN_SIZE_PER_THREAD;
+    unsigned int threads_num = pool.num_threads + 1;
+
+    if (size_threads < threads_num)
+        threads_num = size_threads;
 
     if (threads_num < MIN_THREADS_NUM)
         return 1;
 
-    if (threads_num > MAX_THREADS_NUM)
-        return MAX_THREADS_NUM;
-
     return threads_num;
 }
 
-void tegra_memcpy_vfp_threaded(char *dst, const char *src, int size,
-                               tegra_vfp_func copy_func)
+static void tegra_memcpy_vfp_run_job(char *dst, int dst_pitch,
+                                     const char *src, int src_pitch,
+                                     int line_len, int height,
+                                     tegra_vfp_func copy_func,
+                                     tegra_vfp_2d_func copy_func_2d)
 {
-    unsigned int threads_num = tegra_num_copy_threads(size);
-    struct vfpcpy_cfg cfgs[MAX_THREADS_NUM];
-    pthread_t threads[MAX_THREADS_NUM];
-    unsigned int thread_cpy_size;
-    void *thread_arg;
-    unsigned int i;
+    unsigned int num_parts = tegra_num_copy_threads(line_len * height);
+    struct vfpcpy_job *job = &pool.job;
+    int size;
 
-    /* memmove isn't supported by the threaded copying */
-    assert(dst >= src + size || src >= dst + size);
+    /* single line is split into 128 bytes aligned chunks */
+    if (height == 1 && num_parts > (unsigned int)(line_len / 128))
+        num_parts = line_len / 128;
 
-    if (threads_num > 1)
-        thread_cpy_size = (size / threads_num) & (~127);
-    else
-        thread_cpy_size = size;
+    if (height > 1 && num_parts > (unsigned int)height)
+        num_parts = height;
 
-    for (i = 0; i < threads_num; i++) {
-        cfgs[i].size = thread_cpy_size;
-        cfgs[i].src  = src;
-        cfgs[i].dst  = dst;
-        cfgs[i].cpy  = copy_func;
+    /* pool may be in use by another thread */
+    if (num_parts < 2 ||
+        __atomic_exchange_n(&pool.busy, true, __ATOMIC_ACQUIRE)) {
+        if (copy_func)
+            copy_func(dst, src, line_len);
+        else
+            copy_func_2d(dst, dst_pitch, src, src_pitch, line_len, height);
 
-        src += thread_cpy_size;
-        dst += thread_cpy_size;
+        return;
     }
 
-    for (i = 1; i < threads_num; i++) {
-        thread_arg = (void*) &cfgs[i];
-        pthread_create(&threads[i], NULL, tegra_memcpy_vfp_thread, thread_arg);
+    job->cpy        = copy_func;
+    job->cpy_2d     = copy_func_2d;
+    job->src        = src;
+    job->dst        = dst;
+    job->src_pitch  = src_pitch;
+    job->dst_pitch  = dst_pitch;
+    job->line_len   = line_len;
+    job->height     = height;
+    job->part_size  = (line_len / num_parts) & (~127);
+    job->num_parts  = num_parts;
+
+    tegra_memcpy_vfp_kick_workers();
+
+    tegra_memcpy_vfp_copy_part(job, 0);
+
+    if (height == 1) {
+        size = job->part_size * num_parts;
+
+        if (line_len > size)
+            memcpy(dst + size, src + size, line_len - size);
     }
 
-    copy_func(cfgs[0].dst, cfgs[0].src, cfgs[0].size);
+    tegra_memcpy_vfp_wait_workers();
 
-    size -= thread_cpy_size * threads_num;
-    if (size)
-        memcpy(dst, src, size);
+    __atomic_store_n(&pool.busy, false, __ATOMIC_RELEASE);
+}
+
+void tegra_memcpy_vfp_threaded_2d(char *dst, int dst_pitch,
+                                  const char *src, int src_pitch,
+                                  int line_len, int height,
+                                  tegra_vfp_2d_func copy_func)
+{
+    tegra_memcpy_vfp_run_job(dst, dst_pitch, src, src_pitch,
+                             line_len, height, NULL, copy_func);
+}
+
+void tegra_memcpy_vfp_threaded(char *dst, const char *src, int size,
+                               tegra_vfp_func copy_func)
+{
+    /* memmove isn't supported by the threaded copying */
+    assert(dst >= src + size || src >= dst + size);
 
-    for (i = 1; i < threads_num; i++)
-        pthread_join(threads[i], NULL);
+    tegra_memcpy_vfp_run_job(dst, size, src, size, size, 1, copy_func, NULL);
 }
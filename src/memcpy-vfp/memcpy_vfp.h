@@ -30,12 +30,45 @@
 #include <string.h>
 
 typedef void (*tegra_vfp_func)(char *dst, const char *src, int size);
+typedef void (*tegra_vfp_2d_func)(char *dst, int dst_pitch,
+                                  const char *src, int src_pitch,
+                                  int line_len, int height);
 
 void tegra_copy_block_vfp(char *dst, const char *src, int size);
 void tegra_copy_block_vfp_2_pass(char *dst, const char *src, int size);
 void tegra_copy_block_vfp_arm(char *dst, const char *src, int size);
 void tegra_memcpy_vfp_unaligned_2_pass(char *dst, const char *src, int size);
 
+/*
+ * Pitched copying of height lines, the aligned variants have the same
+ * requirements as the 1D functions below for every line.
+ */
+void tegra_memcpy_2d(char *dst, int dst_pitch,
+                     const char *src, int src_pitch,
+                     int line_len, int height);
+void tegra_copy_block_vfp_2d(char *dst, int dst_pitch,
+                             const char *src, int src_pitch,
+                             int line_len, int height);
+void tegra_copy_block_vfp_2_pass_2d(char *dst, int dst_pitch,
+                                    const char *src, int src_pitch,
+                                    int line_len, int height);
+void tegra_copy_block_vfp_arm_2d(char *dst, int dst_pitch,
+                                 const char *src, int src_pitch,
+                                 int line_len, int height);
+void tegra_memcpy_vfp_unaligned_2d(char *dst, int dst_pitch,
+                                   const char *src, int src_pitch,
+                                   int line_len, int height);
+
+/*
+ * Starts the pool of copying threads, num_threads includes the caller
+ * and 0 selects the default number. The pool is refcounted.
+ */
+int tegra_memcpy_vfp_init(unsigned int num_threads);
+void tegra_memcpy_vfp_fini(void);
+
+/* name of the copying backend selected at init time */
+const char *tegra_memcpy_backend_name(void);
+
 /*
  * Use multi-threaded copying for a large transfers from uncached memory.
  *
@@ -45,6 +78,12 @@ void tegra_memcpy_vfp_unaligned_2_pass(char *dst, const char *src, int size);
 void tegra_memcpy_vfp_threaded(char *dst, const char *src, int size,
                                tegra_vfp_func copy_func);
 
+/* same as above, but copies height lines, lines are split between threads */
+void tegra_memcpy_vfp_threaded_2d(char *dst, int dst_pitch,
+                                  const char *src, int src_pitch,
+                                  int line_len, int height,
+                                  tegra_vfp_2d_func copy_func);
+
 /* use this when src is uncacheable */
 static inline void
 tegra_memcpy_vfp_unaligned(char *dst, const char *src, int size)
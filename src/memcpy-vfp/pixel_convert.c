@@ -0,0 +1,366 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <sys/auxv.h>
+
+#ifdef __arm__
+#include <asm/hwcap.h>
+#endif
+
+#include "pixel_convert.h"
+
+static bool use_neon;
+
+/*
+ * C variants, also used for the tails of the NEON variants which process
+ * 8 or 16 pixels per iteration.
+ */
+static void swizzle_8888_c(uint32_t *dst, const uint32_t *src, int num)
+{
+    uint32_t p;
+
+    while (num-- > 0) {
+        p = *src++;
+        *dst++ = (p & 0xff00ff00) | ((p >> 16) & 0xff) | ((p & 0xff) << 16);
+    }
+}
+
+static void convert_565_to_8888_c(uint32_t *dst, const uint16_t *src, int num)
+{
+    uint32_t p, r, g, b;
+
+    while (num-- > 0) {
+        p = *src++;
+
+        r = (p >> 11) & 0x1f;
+        g = (p >> 5) & 0x3f;
+        b = p & 0x1f;
+
+        r = (r << 3) | (r >> 2);
+        g = (g << 2) | (g >> 4);
+        b = (b << 3) | (b >> 2);
+
+        *dst++ = 0xff000000 | (r << 16) | (g << 8) | b;
+    }
+}
+
+static void convert_8888_to_565_c(uint16_t *dst, const uint32_t *src, int num)
+{
+    uint32_t p;
+
+    while (num-- > 0) {
+        p = *src++;
+        *dst++ = ((p >> 8) & 0xf800) | ((p >> 5) & 0x07e0) | ((p >> 3) & 0x1f);
+    }
+}
+
+static inline uint32_t mul_un8(uint32_t c, uint32_t a)
+{
+    uint32_t t = c * a + 128;
+
+    return (t + (t >> 8)) >> 8;
+}
+
+static void premultiply_8888_c(uint32_t *dst, const uint32_t *src, int num)
+{
+    uint32_t p, a;
+
+    while (num-- > 0) {
+        p = *src++;
+        a = p >> 24;
+
+        *dst++ = (a << 24) |
+                 (mul_un8((p >> 16) & 0xff, a) << 16) |
+                 (mul_un8((p >> 8) & 0xff, a) << 8) |
+                  mul_un8(p & 0xff, a);
+    }
+}
+
+static void yuv_to_semiplanar_c(uint8_t *dst_uv, const uint8_t *src_u,
+                                const uint8_t *src_v, int num)
+{
+    while (num-- > 0) {
+        *dst_uv++ = *src_u++;
+        *dst_uv++ = *src_v++;
+    }
+}
+
+static void yuv_to_packed_c(uint8_t *dst, const uint8_t *src_y,
+                            const uint8_t *src_u, const uint8_t *src_v,
+                            int num, bool uyvy)
+{
+    for (; num > 1; num -= 2, src_y += 2, dst += 4) {
+        if (uyvy) {
+            dst[0] = *src_u++;
+            dst[1] = src_y[0];
+            dst[2] = *src_v++;
+            dst[3] = src_y[1];
+        } else {
+            dst[0] = src_y[0];
+            dst[1] = *src_u++;
+            dst[2] = src_y[1];
+            dst[3] = *src_v++;
+        }
+    }
+}
+
+#ifdef __arm__
+static void swizzle_8888_neon(uint32_t *dst, const uint32_t *src, int num)
+{
+    asm volatile(
+        "   .fpu neon                   \n\t"
+        "   .arch armv7a                \n\t"
+        "0:                             \n\t"
+        "   vld4.8 {d0-d3}, [%1]!       \n\t"
+        "   pld   [%1, #64]             \n\t"
+        "   vswp  d0, d2                \n\t"
+        "   vst4.8 {d0-d3}, [%0]!       \n\t"
+        "   subs  %2, %2, #8            \n\t"
+        "   bgt   0b                    \n\t"
+        : "+r" (dst), "+r" (src), "+r" (num)
+        :
+        : "cc", "memory", "d0", "d1", "d2", "d3");
+}
+
+static void convert_565_to_8888_neon(uint32_t *dst, const uint16_t *src,
+                                     int num)
+{
+    asm volatile(
+        "   .fpu neon                   \n\t"
+        "   .arch armv7a                \n\t"
+        "   vmov.u8 d3, #255            \n\t"
+        "0:                             \n\t"
+        "   vld1.16 {d4-d5}, [%1]!      \n\t"
+        "   pld   [%1, #64]             \n\t"
+        "   vshrn.u16 d2, q2, #8        \n\t"
+        "   vshrn.u16 d1, q2, #3        \n\t"
+        "   vmovn.u16 d0, q2            \n\t"
+        "   vshl.u8 d0, d0, #3          \n\t"
+        "   vsri.u8 d2, d2, #5          \n\t"
+        "   vsri.u8 d1, d1, #6          \n\t"
+        "   vsri.u8 d0, d0, #5          \n\t"
+        "   vst4.8 {d0-d3}, [%0]!       \n\t"
+        "   subs  %2, %2, #8            \n\t"
+        "   bgt   0b                    \n\t"
+        : "+r" (dst), "+r" (src), "+r" (num)
+        :
+        : "cc", "memory", "d0", "d1", "d2", "d3", "d4", "d5");
+}
+
+static void convert_8888_to_565_neon(uint16_t *dst, const uint32_t *src,
+                                     int num)
+{
+    asm volatile(
+        "   .fpu neon                   \n\t"
+        "   .arch armv7a                \n\t"
+        "0:                             \n\t"
+        "   vld4.8 {d0-d3}, [%1]!       \n\t"
+        "   pld   [%1, #64]             \n\t"
+        "   vshll.u8 q8, d2, #8         \n\t"
+        "   vshll.u8 q9, d1, #8         \n\t"
+        "   vshll.u8 q10, d0, #8        \n\t"
+        "   vsri.u16 q8, q9, #5         \n\t"
+        "   vsri.u16 q8, q10, #11       \n\t"
+        "   vst1.16 {d16-d17}, [%0]!    \n\t"
+        "   subs  %2, %2, #8            \n\t"
+        "   bgt   0b                    \n\t"
+        : "+r" (dst), "+r" (src), "+r" (num)
+        :
+        : "cc", "memory", "d0", "d1", "d2", "d3",
+          "d16", "d17", "d18", "d19", "d20", "d21");
+}
+
+/* (t + ((t + 128) >> 8) + 128) >> 8 is the exact rounded division by 255 */
+static void premultiply_8888_neon(uint32_t *dst, const uint32_t *src, int num)
+{
+    asm volatile(
+        "   .fpu neon                   \n\t"
+        "   .arch armv7a                \n\t"
+        "0:                             \n\t"
+        "   vld4.8 {d0-d3}, [%1]!       \n\t"
+        "   pld   [%1, #64]             \n\t"
+        "   vmull.u8 q8, d0, d3         \n\t"
+        "   vmull.u8 q9, d1, d3         \n\t"
+        "   vmull.u8 q10, d2, d3        \n\t"
+        "   vrshr.u16 q11, q8, #8       \n\t"
+        "   vraddhn.u16 d0, q8, q11     \n\t"
+        "   vrshr.u16 q11, q9, #8       \n\t"
+        "   vraddhn.u16 d1, q9, q11     \n\t"
+        "   vrshr.u16 q11, q10, #8      \n\t"
+        "   vraddhn.u16 d2, q10, q11    \n\t"
+        "   vst4.8 {d0-d3}, [%0]!       \n\t"
+        "   subs  %2, %2, #8            \n\t"
+        "   bgt   0b                    \n\t"
+        : "+r" (dst), "+r" (src), "+r" (num)
+        :
+        : "cc", "memory", "d0", "d1", "d2", "d3",
+          "d16", "d17", "d18", "d19", "d20", "d21", "d22", "d23");
+}
+
+static void yuv_to_semiplanar_neon(uint8_t *dst_uv, const uint8_t *src_u,
+                                   const uint8_t *src_v, int num)
+{
+    asm volatile(
+        "   .fpu neon                   \n\t"
+        "   .arch armv7a                \n\t"
+        "0:                             \n\t"
+        "   vld1.8 {d0-d1}, [%1]!       \n\t"
+        "   vld1.8 {d2-d3}, [%2]!       \n\t"
+        "   vst2.8 {d0,d2}, [%0]!       \n\t"
+        "   vst2.8 {d1,d3}, [%0]!       \n\t"
+        "   subs  %3, %3, #16           \n\t"
+        "   bgt   0b                    \n\t"
+        : "+r" (dst_uv), "+r" (src_u), "+r" (src_v), "+r" (num)
+        :
+        : "cc", "memory", "d0", "d1", "d2", "d3");
+}
+
+static void yuv_to_yuyv_neon(uint8_t *dst, const uint8_t *src_y,
+                             const uint8_t *src_u, const uint8_t *src_v,
+                             int num)
+{
+    asm volatile(
+        "   .fpu neon                   \n\t"
+        "   .arch armv7a                \n\t"
+        "0:                             \n\t"
+        "   vld2.8 {d0,d2}, [%1]!       \n\t"
+        "   vld1.8 {d1}, [%2]!          \n\t"
+        "   vld1.8 {d3}, [%3]!          \n\t"
+        "   vst4.8 {d0-d3}, [%0]!       \n\t"
+        "   subs  %4, %4, #16           \n\t"
+        "   bgt   0b                    \n\t"
+        : "+r" (dst), "+r" (src_y), "+r" (src_u), "+r" (src_v), "+r" (num)
+        :
+        : "cc", "memory", "d0", "d1", "d2", "d3");
+}
+
+static void yuv_to_uyvy_neon(uint8_t *dst, const uint8_t *src_y,
+                             const uint8_t *src_u, const uint8_t *src_v,
+                             int num)
+{
+    asm volatile(
+        "   .fpu neon                   \n\t"
+        "   .arch armv7a                \n\t"
+        "0:                             \n\t"
+        "   vld2.8 {d1,d3}, [%1]!       \n\t"
+        "   vld1.8 {d0}, [%2]!          \n\t"
+        "   vld1.8 {d2}, [%3]!          \n\t"
+        "   vst4.8 {d0-d3}, [%0]!       \n\t"
+        "   subs  %4, %4, #16           \n\t"
+        "   bgt   0b                    \n\t"
+        : "+r" (dst), "+r" (src_y), "+r" (src_u), "+r" (src_v), "+r" (num)
+        :
+        : "cc", "memory", "d0", "d1", "d2", "d3");
+}
+#endif
+
+/* number of pixels handled by the NEON variant, it doesn't handle tails */
+static inline int neon_pixels(int num, int step)
+{
+    return use_neon ? num & ~(step - 1) : 0;
+}
+
+void tegra_convert_swizzle_8888(uint32_t *dst, const uint32_t *src, int num)
+{
+    int bulk = neon_pixels(num, 8);
+
+#ifdef __arm__
+    if (bulk)
+        swizzle_8888_neon(dst, src, bulk);
+#endif
+    swizzle_8888_c(dst + bulk, src + bulk, num - bulk);
+}
+
+void tegra_convert_565_to_8888(uint32_t *dst, const uint16_t *src, int num)
+{
+    int bulk = neon_pixels(num, 8);
+
+#ifdef __arm__
+    if (bulk)
+        convert_565_to_8888_neon(dst, src, bulk);
+#endif
+    convert_565_to_8888_c(dst + bulk, src + bulk, num - bulk);
+}
+
+void tegra_convert_8888_to_565(uint16_t *dst, const uint32_t *src, int num)
+{
+    int bulk = neon_pixels(num, 8);
+
+#ifdef __arm__
+    if (bulk)
+        convert_8888_to_565_neon(dst, src, bulk);
+#endif
+    convert_8888_to_565_c(dst + bulk, src + bulk, num - bulk);
+}
+
+void tegra_convert_premultiply_8888(uint32_t *dst, const uint32_t *src,
+                                    int num)
+{
+    int bulk = neon_pixels(num, 8);
+
+#ifdef __arm__
+    if (bulk)
+        premultiply_8888_neon(dst, src, bulk);
+#endif
+    premultiply_8888_c(dst + bulk, src + bulk, num - bulk);
+}
+
+void tegra_convert_yuv_to_semiplanar(uint8_t *dst_uv,
+                                     const uint8_t *src_u,
+                                     const uint8_t *src_v,
+                                     int num)
+{
+    int bulk = neon_pixels(num, 16);
+
+#ifdef __arm__
+    if (bulk)
+        yuv_to_semiplanar_neon(dst_uv, src_u, src_v, bulk);
+#endif
+    yuv_to_semiplanar_c(dst_uv + bulk * 2, src_u + bulk, src_v + bulk,
+                        num - bulk);
+}
+
+void tegra_convert_yuv_to_packed(uint8_t *dst,
+                                 const uint8_t *src_y,
+                                 const uint8_t *src_u,
+                                 const uint8_t *src_v,
+                                 int num, bool uyvy)
+{
+    int bulk = neon_pixels(num, 16);
+
+#ifdef __arm__
+    if (bulk && uyvy)
+        yuv_to_uyvy_neon(dst, src_y, src_u, src_v, bulk);
+    else if (bulk)
+        yuv_to_yuyv_neon(dst, src_y, src_u, src_v, bulk);
+#endif
+    yuv_to_packed_c(dst + bulk * 2, src_y + bulk,
+                    src_u + bulk / 2, src_v + bulk / 2,
+                    num - bulk, uyvy);
+}
+
+void tegra_convert_init(void)
+{
+#ifdef __arm__
+    use_neon = !!(getauxval(AT_HWCAP) & HWCAP_NEON);
+#endif
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __TEGRA_PIXEL_CONVERT_H
+#define __TEGRA_PIXEL_CONVERT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Pixel format converting copies of a single line, num is the number of
+ * pixels. NEON variants are used when CPU supports NEON, C variants are
+ * used otherwise (Tegra20 and non-ARM builds). There are no alignment
+ * requirements, src and dst shall not overlap unless they are equal.
+ *
+ * 32bpp pixels are in the memory order of a8r8g8b8, i.e. B, G, R, A bytes.
+ */
+
+/* a8r8g8b8 <-> a8b8g8r8 */
+void tegra_convert_swizzle_8888(uint32_t *dst, const uint32_t *src, int num);
+
+/* r5g6b5 -> x8r8g8b8, low bits replicate high bits, X is set to 0xff */
+void tegra_convert_565_to_8888(uint32_t *dst, const uint16_t *src, int num);
+
+/* x8r8g8b8 -> r5g6b5, inverse of the above */
+void tegra_convert_8888_to_565(uint16_t *dst, const uint32_t *src, int num);
+
+/* multiplies color components by alpha, result is rounded like pixman does */
+void tegra_convert_premultiply_8888(uint32_t *dst, const uint32_t *src,
+                                    int num);
+
+/* interleaves U and V planes into UV plane of NV12, num is samples count */
+void tegra_convert_yuv_to_semiplanar(uint8_t *dst_uv,
+                                     const uint8_t *src_u,
+                                     const uint8_t *src_v,
+                                     int num);
+
+/* packs line of planar YUV into YUYV or UYVY, num is luma samples count */
+void tegra_convert_yuv_to_packed(uint8_t *dst,
+                                 const uint8_t *src_y,
+                                 const uint8_t *src_u,
+                                 const uint8_t *src_v,
+                                 int num, bool uyvy);
+
+/* selects NEON or C variants, invoked by tegra_memcpy_vfp_init() */
+void tegra_convert_init(void);
+
+#endif
@@ -130,6 +130,19 @@ int mem_pool_get_next_used_entry(struct mem_pool *pool,
          ITR = mem_pool_get_next_used_entry(POOL, ITR + 1),     \
          ENTRY = (POOL)->entries[ITR < 0 ? 0 : ITR].owner)
 
+/* hands allocation over to another owner */
+static inline void mem_pool_entry_move(struct mem_pool_entry *to,
+                                       struct mem_pool_entry *from)
+{
+    struct mem_pool *pool = from->pool;
+
+    *to = *from;
+    pool->entries[to->id].owner = to;
+
+    from->pool = NULL;
+    from->id = -1;
+}
+
 static inline void mem_pool_open_access(struct mem_pool *pool, char *vbase)
 {
     if (pool->access_refcount++)
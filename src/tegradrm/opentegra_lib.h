@@ -57,6 +57,8 @@ int drm_tegra_bo_get_handle(struct drm_tegra_bo *bo, uint32_t *handle);
 int drm_tegra_bo_map(struct drm_tegra_bo *bo, void **ptr);
 int drm_tegra_bo_unmap(struct drm_tegra_bo *bo);
 int drm_tegra_bo_mapped(struct drm_tegra_bo *bo);
+int drm_tegra_bo_map_head(struct drm_tegra_bo *bo, uint32_t size, void **ptr);
+int drm_tegra_bo_unmap_head(struct drm_tegra_bo *bo, void *ptr, uint32_t size);
 int drm_tegra_bo_reused_from_cache(struct drm_tegra_bo *bo);
 
 int drm_tegra_bo_get_flags(struct drm_tegra_bo *bo, uint32_t *flags);
@@ -223,6 +225,9 @@ int drm_tegra_job_push_reloc_v3(struct drm_tegra_job_v3 *job,
 				uint32_t flags);
 int drm_tegra_job_push_wait_v3(struct drm_tegra_job_v3 *job,
 			       uint32_t threshold);
+int drm_tegra_job_push_wait_syncpt_v3(struct drm_tegra_job_v3 *job,
+				      uint32_t sp_id, uint32_t threshold,
+				      bool job_start);
 int drm_tegra_job_push_syncpt_incr_v3(struct drm_tegra_job_v3 *job,
 				      enum drm_tegra_syncpt_cond cond);
 struct drm_tegra_fence *
@@ -233,6 +238,8 @@ int drm_tegra_job_submit_v3(struct drm_tegra_job_v3 *job,
 int drm_tegra_fence_is_busy_v3(struct drm_tegra_fence *fence);
 int drm_tegra_fence_wait_timeout_v3(struct drm_tegra_fence *fence,
 				    int timeout);
+int drm_tegra_fence_get_syncpt_v3(struct drm_tegra_fence *fence,
+				  uint32_t *sp_id, uint32_t *threshold);
 void drm_tegra_fence_free_v3(struct drm_tegra_fence *fence);
 
 #endif /* __DRM_TEGRA_H__ */
@@ -144,6 +144,8 @@ struct drm_tegra_fence {
 		struct {
 			int32_t sync_file_fd;
 			drmMMListHead job_list;
+			uint32_t sp_id;
+			uint32_t sp_thresh;
 		};
 	};
 };
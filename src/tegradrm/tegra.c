@@ -746,6 +746,44 @@ int drm_tegra_bo_unmap(struct drm_tegra_bo *bo)
 	return 0;
 }
 
+/*
+ * DRM allows to mmap GEM only starting from the beginning of BO, hence a
+ * partial mapping always covers the head of BO. Mapping isn't refcounted
+ * and isn't cached, it's up to caller to manage it.
+ */
+int drm_tegra_bo_map_head(struct drm_tegra_bo *bo, uint32_t size, void **ptr)
+{
+	uint8_t *map;
+
+	if (!bo || !ptr || !size || size > bo->size)
+		return -EINVAL;
+
+	map = drm_tegra_bo_do_mapping(bo, bo->offset + size);
+	if (map == MAP_FAILED) {
+		*ptr = NULL;
+		return -errno;
+	}
+
+	DBG_BO(bo, "size %u\n", size);
+
+	*ptr = map + bo->offset;
+
+	return 0;
+}
+
+int drm_tegra_bo_unmap_head(struct drm_tegra_bo *bo, void *ptr, uint32_t size)
+{
+	if (!bo || !ptr || !size)
+		return -EINVAL;
+
+	DBG_BO(bo, "size %u\n", size);
+
+	if (munmap((uint8_t *)ptr - bo->offset, bo->offset + size))
+		return -errno;
+
+	return 0;
+}
+
 int drm_tegra_bo_mapped(struct drm_tegra_bo *bo)
 {
 	if (!bo)
@@ -58,6 +58,8 @@ drm_tegra_fence_create_v3(struct drm_tegra *drm,
 
 	DRMINITLISTHEAD(&fence->job_list);
 	fence->sync_file_fd = args.fence_fd;
+	fence->sp_thresh = threshold;
+	fence->sp_id = sp_id;
 	fence->version = 3;
 
 	return fence;
@@ -112,6 +114,18 @@ int drm_tegra_fence_wait_timeout_v3(struct drm_tegra_fence *fence,
 	return sync_wait(fence->sync_file_fd, timeout);
 }
 
+int drm_tegra_fence_get_syncpt_v3(struct drm_tegra_fence *fence,
+				  uint32_t *sp_id, uint32_t *threshold)
+{
+	if (!fence || fence->version != 3)
+		return -EINVAL;
+
+	*sp_id = fence->sp_id;
+	*threshold = fence->sp_thresh;
+
+	return 0;
+}
+
 void drm_tegra_fence_free_v3(struct drm_tegra_fence *fence)
 {
 	DRMLISTDEL(&fence->job_list);
@@ -637,6 +651,54 @@ int drm_tegra_job_push_wait_v3(struct drm_tegra_job_v3 *job,
 	return 0;
 }
 
+/*
+ * Makes job to wait for the syncpoint of other channel. The wait is
+ * either placed at the current position of the cmdstream or before
+ * the whole job. Jobs of the same channel are executed in-order, hence
+ * waiting for own syncpoint is omitted.
+ */
+int drm_tegra_job_push_wait_syncpt_v3(struct drm_tegra_job_v3 *job,
+				      uint32_t sp_id, uint32_t threshold,
+				      bool job_start)
+{
+	struct drm_tegra_submit_cmd cmd;
+	int err;
+
+	if (sp_id == job->channel->v3.sp_id)
+		return 0;
+
+	if (!job_start) {
+		err = drm_tegra_job_push_gather_v3(job);
+		if (err)
+			return err;
+	}
+
+	if (job->num_cmds == job->num_cmds_max) {
+		err = drm_tegra_job_resize_v3(job, job->num_words,
+					      job->num_buffers_max,
+					      job->num_cmds_max * 2,
+					      true);
+		if (err)
+			return err;
+	}
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = DRM_TEGRA_SUBMIT_CMD_WAIT_SYNCPT;
+	cmd.wait_syncpt.id = sp_id;
+	cmd.wait_syncpt.threshold = threshold;
+
+	if (job_start) {
+		memmove(job->cmds + 1, job->cmds,
+			job->num_cmds * sizeof(*job->cmds));
+		job->cmds[0] = cmd;
+		job->num_cmds++;
+	} else {
+		job->cmds[job->num_cmds++] = cmd;
+	}
+
+	return 0;
+}
+
 #define HOST1X_OPCODE_NONINCR(offset, count) \
 	((0x2 << 28) | (((offset) & 0xfff) << 16) | ((count) & 0xffff))
 
@@ -180,6 +180,9 @@ typedef struct TegraVideo {
 
     struct drm_tegra_plane_csc_blob csc_blob;
     Bool csc_blob_set;
+
+    /* overlay lacks planar YUV, YV12 / I420 are packed into YUYV by CPU */
+    Bool pack_planar;
 } TegraVideo, *TegraVideoPtr;
 
 typedef struct TegraXvAdaptor {
@@ -1141,8 +1144,15 @@ static Bool TegraVideoOverlayInitialize(TegraVideoPtr priv, ScrnInfoPtr scrn,
     err = drm_get_overlay_plane(tegra->fd, overlay_id,
                                 DRM_FORMAT_YUV420, &plane_id);
     if (err) {
-        success = FALSE;
-        goto end;
+        err = drm_get_overlay_plane(tegra->fd, overlay_id,
+                                    DRM_FORMAT_YUYV, &plane_id);
+        if (err) {
+            success = FALSE;
+            goto end;
+        }
+
+        InfoMsg("overlay %d lacks planar YUV, packing to YUYV\n", overlay_id);
+        priv->pack_planar = TRUE;
     }
 
     err = drm_get_primary_plane(tegra->fd, overlay_id, &primary_plane_id);
@@ -1583,12 +1593,20 @@ static int TegraVideoOverlayPutImage(ScrnInfoPtr scrn,
     TegraVideoPtr priv  = data;
     int passthrough     = 0;
     int ret             = Success;
+    Bool planar_src;
+    uint32_t drm_format;
     int id;
     Bool visible;
 
     if (!xv_fourcc_valid(format))
         return BadImplementation;
 
+    planar_src = (format == FOURCC_YV12 || format == FOURCC_I420);
+    drm_format = xv_fourcc_to_drm(format);
+
+    if (planar_src && priv->pack_planar)
+        drm_format = DRM_FORMAT_YUYV;
+
     switch (format) {
     case FOURCC_PASSTHROUGH_YV12:
     case FOURCC_PASSTHROUGH_RGB565:
@@ -1605,7 +1623,7 @@ static int TegraVideoOverlayPutImage(ScrnInfoPtr scrn,
         break;
     }
 
-    if (!TegraVideoOverlayCreateFB(priv, scrn, xv_fourcc_to_drm(format),
+    if (!TegraVideoOverlayCreateFB(priv, scrn, drm_format,
                                    width, height, passthrough, buf) != Success)
         return BadImplementation;
 
@@ -1614,7 +1632,8 @@ static int TegraVideoOverlayPutImage(ScrnInfoPtr scrn,
         goto clean_up_old_fb;
 
     if (!passthrough)
-        drm_copy_data_to_fb(priv->fb, buf, format == FOURCC_I420);
+        drm_copy_data_to_fb(priv->fb, buf, format == FOURCC_I420,
+                            planar_src);
 
     if (!TegraVideoOverlayPutImageOnOverlays(priv, scrn,
                                              src_x, src_y,